@@ -136,6 +136,7 @@ public:
     std::vector<uint8_t> downloadLatestFrame();
 
     bool mFirst = true;
+    int mFrameCount = -1;      ///< Frames accumulated in this camera's render targets, -1 restarts the accumulation.
 
 private:
     friend class Scene;
@@ -150,6 +151,7 @@ private:
     int mHeight; ///< The height of the viewport.
 
     glm::vec3 mPosition; ///< The camera's position.
+    glm::vec3 mPrevPosition; ///< The camera's position when update() was called last.
 
     float mFx;
     float mFy;
@@ -185,9 +187,15 @@ struct CameraUBO {
     glm::mat4 projectionInverse = glm::mat4(1.0F);
     glm::vec4 position = glm::vec4(1.0F); // vec3 pos + vec1 aperture
     glm::vec4 front = glm::vec4(1.0F); // vec3 front + vec1 focalDistance
+    glm::ivec4 info = glm::ivec4(0); // width + height + frameCount + padding
 
 private:
-    glm::vec4 padding1 = glm::vec4(1.0F); ///< Padding (ignore).
-    glm::vec4 padding2 = glm::vec4(1.0F); ///< Padding (ignore).
+    glm::vec4 padding = glm::vec4(1.0F); ///< Padding (ignore).
+};
+
+/// The cameras of a single trace, indexed by the launch depth.
+/// @ingroup API
+struct CamerasUBO {
+    CameraUBO cameras[global::maxCameras];
 };
 }
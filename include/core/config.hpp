@@ -95,7 +95,8 @@ public:
     /// @param flag If false, the pipelines will not be recreated automatically until this function is called with true.
     void setAutomaticPipelineRefresh(bool flag);
 
-    /// Used to set the maximum amount of geometry (3D models) that can be loaded.
+    /// Geometries are suballocated from a buffer that grows on demand, so their number is not limited anymore.
+    /// @deprecated Kept for compatibility, does nothing.
     void setGeometryLimit(size_t amount);
 
     /// Used to set the maximum amount of geometry instances (instances of 3D models) that can be loaded.
@@ -134,6 +135,39 @@ public:
     inline void setInitialWidth(int w) { mInitialWidth = w; }
     inline void setInitialHeight(int h) { mInitialHeight = h; }
 
+    /// Used to set the number of frames that can be in flight in offscreen mode.
+    ///
+    /// With more than one frame in flight the scene update and command recording of a frame overlap the tracing of the previous one.
+    /// @param n The number of frames in flight, at least 1.
+    /// @warning Needs to be called before the renderer is created, ignored in present mode.
+    void setFramesInFlight(uint32_t n);
+
+    auto getFramesInFlight() const -> uint32_t { return mFramesInFlight; }
+
+    /// Used to set how often the BLAS of a deformed geometry is refit before it is rebuilt.
+    ///
+    /// Refitting keeps the structure of the BLAS, so its quality degrades the further the vertices move.
+    /// @param refits The number of refits between two full builds, 0 rebuilds on every update.
+    inline void setBlasRebuildInterval(uint32_t refits) { mBlasRebuildInterval = refits; }
+
+    auto getBlasRebuildInterval() const -> uint32_t { return mBlasRebuildInterval; }
+
+    /// Used to set how often the top level acceleration structure is refit before it is rebuilt.
+    ///
+    /// Moving instances only refit the TLAS, so its quality degrades over time. It is rebuilt once either limit is crossed.
+    /// @param refits The number of refits between two full builds, 0 rebuilds on every update.
+    /// @param displacement The largest distance an instance may move from where it was at the last full build, relative to
+    /// the extent of all instances' origins at that build. 0 disables the limit. If the origins had no extent at the
+    /// last full build, e.g. a single instance or instances sharing their origin, only the refit count applies.
+    inline void setTlasRebuildPolicy(uint32_t refits, float displacement) {
+        mTlasRebuildInterval = refits;
+        mTlasRebuildDisplacement = displacement;
+    }
+
+    auto getTlasRebuildInterval() const -> uint32_t { return mTlasRebuildInterval; }
+
+    auto getTlasRebuildDisplacement() const -> float { return mTlasRebuildDisplacement; }
+
 private:
     // TODO: separate into fixed and changeable parts
 
@@ -141,6 +175,7 @@ private:
     int mInitialHeight = 600;
 
     bool mPresent = true;                                  /// not changeable: whether or not initialize the surface
+    uint32_t mFramesInFlight = 2;                          /// not changeable: offscreen frames in flight
     vk::Format mFormat = vk::Format::eB8G8R8A8Srgb;
     vk::ColorSpaceKHR mColorSpace = vk::ColorSpaceKHR::eSrgbNonlinear;
 
@@ -151,12 +186,14 @@ private:
 
     size_t mMaxGeometryInstances = 256; ///< Can be set to avoid pipeline recreation everytime a geometry instance is added.
     bool mMaxGeometryInstancesChanged = false;
-    size_t mMaxGeometry = 128; ///< The maximum amount of geometry (Must be a multiple of minimum storage buffer alignment).
-    bool mMaxGeometryChanged = false;
     size_t mMaxTextures = 128; ///< The maximum amount of textures.
     bool mMaxTexturesChanged = false;
     size_t mMaxMaterials = 256;
 
+    uint32_t mBlasRebuildInterval = 32; ///< Refits of a deformed geometry's BLAS between two full builds.
+    uint32_t mTlasRebuildInterval = 256; ///< Refits of the TLAS between two full builds.
+    float mTlasRebuildDisplacement = 0.1F; ///< Relative instance displacement since the last full build that triggers a rebuild.
+
     std::string mAssetsPath; ///< Where all assets like ~~~models, textures and~~~ shaders are stored.
 
     uint32_t mMaxPathDepth = 12;                                     ///< The maximum path depth.
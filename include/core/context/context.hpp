@@ -30,6 +30,7 @@
 #include "core/denoiser.hpp"
 #include "core/rt/rt.hpp"
 #include "core/image.hpp"
+#include "core/readback.hpp"
 
 namespace kuafu {
 
@@ -43,8 +44,11 @@ namespace kuafu {
 
         vkCore::Surface mSurface;     // TODO: kuafu_urgent: update when window changes.
         vk::UniqueDevice mDevice;
+        vkCore::MemoryAllocator mAllocator;     ///< Declared after the device, so all memory is freed before it is destroyed.
         vk::UniqueCommandPool mGraphicsCmdPool;
         vk::UniqueCommandPool mTransferCmdPool;
+        vk::UniqueCommandPool mComputeCmdPool;
+        vkCore::UploadBatch mUploadBatch;       ///< Scene uploads, the render submission waits for its semaphore.
 
         RayTracer mRayTracer;
         PostProcessingRenderer mPostProcessingRenderer;
@@ -55,6 +59,10 @@ namespace kuafu {
         vkCore::CommandBuffer mCommandBuffers2;
         vk::UniqueSemaphore mCmdSemaphore;
 
+        ReadbackRing mReadbackRing;
+        std::vector<std::shared_ptr<Readback>> mPendingReadbacks;   ///< Readbacks waiting for their camera to be rendered.
+        std::vector<std::shared_ptr<Readback>> mReadbackCallbacks;  ///< Submitted readbacks whose callback is yet to be invoked.
+
         // on screen use only
         size_t mCurrentFrame = 0;
         size_t mPrevFrame = 0;
@@ -65,6 +73,10 @@ namespace kuafu {
 
         std::shared_ptr<Gui> pGui = nullptr;
 
+        std::vector<Camera*> mCameras;   ///< The cameras traced by the frame being prepared, one per launch depth.
+        bool mBatched = false;           ///< If true, mCameras are blitted to their own frames instead of post processed.
+        Camera* pPrevCamera = nullptr;   ///< The current camera of the previous frame, whose sync objects track the frames in flight.
+
         std::vector<std::unique_ptr<Scene>> mScenes;
         Scene* mCurrentScene;
         std::shared_ptr<Config> pConfig;
@@ -84,6 +96,21 @@ namespace kuafu {
         /// Retrieves an image from the swapchain and presents it.
         void render();
 
+        /// Renders multiple cameras with a single trace, sharing the scene update and the acceleration structures.
+        ///
+        /// Every camera keeps its own render targets, accumulation and frames, which can be downloaded as usual.
+        /// @param cameras The cameras to render, at most global::maxCameras.
+        /// @note Only available in offscreen mode and without denoiser.
+        void render(const std::vector<Camera*> &cameras);
+
+        /// Makes sure the frames and render targets of all cameras in mCameras exist and binds them to the path tracer.
+        /// @return Returns true if the path tracer's descriptors have to be updated.
+        bool prepareCameras();
+
+        /// Records blits of each camera's path traced image to the camera's frame.
+        /// @param cmdBuf The command buffer to record to.
+        void recordCameraBlits(vk::CommandBuffer cmdBuf);
+
         void initGui();
 
         void initPipelines();
@@ -106,6 +133,26 @@ namespace kuafu {
 
         std::vector<uint8_t> downloadLatestFrameFromSwapchain();
 
+        /// Requests an asynchronous readback of the next frame rendering the given camera.
+        /// @param camera The camera to read back, ignored in present mode where the swapchain image is read back.
+        /// @param channels The kuafu::Readback::Channel bits to read back.
+        /// @param callback Invoked at the beginning of a later frame once the copy is done (optional).
+        /// @return Returns a handle to poll or wait for the readback.
+        std::shared_ptr<Readback> requestReadback(Camera* camera, Readback::Channels channels = Readback::eColor,
+                                                  Readback::Callback callback = nullptr);
+
+        /// Records the copies of all pending readbacks of the cameras rendered by the current frame.
+        /// @param cmdBuf The command buffer to record to, after the frame's images have been written.
+        /// @param imageIndex The current image index.
+        /// @return Returns the recorded readbacks.
+        std::vector<std::shared_ptr<Readback>> recordReadbacks(vk::CommandBuffer cmdBuf, size_t imageIndex);
+
+        /// Blocks until all frames in flight are done, e.g. before modifying resources that are shared by them.
+        void waitForFramesInFlight();
+
+        /// Invokes the callbacks of all readbacks that are done.
+        void dispatchReadbackCallbacks();
+
         [[nodiscard]] inline auto  getCamera() const { return mCurrentScene->mCurrentCamera; }
 
         inline auto& getSync() { return pConfig->mPresent ? mSwapchainSync : getCamera()->mSync; }
@@ -30,13 +30,17 @@ extern std::shared_ptr<spdlog::logger> logger;
 extern int frameCount;
 
 extern std::string assetsPath;
-extern uint32_t materialIndex;
+extern std::string meshCachePath;  ///< Where imported mesh files are cached, empty to disable the cache.
 extern uint32_t textureIndex;
-extern std::vector<NiceMaterial> materials;
+
+/// @return Returns all materials, indexed by the material index of a geometry.
+/// @note The registry is never destroyed, so material handles held by other globals can be released at exit.
+MaterialRegistry &materials();
 
 const size_t maxResources = 2;
 const size_t maxPointLights = 32;
 const size_t maxActiveLights = 8;
+const size_t maxCameras = 16;           ///< Max cameras rendered by a single trace, see Kuafu::run(const std::vector<Camera*>&).
 
 namespace keys {
 extern bool eW;
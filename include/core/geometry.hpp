@@ -4,29 +4,33 @@
 #pragma once
 
 #include "core/context/vertex.hpp"
+#include "core/material.hpp"
 
 namespace kuafu {
+class Scene;
 
-//// Simplified Blender PrincipledBSDF
-struct NiceMaterial {
-    glm::vec3 diffuseColor = glm::vec3(1.0F); /// Diffuse color
-    float alpha = 1.0F;
-
-    std::string diffuseTexPath;
-    std::string metallicTexPath;
-    std::string roughnessTexPath;
-    std::string transmissionTexPath;
+/// How the vertex attributes of a geometry are stored on the device.
+/// @ingroup API
+enum class VertexLayout {
+    eFull,      ///< Full precision normals and texture coordinates, 20 bytes per vertex.
+    eCompact    ///< Octahedral encoded 16 bit normals and half precision texture coordinates, 8 bytes per vertex. Only suited for texture coordinates close to [0, 1], tiled ones lose precision.
+};
 
-    float metallic = 0.0F;
-    float specular = 0.5F;
-    float roughness = 0.5F;
-    float ior = 1.4F;
-    float transmission = 0.0F;
+/// An analytic shape that is intersected exactly by PathTrace.rint instead of being tessellated.
+/// @ingroup API
+struct Primitive {
+    enum class Type : uint32_t {
+        eSphere,    ///< size.x is the radius.
+        eCapsule,   ///< size.x is the half height along the x axis, size.y the radius.
+        eBox        ///< size holds the half extents.
+    };
 
-    glm::vec3 emission = glm::vec3(1.0F);
-    float emissionStrength = 0.0F;
+    Type type = Type::eSphere;
+    glm::vec3 center = glm::vec3(0.F);
+    glm::vec3 size = glm::vec3(1.F);
 
-    friend bool operator==(const NiceMaterial &m1, const NiceMaterial &m2);
+    /// @return Returns the lower and upper corner of the primitive's bounding box.
+    [[nodiscard]] std::pair<glm::vec3, glm::vec3> getBounds() const;
 };
 
 struct Geometry {
@@ -34,27 +38,79 @@ struct Geometry {
 
     void recalculateNormals();
 
+    /// Welds duplicate vertices and reorders triangles and vertices for spatial locality.
+    ///
+    /// Triangles are sorted along a Morton curve through their centroids and vertices are renumbered in the order
+    /// they are first referenced, which speeds up acceleration structure builds and closest hit fetches.
+    /// Vertex colors are ignored unless hasVertexColors is set. The geometry is uploaded again on the next frame.
+    void optimize();
+
     std::vector<Vertex> vertices;   ///< Contains all vertices of the geometry.
     std::vector<uint32_t> indices;  ///< Contains all indices of the geometry.
     std::vector<uint32_t> matIndex; ///< Contains all sub-meshes and their respective materials.
+    std::vector<Primitive> primitives; ///< If not empty, the geometry is procedural and its vertices are ignored. matIndex then holds one entry per primitive.
+    std::vector<MaterialHandle> materials; ///< Keeps the materials referenced by matIndex registered.
     std::string path;         ///< The model's path, relative to the path to assets.
     bool initialized = false; ///< Keeps track of whether or not the geometry was initialized.
+    uint64_t version = 0;     ///< Bumped whenever the geometry's device buffers are (re-)created. Used to invalidate its BLAS.
 
-    bool dynamic = false;     ///< Keeps track of whether or not the geometry is dynamic or static. // TODO: use this field
+    bool dynamic = false;     ///< Dynamic geometries can be deformed in place with Scene::updateGeometryVertices().
     bool isOpaque = true;
     bool hideRender = false;
+
+    VertexLayout vertexLayout = VertexLayout::eFull; ///< Used when the geometry's device buffers are (re-)created.
+    bool hasVertexColors = false;   ///< Vertex colors are only uploaded if set.
 };
 
 struct GeometryInstance {
+    /// Sets the instance's world transform matrix.
+    ///
+    /// Only the instance itself is uploaded again with the next frame and the TLAS is refit.
     void setTransform(const glm::mat4 &transform);
 
-    glm::mat4 transform = glm::mat4(1.0F); ///< The instance's world transform matrix.
+    /// Renders the instance with the given material instead of the materials of its geometry.
+    ///
+    /// A material that is not registered yet is uploaded with the next frame, as is the instance itself.
+    void setMaterial(const NiceMaterial &material);
+
+    glm::mat4 transform = glm::mat4(1.0F); ///< The instance's world transform matrix. Changes have to be made with setTransform() or be followed by Scene::markGeometryInstanceDirty().
     int geometryIndex = -1; ///< Used to assign this instance a model.
     std::shared_ptr<Geometry> geometry = nullptr;
+    MaterialHandle material;                ///< Overrides the geometry's materials if valid.
+    Scene *pScene = nullptr;                ///< The one scene the instance was submitted to, which is notified of changes.
+};
+
+/// The pose of a geometry instance, turned into its world transform on the device.
+/// @see Scene::setInstancePoses()
+/// @ingroup API
+struct Pose {
+    glm::vec3 position = glm::vec3(0.0F);
+    float padding0 = 0.0F;
+    glm::quat rotation = glm::quat(1.0F, 0.0F, 0.0F, 0.0F); ///< Must be normalized, stored as x, y, z, w.
+    glm::vec3 scale = glm::vec3(1.0F);
+    float padding1 = 0.0F;
+};
+
+/// Where the members of a pose are found in an array of floats, see Scene::setInstancePoses().
+///
+/// Position and scale are 3 consecutive floats, the rotation is a normalized quaternion of 4 stored as x, y, z, w.
+/// The defaults describe Pose, tightly packed poses are {10, 0, 3, 7}.
+/// @ingroup API
+struct PoseLayout {
+    uint32_t stride = 12;           ///< The number of floats from one pose to the next.
+    uint32_t positionOffset = 0;
+    uint32_t rotationOffset = 4;
+    uint32_t scaleOffset = 8;
 };
 
-std::vector<std::shared_ptr<Geometry>> loadScene(std::string_view fname, bool dynamic);
-std::shared_ptr<Geometry> loadObj(std::string_view path, bool dynamic = false);
+/// Loads all meshes of a file as geometries.
+/// @param fname The path to the mesh file.
+/// @param dynamic If true, the geometries are flagged dynamic.
+/// @param optimize If true, every mesh is optimized as in Geometry::optimize(). The result is cached with the mesh.
+/// Optimizing welds and reorders vertices, so it should not be used for meshes deformed with the source vertices.
+/// @return Returns a geometry for every mesh with triangles.
+std::vector<std::shared_ptr<Geometry>> loadScene(std::string_view fname, bool dynamic, bool optimize = false);
+std::shared_ptr<Geometry> loadObj(std::string_view path, bool dynamic = false, bool optimize = false);
 
 /// A commodity function for allocating an instance from a given geometry and set its matrices.
 ///
@@ -89,15 +145,80 @@ struct NiceMaterialSSBO {
 /// A wrapper for GeometryInstanceSSBO matching the buffer alignment requirements.
 /// @ingroup API
 struct GeometryInstanceSSBO {
-    glm::mat4 transform = glm::mat4(1.0F); ///< The instance's world transform matrix.
-    //glm::mat4 padding   = glm::mat4( 1.0F ); ///< The inverse transpose of transform.
+    /// The rows of the instance's 3x4 world transform matrix, the same layout as vk::TransformMatrixKHR.
+    std::array<glm::vec4, 3> transform = {glm::vec4(1.0F, 0.0F, 0.0F, 0.0F),
+                                          glm::vec4(0.0F, 1.0F, 0.0F, 0.0F),
+                                          glm::vec4(0.0F, 0.0F, 1.0F, 0.0F)};
     uint32_t geometryIndex = 0;
+    uint32_t materialIndex = MaterialHandle::invalid; ///< Overrides the geometry's material indices if valid.
 
-    uint32_t padding0 = 0;
     uint32_t padding1 = 0;
     uint32_t padding2 = 0;
 };
 
+/// Describes how the device buffers of a geometry are laid out. The flags are mirrored in Geometry.glsl.
+struct GeometryLayout {
+    enum Flags : uint32_t {
+        eIndex16 = 1U << 0U,    ///< Two 16 bit indices are packed per 32 bit word.
+        eCompact = 1U << 1U,    ///< The attributes use VertexLayout::eCompact.
+        eColor = 1U << 2U,      ///< The attributes contain vertex colors.
+        eProcedural = 1U << 3U  ///< The positions hold primitive bounding boxes, the attributes the primitives.
+    };
+
+    uint32_t flags = 0;
+    uint32_t vertexCount = 0;
+    uint32_t primitiveCount = 0;    ///< The number of triangles, or of analytic primitives if procedural.
+
+    [[nodiscard]] inline vk::IndexType getIndexType() const {
+        return (flags & eIndex16) != 0 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    }
+
+    /// @return Returns the number of 32 bit attribute words per vertex of a triangle geometry.
+    [[nodiscard]] inline uint32_t getAttributeStride() const {
+        bool compact = (flags & eCompact) != 0;
+        return (compact ? 2 : 5) + ((flags & eColor) != 0 ? (compact ? 1 : 3) : 0);
+    }
+};
+
+/// The device representation of a geometry.
+///
+/// Positions are kept in their own tightly packed stream, which is only read by the acceleration structure builds.
+/// Normals, texture coordinates and optionally colors are packed to 32 bit words in a separate stream read by the
+/// closest hit shader. Indices are stored with 16 bit if all vertices can be addressed with them.
+struct PackedGeometry {
+    GeometryLayout layout;
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> attributes;
+    std::vector<uint32_t> indices;
+};
+
+/// The device representation of a Primitive, matching Primitive in Geometry.glsl.
+struct PrimitiveSSBO {
+    glm::vec3 center = glm::vec3(0.F);
+    uint32_t type = 0;
+    glm::vec3 size = glm::vec3(1.F);
+    float padding0 = 0.F;
+};
+
+/// Packs the vertices and indices of a geometry to its device representation.
+/// @param geometry The geometry to pack.
+/// @return Returns the packed buffers and their layout.
+PackedGeometry packGeometry(const Geometry &geometry);
+
+/// Packs only the vertices of a triangle geometry, the indices are left empty.
+/// @param geometry The geometry to pack.
+/// @return Returns the packed positions and attributes and their layout.
+PackedGeometry packVertices(const Geometry &geometry);
+
+/// New vertex data for a dynamic geometry that was already uploaded, see Scene::updateGeometryVertices().
+struct VertexUpdate {
+    std::vector<glm::vec3> positions;   ///< Host positions. If empty, the positions are copied from buffer.
+    std::vector<uint32_t> attributes;   ///< Packed attributes written along with host positions.
+    GeometryLayout layout;              ///< The layout the attributes were packed with.
+    vk::Buffer buffer;                  ///< A device buffer with tightly packed positions.
+    vk::DeviceSize offset = 0;          ///< The offset of the positions in buffer.
+};
+
 std::shared_ptr<Geometry> createYZPlane(bool dynamic = true, NiceMaterial mat = {});
 
 std::shared_ptr<Geometry> createCube(bool dynamic = true, NiceMaterial mat = {});
@@ -106,4 +227,33 @@ std::shared_ptr<Geometry> createSphere(bool dynamic = true, NiceMaterial mat = {
 
 std::shared_ptr<Geometry> createCapsule(
         float halfHeight = 1., float radius = 1., bool dynamic = true, NiceMaterial mat = {});
+
+/// Creates a procedural geometry made of analytic primitives, all using the given material.
+/// @ingroup API
+std::shared_ptr<Geometry> createPrimitives(
+        const std::vector<Primitive> &primitives, bool dynamic = true, NiceMaterial mat = {});
+
+std::shared_ptr<Geometry> createAnalyticSphere(float radius = 1., bool dynamic = true, NiceMaterial mat = {});
+
+std::shared_ptr<Geometry> createAnalyticCapsule(
+        float halfHeight = 1., float radius = 1., bool dynamic = true, NiceMaterial mat = {});
+
+std::shared_ptr<Geometry> createAnalyticBox(
+        const glm::vec3 &halfExtents = glm::vec3(1.F), bool dynamic = true, NiceMaterial mat = {});
+
+/// Shared unit primitives, built once per tessellation and kept as long as they are referenced.
+///
+/// All instances of a shared primitive use the same device buffers and BLAS, so memory and build time do not grow with
+/// the number of instances. Instances are sized by their transform and get their material from
+/// GeometryInstance::setMaterial().
+/// @note Shared primitives must not be modified.
+/// @ingroup API
+std::shared_ptr<Geometry> getSharedYZPlane();
+
+std::shared_ptr<Geometry> getSharedCube();
+
+std::shared_ptr<Geometry> getSharedSphere(uint32_t stacks = 50, uint32_t slices = 50);
+
+/// @param aspect The ratio of half height to radius. The capsule has a radius of 1, scale its instances by the radius.
+std::shared_ptr<Geometry> getSharedCapsule(float aspect);
 }
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+namespace kuafu {
+/// Where the data of a geometry is stored in a GeometryBuffer.
+struct GeometryAllocation {
+    GeometryLayout layout;
+    vk::DeviceSize positionOffset = 0;     ///< Only read by the acceleration structure builds.
+    vk::DeviceSize attributeOffset = 0;
+    vk::DeviceSize indexOffset = 0;
+    vk::DeviceSize matIndexOffset = 0;
+};
+
+/// The record of a geometry that the shaders look up by geometry index, matching GeometryRecord in Geometry.glsl.
+struct GeometryRecordSSBO {
+    vk::DeviceAddress attributes = 0;
+    vk::DeviceAddress indices = 0;
+    vk::DeviceAddress matIndices = 0;
+    uint32_t flags = 0;
+    uint32_t padding0 = 0;
+};
+
+/// A single device buffer that the data of all geometries is suballocated from.
+///
+/// Shaders and acceleration structure builds read the data through buffer device addresses, so adding a geometry only
+/// copies its data into a free range instead of allocating buffers and growing descriptor arrays. Free ranges are
+/// kept sorted by offset and merged with their neighbours. If no free range is large enough the buffer grows to at
+/// least twice its capacity, which moves all data to a new address.
+/// @note Data is only copied to the device by flush(), the copies are done once its upload batch finished.
+class GeometryBuffer {
+public:
+    /// Every range starts at a multiple of this, which satisfies all acceleration structure input alignments.
+    static constexpr vk::DeviceSize alignment = 16;
+
+    /// @param capacity The initial capacity in bytes.
+    void init(vk::DeviceSize capacity);
+
+    /// Reserves a range and queues the data for the next flush().
+    /// @param data The data to copy to the range.
+    /// @return Returns the offset of the range.
+    template<typename T>
+    vk::DeviceSize add(const std::vector<T> &data) {
+        return add(data.data(), data.size() * sizeof(T));
+    }
+
+    vk::DeviceSize add(const void *data, vk::DeviceSize size);
+
+    /// Returns a range to the free list.
+    /// @param offset The offset returned by add().
+    void free(vk::DeviceSize offset);
+
+    /// Frees all ranges, the capacity is kept.
+    void clear();
+
+    /// Records the copies of all data queued by add() to an upload batch.
+    ///
+    /// The staging buffer and, after a reallocation, the previous buffer are kept alive by the batch.
+    /// @param batch The batch to record the copies to.
+    /// @return Returns true if the buffer was reallocated, so all addresses changed.
+    bool flush(vkCore::UploadBatch &batch);
+
+    /// @return Returns the device buffer, or nullptr before the first flush().
+    [[nodiscard]] inline vk::Buffer get() const { return pBuffer ? pBuffer->get() : vk::Buffer(); }
+
+    /// @return Returns the device address of the given offset.
+    [[nodiscard]] inline vk::DeviceAddress getAddress(vk::DeviceSize offset) const { return mAddress + offset; }
+
+    [[nodiscard]] inline vk::DeviceSize getCapacity() const { return mCapacity; }
+
+    /// @return Returns the number of bytes in use, including the padding of the ranges.
+    [[nodiscard]] inline vk::DeviceSize getUsedSize() const { return mUsedSize; }
+
+private:
+    /// @return Returns the offset of a free range of the given size, or std::nullopt if there is none.
+    std::optional<vk::DeviceSize> allocate(vk::DeviceSize size);
+
+    /// Adds a range to the free list and merges it with adjacent free ranges.
+    void insertFreeRange(vk::DeviceSize offset, vk::DeviceSize size);
+
+    std::unique_ptr<vkCore::Buffer> pBuffer;
+    vk::DeviceAddress mAddress = 0;
+    vk::DeviceSize mCapacity = 0;
+    vk::DeviceSize mUsedSize = 0;
+
+    std::map<vk::DeviceSize, vk::DeviceSize> mFreeRanges;               ///< Offset to size, sorted by offset.
+    std::unordered_map<vk::DeviceSize, vk::DeviceSize> mRanges;         ///< Offset to size of all used ranges.
+
+    std::vector<uint8_t> mStaging;                                      ///< The data queued by add().
+    std::vector<vk::BufferCopy> mPendingCopies;
+};
+}
@@ -13,13 +13,13 @@ class Frames {
 
     vk::Format mFormat;
     vk::Extent2D mExtent;
+    std::vector<vkCore::Allocation> mImagesMemory;      ///< Declared before the images, so it is released last.
     std::vector<vk::UniqueImage> mImages;
-    std::vector<vk::UniqueDeviceMemory> mImagesMemory;
 
     std::vector<vk::UniqueImageView> mImageViews;
     std::vector<vk::UniqueFramebuffer> mFramebuffers;
 
-    size_t mCurrentImageIdx;
+    size_t mCurrentImageIdx = 0;
 
     std::mutex mLock;
 
@@ -51,25 +51,15 @@ public:
         createInfo.format = format;
         createInfo.extent = vk::Extent3D{extent, 1};
         createInfo.imageType = vk::ImageType::e2D;
-        createInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+        createInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc |
+                           vk::ImageUsageFlagBits::eTransferDst;          // blit target of batched rendering
         createInfo.arrayLayers = 1;
         createInfo.mipLevels = 1;
         createInfo.sharingMode = vk::SharingMode::eExclusive;
 
         for (size_t i = 0; i < n; ++i) {
             mImages[i] = vkCore::global::device.createImageUnique(createInfo);
-
-            auto memRequirements = vkCore::global::device.getImageMemoryRequirements(mImages[i].get());
-
-            vk::MemoryAllocateInfo allocInfo;
-            allocInfo.allocationSize = memRequirements.size;
-            allocInfo.memoryTypeIndex = vkCore::findMemoryType(
-                    vkCore::global::physicalDevice,
-                    memRequirements.memoryTypeBits,
-                    vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-            mImagesMemory[i] = vkCore::global::device.allocateMemoryUnique(allocInfo);
-            vkCore::global::device.bindImageMemory(mImages[i].get(), mImagesMemory[i].get(), 0);
+            mImagesMemory[i] = vkCore::allocateImageMemory(mImages[i].get());
         }
 
         for (size_t i = 0; i < mImageViews.size(); ++i)
@@ -0,0 +1,123 @@
+#pragma once
+
+namespace kuafu {
+
+//// Simplified Blender PrincipledBSDF
+struct NiceMaterial {
+    glm::vec3 diffuseColor = glm::vec3(1.0F); /// Diffuse color
+    float alpha = 1.0F;
+
+    std::string diffuseTexPath;
+    std::string metallicTexPath;
+    std::string roughnessTexPath;
+    std::string transmissionTexPath;
+
+    float metallic = 0.0F;
+    float specular = 0.5F;
+    float roughness = 0.5F;
+    float ior = 1.4F;
+    float transmission = 0.0F;
+
+    glm::vec3 emission = glm::vec3(1.0F);
+    float emissionStrength = 0.0F;
+
+    friend bool operator==(const NiceMaterial &m1, const NiceMaterial &m2);
+};
+
+class MaterialRegistry;
+
+/// A reference counted handle to a material in a MaterialRegistry.
+///
+/// The index of a material does not change while any handle to it is alive. Once the last handle is released, the
+/// material's slot is freed and reused by the next new material.
+/// @ingroup API
+class MaterialHandle {
+public:
+    static constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+    MaterialHandle() = default;
+
+    MaterialHandle(const MaterialHandle &other);
+
+    MaterialHandle(MaterialHandle &&other) noexcept;
+
+    MaterialHandle &operator=(MaterialHandle other) noexcept;
+
+    ~MaterialHandle();
+
+    /// @return Returns the material's index into the material buffer.
+    [[nodiscard]] inline uint32_t getIndex() const { return mIndex; }
+
+    [[nodiscard]] inline bool valid() const { return mIndex != invalid; }
+
+private:
+    friend MaterialRegistry;
+
+    MaterialHandle(MaterialRegistry *registry, uint32_t index) : pRegistry(registry), mIndex(index) {}
+
+    MaterialRegistry *pRegistry = nullptr;
+    uint32_t mIndex = invalid;
+};
+
+/// Keeps all materials known to the renderer and deduplicates them.
+///
+/// Materials are looked up by a hashed key made of their interned texture paths and their scalars quantized to
+/// 1 / quantization, so equal materials share a single slot in the material buffer.
+/// @note Freed slots hold a default material until they are reused.
+class MaterialRegistry {
+public:
+    static constexpr float quantization = 4096.0F;
+
+    /// Returns a handle to an equal material if one is registered already, otherwise registers the material.
+    /// @param material The material to look up.
+    /// @return Returns a handle to the registered material.
+    MaterialHandle acquire(const NiceMaterial &material);
+
+    /// @return Returns the material in the given slot.
+    [[nodiscard]] inline const NiceMaterial &operator[](size_t index) const { return mSlots[index].material; }
+
+    /// @return Returns the number of slots, including free ones.
+    [[nodiscard]] inline size_t size() const { return mSlots.size(); }
+
+    /// @return Returns the number of materials that are referenced by at least one handle.
+    [[nodiscard]] inline size_t getActiveCount() const { return mSlots.size() - mFreeSlots.size(); }
+
+    /// @return Returns a counter that is incremented whenever a material is registered, so its slot has to be uploaded.
+    [[nodiscard]] inline uint64_t getVersion() const { return mVersion; }
+
+private:
+    friend MaterialHandle;
+
+    struct Key {
+        std::array<uint32_t, 4> textures;   ///< Interned texture paths, 0 if there is none.
+        std::array<int32_t, 13> scalars;    ///< Quantized colors and factors.
+
+        bool operator==(const Key &other) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Slot {
+        NiceMaterial material;
+        Key key{};
+        uint32_t refCount = 0;
+    };
+
+    Key getKey(const NiceMaterial &material);
+
+    /// @return Returns a non-zero id for a non-empty texture path.
+    uint32_t getTextureId(const std::string &path);
+
+    void retain(uint32_t index);
+
+    void release(uint32_t index);
+
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    std::unordered_map<Key, uint32_t, KeyHash> mIndices;
+    std::unordered_map<std::string, uint32_t> mTextureIds;
+    uint64_t mVersion = 0;
+};
+}
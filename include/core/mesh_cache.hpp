@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+namespace kuafu {
+/// A mesh of an imported file, after Assimp's post processing.
+struct ImportedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    uint32_t materialIndex = 0;     ///< Index into ImportedScene::materials.
+    bool hasColors = false;
+};
+
+/// The content of a mesh file that loadScene() turns into geometries.
+struct ImportedScene {
+    std::vector<NiceMaterial> materials;
+    std::vector<ImportedMesh> meshes;
+};
+
+/// Caches imported mesh files on disk in global::meshCachePath, so files loaded before skip the Assimp import.
+///
+/// Entries are keyed by the absolute path, modification time and size of the file, the import flags and whether the
+/// meshes were optimized. An entry is a flat binary file that is memory mapped and copied into the vectors without
+/// any parsing.
+/// @note The cache is written atomically, several processes can share the same cache directory.
+namespace meshcache {
+/// @param path The absolute path to the mesh file.
+/// @param flags The Assimp post processing flags used for the import.
+/// @param optimized Whether the meshes were optimized after the import.
+/// @return Returns the cached scene, or std::nullopt if there is no valid entry for the file.
+std::optional<ImportedScene> load(const std::filesystem::path &path, uint32_t flags, bool optimized);
+
+/// Stores a scene imported from a mesh file. Failures are only logged.
+/// @param path The absolute path to the mesh file.
+/// @param flags The Assimp post processing flags used for the import.
+/// @param optimized Whether the meshes were optimized after the import.
+/// @param scene The imported scene.
+void store(const std::filesystem::path &path, uint32_t flags, bool optimized, const ImportedScene &scene);
+}
+}
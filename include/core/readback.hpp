@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <functional>
+
+#include "stdafx.hpp"
+
+namespace kuafu {
+class Camera;
+
+class Context;
+
+/// A persistently mapped host buffer that frames are copied to.
+struct ReadbackBuffer {
+    vkCore::Buffer buffer;
+    const uint8_t *pData = nullptr;
+    vk::Semaphore semaphore;
+    uint64_t value = 0;         ///< The timeline value signaled once the last copy into this buffer is done.
+};
+
+/// A handle to an asynchronous frame readback.
+///
+/// The copy is recorded to the command buffer of the next frame that renders the camera and signals the context's
+/// timeline semaphore once it is done, so the following frames can be rendered while the readback is in flight.
+/// All requested channels are copied to a single buffer.
+/// @note The readback's buffer is reused once the handle is released, do not keep pointers returned by data() beyond that.
+/// @ingroup API
+class Readback {
+public:
+    using Callback = std::function<void(const Readback &)>;
+
+    /// The channels that can be read back, combined as a bit mask.
+    /// @note Except for the color, all channels are taken from the first sample of the frame and are not accumulated.
+    enum Channel : uint32_t {
+        eColor = 1U << 0U,        ///< The post processed frame, 8 bit per component in the format returned by getFormat().
+        eAlbedo = 1U << 1U,       ///< The albedo at the first hit, 32 bit float RGBA.
+        eNormal = 1U << 2U,       ///< The world space normal at the first hit, 32 bit float RGBA.
+        eDepth = 1U << 3U,        ///< The linear depth along the camera's viewing direction, 32 bit float. 0 for background.
+        eSegmentation = 1U << 4U  ///< The instance and geometry index of the first hit, 2x 32 bit uint. ~0 for background.
+    };
+
+    using Channels = uint32_t;
+
+    static constexpr size_t channelCount = 5;
+
+    Readback(Camera *camera, Channels channels, Callback callback) :
+            pCamera(camera), mChannels(channels), mCallback(std::move(callback)) {}
+
+    /// @return Returns true if the frame has been recorded, i.e. a frame rendering the camera was submitted.
+    [[nodiscard]] inline bool submitted() const { return pBuffer != nullptr; }
+
+    /// @return Returns true if the copy is done and the pixels can be accessed without waiting.
+    [[nodiscard]] bool ready() const;
+
+    /// Blocks until the copy is done.
+    /// @note Only valid once submitted(), i.e. after Kuafu::run() rendered the camera.
+    void wait() const;
+
+    /// Waits for the copy and returns the pixels of a channel.
+    /// @param channel A requested channel.
+    /// @return Returns the channel's pixels, tightly packed in the format returned by getFormat().
+    [[nodiscard]] std::vector<uint8_t> get(Channel channel = eColor) const;
+
+    /// Waits for the copy and returns a pointer to the mapped pixels of a channel, valid as long as this handle is alive.
+    /// @param channel A requested channel.
+    [[nodiscard]] const uint8_t *data(Channel channel = eColor) const;
+
+    [[nodiscard]] inline auto getCamera() const { return pCamera; }
+
+    [[nodiscard]] inline auto getChannels() const { return mChannels; }
+
+    [[nodiscard]] inline bool hasChannel(Channel channel) const { return (mChannels & channel) != 0; }
+
+    [[nodiscard]] inline auto getExtent() const { return mExtent; }
+
+    [[nodiscard]] inline auto getFormat(Channel channel = eColor) const { return mRegions[getChannelIndex(channel)].format; }
+
+    [[nodiscard]] inline auto getSize(Channel channel = eColor) const { return mRegions[getChannelIndex(channel)].size; }
+
+    /// @return Returns the index of a single channel, e.g. 1 for eAlbedo.
+    static size_t getChannelIndex(Channel channel);
+
+private:
+    friend Context;
+
+    /// Where a channel is stored in the readback buffer.
+    struct Region {
+        vk::Format format = vk::Format::eUndefined;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+    };
+
+    Camera *pCamera;
+    Channels mChannels;
+    Callback mCallback;
+
+    std::shared_ptr<ReadbackBuffer> pBuffer;
+    vk::Extent2D mExtent;
+    std::array<Region, channelCount> mRegions;
+};
+
+/// Manages the readback buffers, which are reused round-robin once they are neither referenced by a handle
+/// nor written by the device anymore.
+class ReadbackRing {
+public:
+    /// @param size The minimum size of the buffer.
+    /// @return Returns a buffer that is free to be copied to.
+    std::shared_ptr<ReadbackBuffer> acquire(vk::DeviceSize size);
+
+    void destroy() { mBuffers.clear(); }
+
+private:
+    std::vector<std::shared_ptr<ReadbackBuffer>> mBuffers;
+    size_t mNext = 0;
+};
+}
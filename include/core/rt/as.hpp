@@ -29,7 +29,7 @@ namespace kuafu {
 /// @ingroup API
 struct AccelerationStructure {
     vk::AccelerationStructureKHR as; ///< The Vulkan acceleration structure.
-    vk::DeviceMemory memory;         ///< The acceleration structure's memory.
+    std::shared_ptr<vkCore::Allocation> memory; ///< The acceleration structure's memory, shared by all copies of this object.
     vk::Buffer buffer;
 
     /// Used to destroy the acceleration structure and free its memory.
@@ -51,6 +51,14 @@ struct Blas {
 
     std::vector<vk::AccelerationStructureGeometryKHR> asGeometry;             ///< Data used to build acceleration structure geometry.
     std::vector<vk::AccelerationStructureBuildRangeInfoKHR> asBuildRangeInfo; ///< The offset between acceleration structures when building.
+
+    uint64_t version = 0;  ///< The kuafu::Geometry::version this BLAS was built from.
+    bool opaque = true;    ///< The opacity flag this BLAS was built with.
+    bool hidden = false;   ///< True if this is a dummy BLAS standing in for a hidden geometry.
+
+    bool updatable = false;            ///< Built with eAllowUpdate and not compacted, so it can be refit in place.
+    uint32_t refitCount = 0;           ///< The number of refits since the last full build.
+    vk::DeviceSize scratchSize = 0;    ///< The scratch memory a build or an update of this BLAS needs.
 };
 
 /// Creates the acceleration structure and allocates and binds memory for it.
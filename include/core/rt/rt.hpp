@@ -25,6 +25,7 @@
 #include "core/image.hpp"
 #include "core/rt/as.hpp"
 #include "core/geometry.hpp"
+#include "core/geometry_buffer.hpp"
 #include "core/config.hpp"
 
 namespace kuafu {
@@ -41,6 +42,30 @@ struct RtPushConstants {
     uint32_t nextEventEstimationMinBounces = 0;
 };
 
+/// The push constants of InstancePoses.comp.
+struct PosePushConstants {
+    vk::DeviceAddress poses = 0;
+    vk::DeviceAddress tlasInstances = 0;
+    vk::DeviceAddress geometryInstances = 0;
+    uint32_t count = 0;
+    uint32_t stride = 0;            ///< See PoseLayout.
+    uint32_t positionOffset = 0;
+    uint32_t rotationOffset = 0;
+    uint32_t scaleOffset = 0;
+    uint32_t padding0 = 0;
+};
+
+/// Timings and top level acceleration structure statistics of a traced frame, see RayTracer::getTelemetry().
+/// @ingroup API
+struct FrameTelemetry {
+    uint64_t frame = 0;             ///< Counts the frames recorded by the ray tracer.
+    float tlasBuildTime = 0.0F;     ///< Milliseconds spent on BLAS updates, instance poses and the TLAS build, 0 if nothing was built.
+    float traceTime = 0.0F;         ///< Milliseconds spent tracing rays.
+    bool tlasRebuilt = false;       ///< Whether the TLAS was built from scratch instead of refit.
+    uint32_t tlasRefitCount = 0;    ///< Refits of the TLAS since its last full build.
+    float tlasDisplacement = 0.0F;  ///< The largest instance displacement since the last full build, relative to the instances' extent.
+};
+
 struct PathTracingCapabilities {
     vk::PhysicalDeviceRayTracingPipelinePropertiesKHR pipelineProperties; ///< The physical device's path tracing capabilities.
     vk::PhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties;
@@ -73,19 +98,34 @@ public:
 
     [[nodiscard]] const auto& getCapabilities() { return mCapabilities; }
 
-    inline void setRenderTargets(std::shared_ptr<RenderTargets> renderTargets) { mRenderTargets = renderTargets; }
+    inline void setRenderTargets(std::shared_ptr<RenderTargets> renderTargets) { mRenderTargets = {renderTargets}; }
+
+    /// Sets the render targets of all cameras traced at once, ordered by launch depth.
+    /// @note The first render targets are the ones returned by getStorageImage() and its siblings.
+    inline void setRenderTargets(const std::vector<std::shared_ptr<RenderTargets>>& renderTargets) {
+        KF_ASSERT(!renderTargets.empty() && renderTargets.size() <= global::maxCameras,
+                  "Invalid number of render targets: {}", renderTargets.size());
+        mRenderTargets = renderTargets;
+    }
+
+    [[nodiscard]] const auto& getRenderTargets() const { return mRenderTargets; }
 
     inline void createRenderTarget(const std::string& target, const vk::ImageCreateInfo& createInfo) {
+        createRenderTarget(*mRenderTargets.front(), target, createInfo);
+    }
+
+    static inline void createRenderTarget(RenderTargets& renderTargets, const std::string& target,
+                                          const vk::ImageCreateInfo& createInfo) {
         StorageImage storageImage;
         storageImage.init(createInfo);
-        (*mRenderTargets)[target] = std::move(storageImage);
+        renderTargets[target] = std::move(storageImage);
     }
 
-    [[nodiscard]] auto getStorageImage(const std::string& target) const { return mRenderTargets->at(target).get(); }
+    [[nodiscard]] auto getStorageImage(const std::string& target) const { return mRenderTargets.front()->at(target).get(); }
 
-    [[nodiscard]] auto getStorageImageView(const std::string& target) const { return mRenderTargets->at(target).getView(); }
+    [[nodiscard]] auto getStorageImageView(const std::string& target) const { return mRenderTargets.front()->at(target).getView(); }
 
-    [[nodiscard]] const auto& getStorageImageInfo(const std::string& target) const { return mRenderTargets->at(target).getInfo(); }
+    [[nodiscard]] const auto& getStorageImageInfo(const std::string& target) const { return mRenderTargets.front()->at(target).getInfo(); }
 
     [[nodiscard]] auto getPipeline() const { return _pipeline.get(); }
 
@@ -100,47 +140,155 @@ public:
     [[nodiscard]] auto createDummyBlas() const;
 
     /// Used to convert wavefront models to a bottom level acceleration structure.
-    /// @param vertexBuffer A vertex buffer of some geometry.
-    /// @param indexBuffer An index buffer of some geometry.
+    /// @param positionAddress The device address of the geometry's vertex positions.
+    /// @param indexAddress The device address of the geometry's indices.
+    /// @param layout The layout of the geometry's data.
     /// @return Returns the bottom level acceleration structure.
-    [[nodiscard]] auto modelToBlas(const vkCore::StorageBuffer<Vertex> &vertexBuffer,
-                     const vkCore::StorageBuffer<uint32_t> &indexBuffer, bool opaque) const;
+    [[nodiscard]] auto modelToBlas(vk::DeviceAddress positionAddress, vk::DeviceAddress indexAddress,
+                                   const GeometryLayout &layout, bool opaque) const;
 
     /// Used to convert a bottom level acceleration structure instance to a Vulkan geometry instance.
     /// @param instance A bottom level acceleration structure instance.
     /// @return Returns the Vulkan geometry instance.
     auto geometryInstanceToAccelerationStructureInstance(
-            std::shared_ptr<GeometryInstance> &geometryInstance);
-
-    /// Used to prepare building the bottom level acceleration structures.
-    /// @param vertexBuffers Vertex buffers of all geometry in the scene.
-    /// @param indexBuffers Index buffers of all geometry in the scene.
-    void createBottomLevelAS(std::vector<vkCore::StorageBuffer<Vertex>> &vertexBuffers,
-                             const std::vector<vkCore::StorageBuffer<uint32_t>> &indexBuffers,
-                             const std::vector<std::shared_ptr<Geometry>> &geometries);
-
-    /// Builds all bottom level acceleration structures.
-    /// @param blas_ A vector of kuafu::Blas objects containing all bottom level acceleration structures prepared in createBottomLevelAS().
+            const std::shared_ptr<GeometryInstance> &geometryInstance) -> vk::AccelerationStructureInstanceKHR;
+
+    /// Synchronizes the cached bottom level acceleration structures with the scene's geometries.
+    ///
+    /// Only geometries that are new, whose buffers were re-created or whose opacity / visibility changed are (re)built.
+    /// Dynamic geometries are built with eAllowUpdate and without compaction, so they can be refit right away.
+    /// Cached structures of geometries no longer in the scene are released once the frames in flight finished.
+    /// @param geometryBuffer The buffer holding the data of all geometry in the scene.
+    /// @param allocations Where the data of each geometry is stored in the geometry buffer.
+    /// @param geometries All geometries in the scene.
+    /// @param uploads The batch that uploads the geometry data, the builds wait for it on the device.
+    /// @return Returns true if any bottom level acceleration structure was built or destroyed.
+    bool updateBottomLevelAS(const GeometryBuffer &geometryBuffer,
+                             const std::unordered_map<const Geometry *, GeometryAllocation> &allocations,
+                             const std::vector<std::shared_ptr<Geometry>> &geometries,
+                             const vkCore::UploadBatch &uploads);
+
+    /// Builds the bottom level acceleration structures of the given geometries on the compute queue.
+    ///
+    /// The builds signal getBlasSemaphore(), anything on another queue that reads the structures has to wait for it.
+    /// The host does not wait for them. Structures built with eAllowCompaction are compacted by a later
+    /// collectBlasBuilds(), and the structures they replace are released once the current frame finished.
+    /// @param geometries The geometries whose kuafu::Blas objects were prepared in updateBottomLevelAS().
+    /// @param uploads The batch that uploads the geometry data, the builds wait for it on the device.
     /// @param flags The build flags.
-    void buildBlas(
+    void buildBlas(const std::vector<const Geometry *> &geometries, const vkCore::UploadBatch &uploads,
             vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
 
-    /// Build the top level acceleration structure.
+    /// Compacts the bottom level acceleration structures whose builds finished and releases the builds' resources.
+    ///
+    /// The compacted sizes are read without waiting, the copies are submitted to the compute queue like the builds.
+    /// @return Returns true if a BLAS was replaced by its compacted copy, so the top level acceleration structure has to
+    /// be rebuilt.
+    bool collectBlasBuilds();
+
+    /// Releases the structures and buffers retired by the last frame that used the given frame in flight.
+    /// @param frameIndex The index of the frame in flight about to be prepared. The device must be done with its last frame.
+    /// @param framesInFlight The number of frames in flight.
+    void beginFrame(size_t frameIndex, size_t framesInFlight);
+
+    /// Writes new vertices of deformed geometries and refits their bottom level acceleration structures.
+    ///
+    /// A BLAS that was built for static use is replaced once by one built with eAllowUpdate and without compaction.
+    /// Afterwards it is refit in place, and rebuilt in place once it was refit rebuildInterval times in a row. The
+    /// copies, refits and builds are not executed here but recorded with recordTlasBuild(), the top level acceleration
+    /// structure is updated along with them.
+    /// @param geometryBuffer The buffer holding the data of all geometry in the scene.
+    /// @param allocations Where the data of each geometry is stored in the geometry buffer.
+    /// @param updates The new vertex data, by geometry.
+    /// @param frameIndex The index of the frame in flight the updates will be recorded to.
+    /// @param rebuildInterval The number of refits between two full builds.
+    /// @return Returns true if a BLAS was replaced, so the top level acceleration structure has to be rebuilt.
+    bool updateGeometryVertices(const GeometryBuffer &geometryBuffer,
+                                const std::unordered_map<const Geometry *, GeometryAllocation> &allocations,
+                                const std::unordered_map<const Geometry *, VertexUpdate> &updates,
+                                size_t frameIndex, uint32_t rebuildInterval);
+
+    /// @return Returns the timeline semaphore signaled by the bottom level acceleration structure builds.
+    [[nodiscard]] auto getBlasSemaphore() const { return mBlasSemaphore.get(); }
+
+    /// @return Returns the value getBlasSemaphore() reaches once the last build finished.
+    [[nodiscard]] auto getBlasValue() const { return mBlasValue; }
+
+    /// Prepares a build of the top level acceleration structure.
+    ///
+    /// The TLAS instances are kept between calls. A full build creates all of them again, a refit only those of the
+    /// instances that changed. Only instances that changed since a frame's last call are written to its persistently
+    /// mapped instance buffer. Every frame in flight has its own instance buffer, so the instances of a frame can be written while the previous one is traced.
+    /// Instance buffers, scratch buffer and the acceleration structure itself are grown geometrically and reused otherwise.
+    /// The build is not executed here but recorded with recordTlasBuild().
     /// @param instances A vector of bottom level acceleration structure instances.
+    /// @param frameIndex The index of the frame in flight the build will be recorded to.
     /// @param flags The build flags.
-    void buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances,
+    /// @param reuse If true, the existing acceleration structure will be updated instead of rebuilt if possible.
+    /// @param changedInstances If reuse is set, the positions of the instances that changed since the last call. All
+    /// other instances are assumed to be unchanged.
+    /// @note The device must be done with the last frame that used frameIndex. If the instance count grows, it must also be done
+    /// with the top level acceleration structure itself.
+    void buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances, size_t frameIndex,
                    vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace,
-                   bool reuse = false);
+                   bool reuse = false, std::span<const uint32_t> changedInstances = {});
 
+    /// Prepares a refit of the top level acceleration structure, see buildTlas().
+    ///
+    /// Refits keep the tree of the last full build, so the structure is rebuilt instead once it was refit too often or
+    /// an instance moved too far from where it was at the last full build, see setTlasRebuildPolicy().
+    /// @param changedInstances The positions of the instances that changed since the last call.
     void updateTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances,
+                    std::span<const uint32_t> changedInstances, size_t frameIndex,
                     vk::BuildAccelerationStructureFlagsKHR flags =
                     vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
                     vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
 
+    /// Sets when updateTlas() rebuilds the top level acceleration structure instead of refitting it.
+    /// @see Config::setTlasRebuildPolicy()
+    inline void setTlasRebuildPolicy(uint32_t refits, float displacement) {
+        mTlasRebuildInterval = refits;
+        mTlasRebuildDisplacement = displacement;
+    }
+
+    /// Sets the poses of the leading instances passed to buildTlas(), which replace the instances' transforms.
+    ///
+    /// The poses are only copied to the pose buffer of the frame. Their transforms are computed on the device and
+    /// written to the TLAS instances and the geometry instance buffer right before the build.
+    /// @param poses The poses, in the order of the instances.
+    /// @param layout Where the members of a pose are found.
+    /// @param changed Whether the poses or their layout changed since the last call.
+    /// @param geometryInstances The instance buffer read by the path tracing shaders.
+    /// @param frameIndex The index of the frame in flight the build will be recorded to.
+    /// @note Has to be called before buildTlas() or updateTlas() of the same frame.
+    void setInstancePoses(std::span<const float> poses, const PoseLayout &layout, bool changed,
+                          vk::Buffer geometryInstances, size_t frameIndex);
+
+    /// Records the build prepared in buildTlas() to the given command buffer, if there is one.
+    ///
+    /// The build is guarded by barriers against previous traces and builds and against the following trace. The
+    /// vertex updates and BLAS refits prepared in updateGeometryVertices() and the transforms of posed instances are
+    /// recorded first.
+    /// @param cmdBuf The command buffer to record to.
+    void recordTlasBuild(vk::CommandBuffer cmdBuf);
+
+    /// Collects the telemetry of the last frame that used the given frame in flight and prepares the timestamps of the next one.
+    /// @param frameIndex The index of the frame in flight about to be recorded. The device must be done with its last frame.
+    /// @param framesInFlight The number of frames in flight.
+    void collectTelemetry(size_t frameIndex, size_t framesInFlight);
+
+    /// @return Returns the telemetry of the most recent frames, oldest first.
+    [[nodiscard]] const auto& getTelemetry() const { return mTelemetry; }
+
     /// Creates the storage image which the path tracing shaders will write to.
     /// @param swapchainExtent The swapchain images' extent.
     void createStorageImage(vk::Extent2D swapchainExtent);
 
+    /// Creates the storage images of the given render targets, e.g. of a camera that is not the current one.
+    /// @param renderTargets The render targets to (re)create.
+    /// @param extent The camera's extent.
+    static void createStorageImage(RenderTargets &renderTargets, vk::Extent2D extent);
+
     /// Creates the shader binding tables.
     void createShaderBindingTable();
 
@@ -152,8 +300,10 @@ public:
     /// Used to record the actual path tracing commands to a given command buffer.
     /// @param swapchainCommandBuffer The command buffer to record to.
     /// @param swapchainImage The current image in the swapchain.
-    /// @param extent The swapchain images' extent.
-    void trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapchainImage, vk::Extent2D extent);
+    /// @param extent The swapchain images' extent, or the largest extent of all cameras traced at once.
+    /// @param cameraCount The number of cameras traced at once, used as launch depth.
+    void trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapchainImage, vk::Extent2D extent,
+               uint32_t cameraCount = 1);
 
     void initDescriptorSet();
 
@@ -164,16 +314,156 @@ public:
     float getPixelVariance(uint32_t index);
 
 private:
+    /// Submits command buffers to the compute queue, they signal getBlasSemaphore() once they finished.
+    /// @param cmdBufs The command buffers to submit.
+    /// @param waitSemaphore An optional timeline semaphore the commands wait for.
+    /// @param waitValue The value of waitSemaphore to wait for.
+    /// @return Returns the value getBlasSemaphore() reaches once the commands finished.
+    auto submitToComputeQueue(const std::vector<vk::CommandBuffer> &cmdBufs, vk::Semaphore waitSemaphore = nullptr,
+                              uint64_t waitValue = 0) -> uint64_t;
+
+    /// Destroys an acceleration structure once the frame being prepared and the builds submitted so far finished.
+    void retire(const AccelerationStructure &as);
+
+    /// Keeps a resource alive until the frame being prepared and the builds submitted so far finished.
+    void retire(std::shared_ptr<void> resource);
+
+    /// Creates the compute pipeline that turns instance poses into transforms.
+    void createPosePipeline();
+
+    /// Records the vertex copies and BLAS refits prepared in updateGeometryVertices().
+    void recordBlasUpdates(vk::CommandBuffer cmdBuf);
+
+    /// Records the computation of the posed instances' transforms, see setInstancePoses().
+    void recordInstancePoses(vk::CommandBuffer cmdBuf);
+
     vk::UniquePipeline _pipeline;
     vk::UniquePipelineLayout _layout;
     uint32_t _shaderGroups;
     PathTracingCapabilities mCapabilities;
-    std::vector<Blas> mBlas;
+    std::unordered_map<const Geometry *, Blas> mBlas; ///< Bottom level acceleration structures, keyed by geometry.
+    vk::UniqueSemaphore mBlasSemaphore; ///< Timeline semaphore signaled by the builds on the compute queue.
+    uint64_t mBlasValue = 0;
+
+    /// The resources of BLAS builds on the compute queue, kept until getBlasSemaphore() reaches their value.
+    struct BlasBuild {
+        /// A structure of the build, compacted once the build finished unless it was replaced in the meantime.
+        struct Structure {
+            const Geometry *geometry = nullptr;
+            vk::AccelerationStructureKHR as;
+            vk::DeviceSize size = 0;
+        };
+
+        uint64_t value = 0;
+        vk::UniqueCommandPool commandPool;
+        std::shared_ptr<vkCore::Buffer> scratchBuffer;
+        vk::UniqueQueryPool queryPool;      ///< The compacted sizes, only if the structures are compacted.
+        std::vector<Structure> structures;  ///< In query order.
+    };
+
+    std::deque<BlasBuild> mBlasBuilds; ///< Submitted builds and compactions, oldest first.
+
+    /// Resources frames in flight or builds might still use, released once the frame that retired them finished.
+    struct FrameRelease {
+        std::vector<AccelerationStructure> structures;
+        std::vector<std::shared_ptr<void>> resources;
+        uint64_t blasValue = 0; ///< The value of getBlasSemaphore() when the last resource was retired.
+    };
+
+    std::vector<FrameRelease> mFrameReleases; ///< One per frame in flight.
+    size_t mFrameIndex = 0; ///< The frame in flight being prepared.
     Tlas mTlas; ///< The top level acceleration structure.
-    vkCore::Buffer _instanceBuffer;
+    uint32_t mTlasCapacity = 0; ///< The instance count the top level acceleration structure was sized for.
+
+    /// Persistently mapped, host visible buffer of TLAS instances.
+    struct InstanceBuffer {
+        vkCore::Buffer buffer;
+        vk::AccelerationStructureInstanceKHR *pData = nullptr;
+        uint32_t capacity = 0;
+        std::vector<uint32_t> pending; ///< The instances that changed since the buffer was written last.
+        bool writeAll = true;          ///< All instances have to be written, e.g. because the buffer is new.
+
+        vkCore::Buffer poseBuffer; ///< The poses the transforms of posed instances are computed from.
+        float *pPoses = nullptr;
+        size_t poseCapacity = 0;      ///< In floats.
+        uint64_t poseVersion = 0; ///< The version of the poses in the pose buffer.
+    };
+
+    /// @return Returns the instance buffer of a frame in flight, which is created if necessary.
+    auto getInstanceBuffer(size_t frameIndex) -> InstanceBuffer &;
+
+    /// Persistently mapped, host visible buffer the vertices of deformed geometries are copied from.
+    struct VertexStaging {
+        vkCore::Buffer buffer;
+        uint8_t *pData = nullptr;
+        vk::DeviceSize capacity = 0;
+    };
+
+    std::vector<std::unique_ptr<VertexStaging>> mVertexStaging; ///< One staging buffer per frame in flight.
+
+    /// A copy into the geometry buffer, followed by the refit or rebuild of a BLAS.
+    struct BlasUpdate {
+        vk::Buffer srcBuffer;
+        std::vector<vk::BufferCopy> copies;
+        vk::AccelerationStructureKHR as;
+        vk::AccelerationStructureGeometryKHR asGeometry;
+        vk::AccelerationStructureBuildRangeInfoKHR asBuildRangeInfo;
+        vk::DeviceSize scratchSize = 0;
+        bool rebuild = false;
+    };
+
+    std::vector<BlasUpdate> mBlasUpdates; ///< The updates to record with the next build.
+    vk::Buffer mBlasUpdateDstBuffer; ///< The geometry buffer the updates copy to.
+    std::shared_ptr<vkCore::Buffer> mBlasUpdateScratchBuffer; ///< Shared, so a replaced buffer can be retired.
+    vk::DeviceSize mBlasUpdateScratchCapacity = 0;
+    bool mBlasRefitted = false; ///< A BLAS was refit since the last build of the top level acceleration structure was prepared.
+
+    std::vector<std::unique_ptr<InstanceBuffer>> mInstanceBuffers; ///< One instance buffer per frame in flight.
+    size_t mInstanceBufferIndex = 0; ///< The instance buffer of the pending build.
+    uint32_t mInstanceCapacity = 0;
+    std::vector<vk::AccelerationStructureInstanceKHR> mTlasInstances; ///< The TLAS instances of all geometry instances.
+
+    vkCore::Buffer mTlasScratchBuffer;
+    vk::DeviceSize mTlasScratchCapacity = 0;
+
+    uint32_t mTlasRebuildInterval = 256; ///< Refits of the top level acceleration structure between two full builds.
+    float mTlasRebuildDisplacement = 0.1F; ///< Relative instance displacement since the last full build that triggers a rebuild.
+    uint32_t mTlasRefitCount = 0; ///< Refits since the last full build.
+    float mTlasDisplacement = 0.0F; ///< The largest relative instance displacement when the last build was prepared.
+    float mTlasExtent = 0.0F; ///< The diagonal of the instance origins' bounds at the last full build, 0 if degenerate.
+    std::vector<glm::vec3> mTlasOrigins; ///< The instance origins at the last full build.
+    std::vector<glm::vec3> mInstanceOrigins; ///< The instance origins of the last prepared build.
+    float mMovedDistance2 = 0.0F; ///< The largest squared distance an instance moved since the last full build, posed ones aside.
+    float mPoseDistance2 = 0.0F; ///< The largest squared distance a posed instance moved since the last full build.
+
+    vk::UniquePipeline mPosePipeline;
+    vk::UniquePipelineLayout mPoseLayout;
+    uint32_t mPoseCount = 0; ///< The number of leading instances whose transforms are computed from poses.
+    PoseLayout mInstancePoseLayout; ///< The layout of the poses in the pose buffers.
+    uint64_t mPoseVersion = 0; ///< Incremented whenever the poses change.
+    bool mPosesChanged = false; ///< The poses changed since the last build was prepared.
+    std::vector<glm::vec3> mPosePositions; ///< The positions of the poses, used to track the displacement of posed instances.
+    vk::DeviceAddress mGeometryInstancesAddress = 0;
+
+    bool mTlasBuildPending = false;
+    vk::BuildAccelerationStructureFlagsKHR mTlasFlags;
+    vk::BuildAccelerationStructureModeKHR mTlasMode = vk::BuildAccelerationStructureModeKHR::eBuild;
     vkCore::Buffer _sbtBuffer; ///< The shader binding table buffer.
 
-    std::shared_ptr<RenderTargets> mRenderTargets;
+    /// The timestamps and TLAS statistics of a frame in flight, until they are collected.
+    struct FrameTimestamps {
+        FrameTelemetry telemetry;
+        bool written = false; ///< Whether the frame was recorded and has not been collected yet.
+    };
+
+    float mTimestampPeriod = 0.0F; ///< Nanoseconds per timestamp tick, 0 if the graphics queue does not support timestamps.
+    vk::UniqueQueryPool mTimestampPool; ///< Three timestamps per frame in flight: start, after the TLAS build and after the trace.
+    std::vector<FrameTimestamps> mTimestamps; ///< One entry per frame in flight.
+    size_t mTimestampIndex = 0; ///< The frame in flight being recorded.
+    uint64_t mTelemetryFrame = 0;
+    std::deque<FrameTelemetry> mTelemetry; ///< The telemetry of the most recent frames.
+
+    std::vector<std::shared_ptr<RenderTargets>> mRenderTargets; ///< Render targets of each traced camera.
 
     vkCore::Descriptors mDescriptors;
     std::vector<vk::DescriptorSet> mDescriptorSets;
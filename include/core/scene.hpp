@@ -24,17 +24,25 @@
 
 #include "core/camera.hpp"
 #include "core/geometry.hpp"
+#include "core/geometry_buffer.hpp"
 #include "core/config.hpp"
 #include "core/light.hpp"
+#include "core/slot_map.hpp"
+#include "core/texture.hpp"
 
 namespace kuafu {
 class Context;
 
 class Kuafu;
 
+using GeometryHandle = SlotHandle;          ///< The handle's index is the geometry index.
+using GeometryInstanceHandle = SlotHandle;
+
 /// Stores all geoemtry, geometry instances and light sources.
 /// Provides functions to change said data.
-/// @todo removeGeometry()
+///
+/// Geometries and instances are kept in slot maps, so submitting, removing and looking them up is O(1). A geometry
+/// keeps its geometry index until it is removed, instances are densely packed in the order of the instance buffer.
 /// @ingroup BASE
 /// @ingroup API
 class Scene {
@@ -44,18 +52,28 @@ public:
 
     Scene() = delete;
 
+    ~Scene();
+
+    /// @return Returns all geometries in the scene. Removing a geometry changes the order.
     auto getGeometries() const -> const std::vector<std::shared_ptr<Geometry>> &;
 
-    /// @return Returns all geometry instances in the scene.
+    /// @return Returns all geometry instances in the scene. Removing an instance changes the order.
     auto getGeometryInstances() const -> const std::vector<std::shared_ptr<GeometryInstance>> &;
 
+    /// @param index The instance's position in getGeometryInstances().
     auto getGeometryInstance(size_t index) const -> std::shared_ptr<GeometryInstance>;
 
+    /// @return Returns the instance of a handle, or nullptr if it was removed.
+    auto getGeometryInstance(GeometryInstanceHandle handle) const -> std::shared_ptr<GeometryInstance>;
+
     /// Used to submit a geometry instance for rendering.
-    /// @param geometryInstance The instance to queue for rendering.
+    /// @param geometryInstance The instance to queue for rendering. Its geometry must have been submitted.
+    /// @return Returns the instance's handle. Submitting an instance twice returns the same handle.
+    /// @note An instance belongs to one scene at a time, it must be removed before it is submitted to another one. The
+    /// overload taking a reference submits a copy, which always belongs to this scene only.
     /// @note This function does not invoke any draw calls.
-    void submitGeometryInstance(std::shared_ptr<GeometryInstance> geometryInstance);
-    void submitGeometryInstance(const GeometryInstance& geometryInstance);
+    GeometryInstanceHandle submitGeometryInstance(std::shared_ptr<GeometryInstance> geometryInstance);
+    GeometryInstanceHandle submitGeometryInstance(const GeometryInstance& geometryInstance);
 
     /// Used to submit multiple geometry instances for rendering, replacing all existing instances.
     /// @param geometryInstances The instances to queue for rendering.
@@ -67,8 +85,33 @@ public:
     /// Once a geometry instance was removed, it will no longer be rendered.
     /// @param geometryInstance The instance to remove.
     void removeGeometryInstance(const std::shared_ptr<GeometryInstance> &geometryInstance);
+    void removeGeometryInstance(GeometryInstanceHandle handle);
     void removeGeometryInstances(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances);
 
+    /// Used to move many geometry instances at once, e.g. after every simulation step.
+    ///
+    /// The poses are copied as they are and turned into world transforms on the device, right before the top level
+    /// acceleration structure is updated. They replace the transforms of the instances until the next call, but the
+    /// instances' transform members are not updated.
+    /// @param poses The poses of the leading instances, in the order of getGeometryInstances(). Pass no poses to go
+    /// back to the instances' own transforms.
+    /// @note The poses are matched to the instances by position, submitting or removing instances changes the order.
+    void setInstancePoses(std::span<const Pose> poses);
+
+    /// Like setInstancePoses(std::span<const Pose>), for poses in any other layout, e.g. straight from a physics
+    /// engine. The floats are copied as they are, the layout is applied on the device.
+    /// @param poses The poses of the leading instances, layout.stride floats each.
+    /// @param layout Where the members of a pose are found.
+    void setInstancePoses(std::span<const float> poses, const PoseLayout &layout);
+
+    /// @return Returns the number of leading instances that are posed.
+    auto getInstancePoseCount() const -> size_t;
+
+    /// @return Returns the poses that are applied to the instances, laid out as in getInstancePoseLayout().
+    auto getInstancePoses() const -> std::span<const float>;
+
+    [[nodiscard]] inline auto getInstancePoseLayout() const -> const PoseLayout & { return mInstancePoseLayout; }
+
     /// Used to remove all geometry instances.
     ///
     /// However, geometries remain loaded and must be deleted explicitely.
@@ -78,8 +121,9 @@ public:
     ///
     /// Once a geometry was submitted, geometry instances referencing this particular geometry can be drawn.
     /// @param geometry The geometry to submit.
-    void submitGeometry(std::shared_ptr<Geometry> geometry);
-    void submitGeometry(const Geometry& geometry);
+    /// @return Returns the geometry's handle. Shared geometries, e.g. from getSharedSphere(), only occupy a single slot.
+    GeometryHandle submitGeometry(std::shared_ptr<Geometry> geometry);
+    GeometryHandle submitGeometry(const Geometry& geometry);
 
     /// Used to submit multiple geometries and set up their buffers.
     ///
@@ -88,16 +132,37 @@ public:
     void setGeometries(const std::vector<std::shared_ptr<Geometry>> &geometries);
 
     /// Used to remove a geometry.
-    /// @param geometry The geometry to remove.
+    /// @param geometry The geometry to remove. No instance may reference it anymore.
     void removeGeometry(std::shared_ptr<Geometry> geometry);
 
     /// Used to remove a geometry.
     /// @param geometryIndex The geometry's index.
     void removeGeometry(uint32_t geometryIndex);
 
+    void removeGeometry(GeometryHandle handle);
+
     /// Used to remove all geometries
     void clearGeometries();
 
+    /// Used to deform a dynamic geometry, e.g. simulated cloth, without uploading it again.
+    ///
+    /// The vertices are written in place and the geometry's BLAS is refit instead of rebuilt, see
+    /// Config::setBlasRebuildInterval(). Static geometries are not affected.
+    /// @param geometry The geometry to update. It must be dynamic and not procedural.
+    /// @param vertices The new vertices, as many as the geometry has. The indices stay the same.
+    void updateGeometryVertices(const std::shared_ptr<Geometry> &geometry, std::span<const Vertex> vertices);
+
+    /// Used to deform a dynamic geometry with positions that already are on the device.
+    ///
+    /// Only the positions are updated, normals and texture coordinates stay as they are. The geometry's vertices on the
+    /// host are not updated.
+    /// @param geometry The geometry to update. It must be dynamic, not procedural and already be uploaded.
+    /// @param positions A buffer with tightly packed positions, as many as the geometry has vertices. It needs
+    /// eTransferSrc usage and is read on the graphics queue when the next frame is rendered.
+    /// @param offset The offset of the positions in the buffer.
+    void updateGeometryVertices(const std::shared_ptr<Geometry> &geometry, vk::Buffer positions,
+                                vk::DeviceSize offset = 0);
+
     inline void setClearColor(const glm::vec4 &clearColor) {
         mClearColor = clearColor;
         pConfig->triggerSwapchainRefresh();
@@ -147,12 +212,19 @@ public:
     /// @return Returns a pointer to the renderer's camera.
     Camera* getCamera() const { return mCurrentCamera; }
 
-    inline auto getGeometryInstanceCount() { return mGeometries.size(); }
+    inline auto getGeometryInstanceCount() { return mGeometryInstances.size(); }
 
     inline void markGeometriesChanged() { mUploadGeometries = true; }
 
+    /// Rebuilds the top level acceleration structure with the next frame, after all frames in flight finished.
     inline void markGeometryInstancesChanged() { mUploadGeometryInstancesToBuffer = true; }
 
+    /// Uploads a single instance again with the next frame, e.g. after its transform was assigned directly.
+    ///
+    /// Unlike markGeometryInstancesChanged(), the frames in flight are not waited for and the top level acceleration
+    /// structure is only refit. Instances that are not in the scene are ignored.
+    void markGeometryInstanceDirty(const GeometryInstance *geometryInstance);
+
     inline void setDirectionalLight(std::shared_ptr<DirectionalLight> light) { pDirectionalLight = light; };
     inline void removeDirectionalLight() { pDirectionalLight = nullptr; }
 
@@ -222,17 +294,31 @@ private:
 
     void prepareBuffers();
 
-    void uploadUniformBuffers(uint32_t imageIndex);
+    void uploadUniformBuffers(uint32_t imageIndex, const std::vector<Camera *> &cameras);
 
-    void uploadCameraBuffer(uint32_t imageIndex);
+    void uploadCameraBuffer(uint32_t imageIndex, const std::vector<Camera *> &cameras);
 
     void uploadLightBuffers(uint32_t imageIndex);
 
     void uploadEnvironmentMap();
 
-    void uploadGeometries();
+    /// Records the upload of all materials and the textures they and the active lights use to the batch.
+    void uploadMaterials(vkCore::UploadBatch &batch);
+
+    /// Records the upload of textures, materials and geometries to the batch.
+    void uploadGeometries(vkCore::UploadBatch &batch);
+
+    /// Writes the dirty instances to the staging buffer of a frame. They are copied into the instance buffer by
+    /// recordGeometryInstanceUploads(), so frames in flight keep the instances they were recorded with.
+    /// @return Returns the positions of the uploaded instances in getGeometryInstances(), in ascending order.
+    auto uploadGeometryInstances(size_t frameIndex) -> std::vector<uint32_t>;
+
+    /// Records the copies of the last uploadGeometryInstances(), before the poses are applied and the TLAS is built.
+    void recordGeometryInstanceUploads(vk::CommandBuffer cmdBuf);
 
-    void uploadGeometryInstances();
+    void markGeometryInstanceSlotDirty(uint32_t slot);
+
+    void markAllGeometryInstancesDirty();
 
     void addDummy();
 
@@ -240,6 +326,9 @@ private:
 
     void translateDummy();
 
+    /// Resolves the geometry index of an instance and counts the reference.
+    void attachGeometryInstance(GeometryInstance &geometryInstance);
+
     void updateSceneDescriptors();
 
     void updateGeometryDescriptors();
@@ -260,17 +349,43 @@ private:
     vkCore::Cubemap mEnvironmentMap;
     vk::UniqueSampler mImmutableSampler;
 
-    std::vector<vkCore::StorageBuffer<uint32_t>> mIndexBuffers;
-    std::vector<vkCore::StorageBuffer<uint32_t>> mMaterialIndexBuffers;
-    std::vector<vkCore::StorageBuffer<Vertex>> mVertexBuffers;
+    GeometryBuffer mGeometryBuffer;                                     ///< The data of all geometries.
+    std::unordered_map<const Geometry *, GeometryAllocation> mGeometryAllocations;
+    std::unordered_map<const Geometry *, VertexUpdate> mVertexUpdates; ///< The vertices to write with the next frame.
+    vkCore::StorageBuffer<GeometryRecordSSBO> mGeometryRecordsBuffer;  ///< The records of all geometries, by geometry index.
     vkCore::StorageBuffer<NiceMaterialSSBO> mMaterialBuffers;
+    uint64_t mUploadedMaterialVersion = 0;  ///< The version of the material registry in mMaterialBuffers.
     vkCore::StorageBuffer<GeometryInstanceSSBO> mGeometryInstancesBuffer;
-    std::vector<std::shared_ptr<vkCore::Texture>> mTextures;
+    std::vector<bool> mGeometryInstanceDirty;                          ///< By slot index.
+    std::vector<uint32_t> mDirtyGeometryInstances;                     ///< The slots of the instances to upload with the next frame.
+    std::vector<float> mInstancePoses;                                 ///< The poses of the leading instances.
+    PoseLayout mInstancePoseLayout;
+
+    /// The dirty instances of a frame, copied into the instance buffer by the frame's command buffer.
+    struct InstanceStaging {
+        vkCore::Buffer buffer;
+        GeometryInstanceSSBO *pData = nullptr;
+        size_t capacity = 0;
+    };
 
-    vkCore::UniformBuffer<CameraUBO> mCameraUniformBuffer;
+    std::vector<std::unique_ptr<InstanceStaging>> mInstanceStaging;    ///< One per frame in flight.
+    std::vector<vk::BufferCopy> mInstanceCopies;                       ///< The copies to record with the next frame.
+    vk::Buffer mInstanceCopySource;
+    std::vector<std::shared_ptr<vkCore::Texture>> mTextures; ///< The textures bound to the geometry descriptors, by texture index.
+    TextureCache mTextureCache;
+
+    vkCore::UniformBuffer<CamerasUBO> mCameraUniformBuffer;
+
+    /// Where a geometry is stored and how many instances reference it.
+    struct GeometryEntry {
+        GeometryHandle handle;
+        uint32_t instanceCount = 0;
+    };
 
-    std::vector<std::shared_ptr<Geometry>> mGeometries;
-    std::vector<std::shared_ptr<GeometryInstance>> mGeometryInstances;
+    SlotMap<std::shared_ptr<Geometry>> mGeometries;                   ///< Slot indices are the geometry indices.
+    SlotMap<std::shared_ptr<GeometryInstance>> mGeometryInstances;    ///< Packed in the order of the instance buffer.
+    std::unordered_map<const Geometry *, GeometryEntry> mGeometryEntries;
+    std::unordered_map<const GeometryInstance *, GeometryInstanceHandle> mGeometryInstanceHandles;
 
     std::shared_ptr<DirectionalLight> pDirectionalLight;
     vkCore::UniformBuffer<DirectionalLightUBO> mDirectionalLightUniformBuffer;
@@ -285,6 +400,7 @@ private:
     bool mUseEnvironmentMap = false;
 
     bool mUploadGeometryInstancesToBuffer = false;
+    bool mUploadInstancePoses = false;
     bool mUploadEnvironmentMap = false;
     bool mUploadGeometries = false;
     bool mDummy = false;
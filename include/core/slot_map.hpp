@@ -0,0 +1,142 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+namespace kuafu {
+/// A generational handle to a value in a SlotMap.
+///
+/// The index is stable for as long as the value is in the map. Once it is removed, the slot's generation is bumped, so
+/// handles to the removed value stay invalid even after the slot was reused.
+/// @ingroup API
+struct SlotHandle {
+    static constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index = invalid;
+    uint32_t generation = 0;
+
+    [[nodiscard]] inline bool valid() const { return index != invalid; }
+
+    bool operator==(const SlotHandle &other) const = default;
+};
+
+/// Stores values in densely packed storage, addressed by generational handles.
+///
+/// Inserting, removing and looking up a value are O(1). Removing a value moves the last value into its place, so the
+/// order of values() changes, but the slot indices of handles do not.
+template<typename T>
+class SlotMap {
+public:
+    /// @return Returns the handle of the inserted value.
+    SlotHandle insert(T value) {
+        uint32_t index;
+        if (!mFreeSlots.empty()) {
+            index = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(mSlots.size());
+            mSlots.emplace_back();
+        }
+
+        mSlots[index].dense = static_cast<uint32_t>(mValues.size());
+        mValues.push_back(std::move(value));
+        mDenseToSlot.push_back(index);
+
+        return {index, mSlots[index].generation};
+    }
+
+    /// Removes a value, handles that are no longer valid are ignored.
+    /// @return Returns true if a value was removed.
+    bool erase(SlotHandle handle) {
+        if (!contains(handle))
+            return false;
+
+        auto &slot = mSlots[handle.index];
+        uint32_t dense = slot.dense;
+        uint32_t last = static_cast<uint32_t>(mValues.size() - 1);
+
+        if (dense != last) {
+            mValues[dense] = std::move(mValues[last]);
+            mDenseToSlot[dense] = mDenseToSlot[last];
+            mSlots[mDenseToSlot[dense]].dense = dense;
+        }
+
+        mValues.pop_back();
+        mDenseToSlot.pop_back();
+
+        slot.dense = SlotHandle::invalid;
+        ++slot.generation;
+        mFreeSlots.push_back(handle.index);
+
+        return true;
+    }
+
+    void clear() {
+        for (auto index : mDenseToSlot) {
+            mSlots[index].dense = SlotHandle::invalid;
+            ++mSlots[index].generation;
+            mFreeSlots.push_back(index);
+        }
+
+        mValues.clear();
+        mDenseToSlot.clear();
+    }
+
+    void reserve(size_t capacity) {
+        mValues.reserve(capacity);
+        mDenseToSlot.reserve(capacity);
+    }
+
+    [[nodiscard]] inline bool contains(SlotHandle handle) const {
+        return handle.index < mSlots.size() &&
+               mSlots[handle.index].generation == handle.generation &&
+               mSlots[handle.index].dense != SlotHandle::invalid;
+    }
+
+    /// @return Returns the value of a handle, or nullptr if the handle is not valid.
+    [[nodiscard]] inline T *get(SlotHandle handle) {
+        return contains(handle) ? &mValues[mSlots[handle.index].dense] : nullptr;
+    }
+
+    [[nodiscard]] inline const T *get(SlotHandle handle) const {
+        return contains(handle) ? &mValues[mSlots[handle.index].dense] : nullptr;
+    }
+
+    /// @return Returns the handle of the value in the given slot, or an invalid handle if the slot is free.
+    [[nodiscard]] inline SlotHandle find(uint32_t index) const {
+        if (index >= mSlots.size() || mSlots[index].dense == SlotHandle::invalid)
+            return {};
+
+        return {index, mSlots[index].generation};
+    }
+
+    /// @return Returns the handle of the value at the given position of values().
+    [[nodiscard]] inline SlotHandle getHandle(size_t dense) const {
+        uint32_t index = mDenseToSlot[dense];
+        return {index, mSlots[index].generation};
+    }
+
+    /// @return Returns the position of a value in values(). The handle must be valid.
+    [[nodiscard]] inline uint32_t getDenseIndex(SlotHandle handle) const { return mSlots[handle.index].dense; }
+
+    /// @return Returns all values, densely packed.
+    [[nodiscard]] inline const std::vector<T> &values() const { return mValues; }
+
+    [[nodiscard]] inline size_t size() const { return mValues.size(); }
+
+    [[nodiscard]] inline bool empty() const { return mValues.empty(); }
+
+    /// @return Returns the number of slots, including free ones. All slot indices are below.
+    [[nodiscard]] inline size_t getSlotCount() const { return mSlots.size(); }
+
+private:
+    struct Slot {
+        uint32_t dense = SlotHandle::invalid;   ///< The position of the slot's value in mValues, invalid if free.
+        uint32_t generation = 0;
+    };
+
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    std::vector<T> mValues;
+    std::vector<uint32_t> mDenseToSlot;     ///< The slot of each value in mValues.
+};
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+namespace kuafu {
+/// Keeps the textures that are resident on the GPU, keyed by their canonical path.
+///
+/// Textures are handed out as shared pointers, a texture stays resident as long as it is referenced outside the cache
+/// and is evicted by evictUnused() otherwise. All textures are sampled with the scene's immutable sampler, so the path
+/// alone identifies a texture.
+/// @note Evicting textures destroys them, the device must not be using them anymore.
+class TextureCache {
+public:
+    /// Returns the resident texture of the given file, only loads it if it is not resident yet.
+    /// @param path The path to the texture file.
+    /// @return Returns the texture.
+    /// @throws std::runtime_error if the texture can not be loaded.
+    std::shared_ptr<vkCore::Texture> acquire(const std::string &path);
+
+    /// Makes all given textures resident.
+    ///
+    /// Textures that are not resident yet are decoded on all cores and uploaded in chunks of bounded size, each chunk
+    /// is submitted to the batch once it was recorded. The textures must not be sampled before the batch finished.
+    /// Files that can not be loaded are skipped, acquire() reports them.
+    /// @param paths The paths to the texture files.
+    /// @param batch The batch to record the uploads to.
+    void load(const std::vector<std::string> &paths, vkCore::UploadBatch &batch);
+
+    /// Destroys all textures that are not referenced outside the cache anymore.
+    /// @return Returns the number of evicted textures.
+    size_t evictUnused();
+
+    [[nodiscard]] inline size_t size() const { return mTextures.size(); }
+
+    inline void clear() { mTextures.clear(); }
+
+private:
+    /// @return Returns the canonical path, or the path itself if it can not be resolved.
+    static std::string getKey(const std::string &path);
+
+    std::unordered_map<std::string, std::shared_ptr<vkCore::Texture>> mTextures;
+};
+}
@@ -22,13 +22,21 @@
 //
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <ktx.h>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <tuple>
+#include <utility>
 #include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_STATIC
@@ -72,6 +80,8 @@
 
 namespace vkCore
 {
+  class MemoryAllocator;
+
   namespace global
   {
     inline vk::PhysicalDeviceLimits physicalDeviceLimits;
@@ -82,15 +92,17 @@ namespace vkCore
     inline vk::SurfaceKHR surface            = nullptr;
     inline vk::Queue graphicsQueue           = nullptr;
     inline vk::Queue transferQueue           = nullptr;
-    inline vk::Queue computeQueue            = nullptr; // @todo Is not created.
+    inline vk::Queue computeQueue            = nullptr;
     inline vk::CommandPool graphicsCmdPool   = nullptr;
     inline vk::CommandPool transferCmdPool   = nullptr;
-    inline vk::CommandPool computeCmdPool    = nullptr; // @todo Is not created.
+    inline vk::CommandPool computeCmdPool    = nullptr;
     inline uint32_t graphicsFamilyIndex      = 0U;
     inline uint32_t transferFamilyIndex      = 0U;
+    inline uint32_t computeFamilyIndex       = 0U; ///< The graphics family if there is no async compute family.
     inline uint32_t dataCopies               = 2U;
     inline uint32_t swapchainImageCount      = 0U;
     inline float queuePriority               = 1.0F;
+    inline MemoryAllocator* allocator        = nullptr; ///< Used by all buffers and images if set.
   } // namespace global
 
   namespace details
@@ -308,14 +320,21 @@ namespace vkCore
 
     std::string deviceName = properties.deviceName;
 
-    // Always prefer dedicated GPUs.
-    if ( properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu )
-    {
-      score += 100U;
-    }
-    else
+    // Always prefer dedicated GPUs, but allow others, e.g. software drivers on machines without a GPU.
+    switch ( properties.deviceType )
     {
-      return { 0U, deviceName };
+      case vk::PhysicalDeviceType::eDiscreteGpu:
+        score += 1000U;
+        break;
+      case vk::PhysicalDeviceType::eIntegratedGpu:
+      case vk::PhysicalDeviceType::eVirtualGpu:
+        score += 100U;
+        break;
+      case vk::PhysicalDeviceType::eCpu:
+        score += 10U;
+        break;
+      default:
+        return { 0U, deviceName };
     }
 
     // Prefer newer Vulkan support.
@@ -514,6 +533,7 @@ namespace vkCore
   {
     std::optional<uint32_t> graphicsFamilyIndex;
     std::optional<uint32_t> transferFamilyIndex;
+    std::optional<uint32_t> computeFamilyIndex;
 
     auto queueFamilyProperties = global::physicalDevice.getQueueFamilyProperties( );
     std::vector<uint32_t> queueFamilies( queueFamilyProperties.size( ) );
@@ -546,6 +566,30 @@ namespace vkCore
       }
     }
 
+    // A family with transfer but without compute support is the copy engine, prefer it over an async compute family.
+    for ( uint32_t index = 0; index < static_cast<uint32_t>( queueFamilies.size( ) ); ++index )
+    {
+      auto flags = queueFamilyProperties[index].queueFlags;
+      if ( flags & vk::QueueFlagBits::eTransfer && !( flags & ( vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute ) ) )
+      {
+        transferFamilyIndex = index;
+        break;
+      }
+    }
+
+    // Async compute, a compute family without graphics support that is not used for transfers if possible.
+    for ( uint32_t index = 0; index < static_cast<uint32_t>( queueFamilies.size( ) ); ++index )
+    {
+      auto flags = queueFamilyProperties[index].queueFlags;
+      if ( flags & vk::QueueFlagBits::eCompute && !( flags & vk::QueueFlagBits::eGraphics ) )
+      {
+        if ( !computeFamilyIndex.has_value( ) || computeFamilyIndex == transferFamilyIndex )
+        {
+          computeFamilyIndex = index;
+        }
+      }
+    }
+
     if ( !graphicsFamilyIndex.has_value( ) || !transferFamilyIndex.has_value( ) )
     {
       VK_CORE_THROW( "Failed to retrieve queue family indices." );
@@ -553,13 +597,24 @@ namespace vkCore
 
     global::graphicsFamilyIndex = graphicsFamilyIndex.value( );
     global::transferFamilyIndex = transferFamilyIndex.value( );
+
+    // Without an async compute family, compute work runs on the graphics queue.
+    global::computeFamilyIndex = computeFamilyIndex.value_or( graphicsFamilyIndex.value( ) );
+  }
+
+  /// @return Returns the distinct families of the graphics, transfer and compute queues.
+  inline auto getQueueFamilyIndices( ) -> std::vector<uint32_t>
+  {
+    std::set<uint32_t> queueFamilyIndices = { global::graphicsFamilyIndex, global::transferFamilyIndex, global::computeFamilyIndex };
+    return { queueFamilyIndices.begin( ), queueFamilyIndices.end( ) };
   }
 
   inline std::vector<vk::DeviceQueueCreateInfo> getDeviceQueueCreateInfos( )
   {
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
 
-    std::vector<uint32_t> queueFamilyIndices = { global::graphicsFamilyIndex, global::transferFamilyIndex };
+    // Queues that share a family share the family's first queue.
+    std::vector<uint32_t> queueFamilyIndices = getQueueFamilyIndices( );
 
     uint32_t index = 0;
     for ( const auto& queueFamilyIndex : queueFamilyIndices )
@@ -1086,10 +1141,17 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
     return shaderModule;
   }
 
+  /// @return Returns the loader of the Vulkan library, which stays loaded for the lifetime of the application.
+  /// @note Loads the library directly, no window system (e.g. SDL) has to be initialized.
+  inline auto getDynamicLoader( ) -> vk::DynamicLoader&
+  {
+    static vk::DynamicLoader dl;
+    return dl;
+  }
+
   inline auto initInstance( const std::vector<const char*>& layers, std::vector<const char*>& extensions, uint32_t minVersion = VK_API_VERSION_1_0 ) -> vk::Instance
   {
-    vk::DynamicLoader dl;
-    auto vkGetInstanceProcAddr = dl.getProcAddress<PFN_vkGetInstanceProcAddr>( "vkGetInstanceProcAddr" );
+    auto vkGetInstanceProcAddr = getDynamicLoader( ).getProcAddress<PFN_vkGetInstanceProcAddr>( "vkGetInstanceProcAddr" );
     VULKAN_HPP_DEFAULT_DISPATCHER.init( vkGetInstanceProcAddr );
 
     // Check if all extensions and layers needed are available.
@@ -1283,8 +1345,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
 
   inline auto initInstanceUnique( const std::vector<const char*>& layers, std::vector<const char*>& extensions, uint32_t minVersion = VK_API_VERSION_1_0 ) -> vk::UniqueInstance
   {
-    vk::DynamicLoader dl;
-    auto vkGetInstanceProcAddr = dl.getProcAddress<PFN_vkGetInstanceProcAddr>( "vkGetInstanceProcAddr" );
+    auto vkGetInstanceProcAddr = getDynamicLoader( ).getProcAddress<PFN_vkGetInstanceProcAddr>( "vkGetInstanceProcAddr" );
     VULKAN_HPP_DEFAULT_DISPATCHER.init( vkGetInstanceProcAddr );
 
     // Check if all extensions and layers needed are available.
@@ -1345,406 +1406,1416 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
   // Classes
   // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-  /// A wrapper class for Vulkan command buffer objects.
-  class CommandBuffer
+  /// What device memory is used for.
+  ///
+  /// The MemoryAllocator keeps separate pools and statistics for every usage.
+  enum class MemoryUsage
+  {
+    eDeviceLocal,           ///< Only accessed by the device.
+    eHostVisible,           ///< Written by the host and read by the device, e.g. uniform buffers.
+    eStaging,               ///< Short-lived host visible memory, e.g. staging buffers. Allocated linearly.
+    eReadback,              ///< Written by the device and read by the host, host cached memory is preferred.
+    eAccelerationStructure, ///< Acceleration structure storage.
+    eCount
+  };
+
+  /// Statistics of all allocations of a MemoryUsage.
+  struct MemoryStats
+  {
+    uint32_t blockCount             = 0; ///< Device memory blocks that allocations are suballocated from.
+    vk::DeviceSize blockBytes       = 0;
+    uint32_t allocationCount        = 0; ///< Live allocations, including dedicated ones.
+    vk::DeviceSize allocationBytes  = 0; ///< Sizes of the live allocations, including padding for alignment.
+    uint32_t dedicatedCount         = 0; ///< Allocations with their own device memory.
+    vk::DeviceSize dedicatedBytes   = 0;
+  };
+
+  /// A range of device memory handed out by the MemoryAllocator.
+  ///
+  /// The memory is returned to the allocator when the allocation is destroyed. Host visible memory is mapped persistently.
+  /// @ingroup API
+  class Allocation
   {
   public:
-    CommandBuffer( ) = default;
+    Allocation( ) = default;
 
-    /// Call to init(vk::CommandPool, uint32_t, vk::CommandBufferUsageFlags).
-    CommandBuffer( vk::CommandPool commandPool, uint32_t count = 1, vk::CommandBufferUsageFlags usageFlags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    Allocation( const Allocation& ) = delete;
+
+    Allocation( Allocation&& other ) noexcept
     {
-      init( commandPool, count, usageFlags );
+      *this = std::move( other );
     }
 
-    /// Creates the command buffers.
-    /// @param commandPool The command pool from which the command buffers will be allocated from.
-    /// @param count The amount of Vulkan command buffers to initialize (the same as the amount of images in the swapchain).
-    /// @param usageFlags Specifies what the buffer will be used for.
-    void init( vk::CommandPool commandPool, uint32_t count = 1, vk::CommandBufferUsageFlags usageFlags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    ~Allocation( )
     {
-      _commandPool = commandPool;
-
-      _commandBuffers.resize( count );
+      free( );
+    }
 
-      vk::CommandBufferAllocateInfo allocateInfo( commandPool,                      // commandPool
-                                                  vk::CommandBufferLevel::ePrimary, // level
-                                                  count );                          // commandBufferCount
+    auto operator=( const Allocation& ) -> Allocation& = delete;
 
-      _commandBuffers = global::device.allocateCommandBuffers( allocateInfo );
-      for ( const vk::CommandBuffer& commandBuffer : _commandBuffers )
+    auto operator=( Allocation&& other ) noexcept -> Allocation&
+    {
+      if ( this != &other )
       {
-        VK_CORE_ASSERT( commandBuffer, "Failed to create command buffers." );
+        free( );
+
+        _allocator   = std::exchange( other._allocator, nullptr );
+        _allocatorId = std::exchange( other._allocatorId, 0 );
+        _memory      = std::exchange( other._memory, nullptr );
+        _offset    = other._offset;
+        _size      = other._size;
+        _mapped    = std::exchange( other._mapped, nullptr );
+        _pool      = other._pool;
+        _block     = other._block;
+        _order     = other._order;
+        _usage     = other._usage;
       }
 
-      // Set up begin info.
-      _beginInfo.flags = usageFlags;
+      return *this;
     }
 
-    auto get( ) const -> const std::vector<vk::CommandBuffer> { return _commandBuffers; }
+    auto getMemory( ) const -> vk::DeviceMemory { return _memory; }
 
-    auto get( size_t index ) const -> const vk::CommandBuffer { return _commandBuffers[index]; }
+    auto getOffset( ) const -> vk::DeviceSize { return _offset; }
 
-    void free( )
-    {
-      global::device.freeCommandBuffers( _commandPool, static_cast<uint32_t>( _commandBuffers.size( ) ), _commandBuffers.data( ) );
-    }
+    auto getSize( ) const -> vk::DeviceSize { return _size; }
 
-    void reset( )
-    {
-      for ( vk::CommandBuffer& buffer : _commandBuffers )
-      {
-        buffer.reset( vk::CommandBufferResetFlagBits::eReleaseResources );
-      }
-    }
+    /// @return Returns a pointer to the start of the allocation, or nullptr if the memory is not host visible.
+    auto getMapped( ) const -> void* { return _mapped; }
 
-    /// Used to begin the command buffer recording.
-    /// @param index An index to a command buffer to record to.
-    void begin( size_t index = 0 )
+    explicit operator bool( ) const { return static_cast<bool>( _memory ); }
+
+    /// Returns the memory to the allocator.
+    inline void free( );
+
+  private:
+    friend class MemoryAllocator;
+
+    static constexpr uint32_t dedicated = std::numeric_limits<uint32_t>::max( );
+
+    MemoryAllocator* _allocator = nullptr; ///< Not set if the memory was allocated without an allocator.
+    uint64_t _allocatorId       = 0;       ///< The id of the allocator at allocation, see MemoryAllocator::init().
+    vk::DeviceMemory _memory    = nullptr;
+    vk::DeviceSize _offset      = 0;
+    vk::DeviceSize _size        = 0;
+    void* _mapped               = nullptr;
+    uint32_t _pool              = dedicated;
+    uint32_t _block             = 0;
+    uint32_t _order             = 0;
+    MemoryUsage _usage          = MemoryUsage::eDeviceLocal;
+  };
+
+  /// Suballocates buffers, images and acceleration structures from large device memory blocks.
+  ///
+  /// Every combination of memory type, usage and resource kind has its own pool, so images never share a block with
+  /// buffers and the buffer image granularity never has to be respected. Staging memory is allocated linearly, a block
+  /// is reused once all of its allocations were freed. All other memory uses a buddy allocator, which aligns every
+  /// allocation to its size rounded up to a power of two. Allocations larger than half a block get their own memory.
+  /// @note The allocator must outlive all of its allocations and be destroyed before the device.
+  /// @ingroup API
+  class MemoryAllocator
+  {
+  public:
+    static constexpr vk::DeviceSize blockSize      = vk::DeviceSize( 64 ) << 20U;
+    static constexpr vk::DeviceSize minBuddySize   = 256;
+    static constexpr uint32_t maxOrder             = 18; ///< blockSize == minBuddySize << maxOrder
+    static constexpr vk::DeviceSize asAlignment    = 256; ///< Required offset alignment of acceleration structures.
+
+    MemoryAllocator( ) = default;
+
+    MemoryAllocator( const MemoryAllocator& ) = delete;
+
+    MemoryAllocator( MemoryAllocator&& ) = delete;
+
+    auto operator=( const MemoryAllocator& ) -> MemoryAllocator& = delete;
+
+    auto operator=( MemoryAllocator&& ) -> MemoryAllocator& = delete;
+
+    ~MemoryAllocator( )
     {
-      _commandBuffers[index].begin( _beginInfo );
+      destroy( );
     }
 
-    /// Used to stop the command buffer recording.
-    /// @param index An index to a command buffer to stop recording.
-    void end( size_t index = 0 )
+    /// Makes this the allocator used by all vkCore resources.
+    ///
+    /// Every call gives the allocator a new id, so allocations of a destroyed allocator are never returned to a new one
+    /// at the same address.
+    /// @note Must be called after the device was created.
+    void init( )
     {
-      _commandBuffers[index].end( );
+      _id               = _nextId++;
+      global::allocator = this;
     }
 
-    /// Submits the recorded commands to a queue.
-    /// @param queue The queue to submit to.
-    /// @param waitSemaphores A std::vector of semaphores to wait for.
-    /// @param signalSemaphores A std::vector of semaphores to signal.
-    /// @param waitDstStageMask The pipeline stage where the commands will be executed.
-    void submitToQueue( vk::Queue queue, vk::Fence fence = nullptr, const std::vector<vk::Semaphore>& waitSemaphores = { }, const std::vector<vk::Semaphore>& signalSemaphores = { }, vk::PipelineStageFlags* waitDstStageMask = { } )
+    /// Frees all blocks. Allocations that are still alive become invalid.
+    void destroy( )
     {
-      if ( _beginInfo.flags & vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
-      {
-        vk::SubmitInfo submitInfo( static_cast<uint32_t>( waitSemaphores.size( ) ),   // waitSemaphoreCount
-                                   waitSemaphores.data( ),                            // pWaitSemaphores
-                                   waitDstStageMask,                                  // pWaitDstStageMask
-                                   static_cast<uint32_t>( _commandBuffers.size( ) ),  // commandBufferCount
-                                   _commandBuffers.data( ),                           // pCommandBuffers
-                                   static_cast<uint32_t>( signalSemaphores.size( ) ), // signalSemaphoreCount
-                                   signalSemaphores.data( ) );                        // pSignalSemaphores
+      std::lock_guard lock( _mutex );
 
-        if ( queue.submit( 1, &submitInfo, fence ) != vk::Result::eSuccess )
+      for ( auto& pool : _pools )
+      {
+        for ( auto& block : pool.blocks )
         {
-          VK_CORE_THROW( "Failed to submit" );
+          if ( block.memory )
+          {
+            global::device.freeMemory( block.memory );
+          }
         }
-
-        queue.waitIdle( );
       }
-      else
+
+      _pools.clear( );
+
+      if ( global::allocator == this )
       {
-        VK_CORE_THROW( "Only command buffers with a usage flag containing eOneTimeSubmit should be submitted automatically" );
+        global::allocator = nullptr;
       }
     }
 
-  private:
-    std::vector<vk::CommandBuffer> _commandBuffers;
+    /// Allocates memory for the given requirements.
+    /// @param requirements The memory requirements of the resource.
+    /// @param memoryTypeIndex The memory type to allocate from.
+    /// @param usage What the memory is used for.
+    /// @param deviceAddress If true, the memory can be bound to buffers with a device address.
+    /// @param image If true, the memory is bound to an image with optimal tiling.
+    /// @return Returns the allocation.
+    auto allocate( const vk::MemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, bool deviceAddress = false, bool image = false ) -> Allocation
+    {
+      vk::DeviceSize alignment = requirements.alignment;
+      if ( usage == MemoryUsage::eAccelerationStructure )
+      {
+        alignment = std::max( alignment, asAlignment );
+      }
 
-    vk::CommandPool _commandPool; ///< The command pool used to allocate the command buffer from.
-    vk::CommandBufferBeginInfo _beginInfo;
-  };
+      vk::DeviceSize size = ( requirements.size + alignment - 1 ) / alignment * alignment;
 
-  // @todo move up to functions.
-  /// Transitions the image layout of any given image. The function will generate its own command buffer.
-  /// @param image The vulkan image for which you want to change the image layout.
-  /// @param oldLayout The current image layout of the given vulkan image.
-  /// @param newLayout The target image layout.
-  inline void transitionImageLayout( vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout )
-  {
-    auto barrierInfo = getImageMemoryBarrierInfo( image, oldLayout, newLayout );
+      if ( size > blockSize / 2 )
+      {
+        return allocateDedicated( this, size, memoryTypeIndex, usage, deviceAddress );
+      }
 
-    CommandBuffer commandBuffer;
-    commandBuffer.init( global::graphicsCmdPool );
-    commandBuffer.begin( );
+      std::lock_guard lock( _mutex );
 
-    commandBuffer.get( 0 ).pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
-                                            std::get<2>( barrierInfo ), // dstStageMask
-                                            vk::DependencyFlagBits::eByRegion,
-                                            0,
-                                            nullptr,
-                                            0,
-                                            nullptr,
-                                            1,
-                                            &std::get<0>( barrierInfo ) ); // barrier
+      Allocation allocation;
+      allocation._allocator   = this;
+      allocation._allocatorId = _id;
+      allocation._usage       = usage;
 
-    commandBuffer.end( );
-    commandBuffer.submitToQueue( global::graphicsQueue );
-  }
+      bool linear = usage == MemoryUsage::eStaging;
 
-  /// A wrapper class for a Vulkan image.
-  /// @ingroup API
-  class Image
-  {
-  public:
-    auto get( ) const -> vk::Image { return _image.get( ); }
+      auto poolIndex = getPool( memoryTypeIndex, usage, deviceAddress, image, linear );
+      auto& pool     = _pools[poolIndex];
 
-    auto getExtent( ) const -> vk::Extent3D { return _extent; }
+      allocation._pool = poolIndex;
+      if ( linear )
+      {
+        allocateLinear( pool, size, alignment, allocation );
+      }
+      else
+      {
+        allocateBuddy( pool, std::max( size, alignment ), allocation );
+      }
 
-    auto getFormat( ) const -> vk::Format { return _format; }
+      allocation._memory = pool.blocks[allocation._block].memory;
+      if ( pool.blocks[allocation._block].mapped != nullptr )
+      {
+        allocation._mapped = static_cast<uint8_t*>( pool.blocks[allocation._block].mapped ) + allocation._offset;
+      }
 
-    auto getLayout( ) const -> vk::ImageLayout { return _layout; }
+      auto& stats = _stats[static_cast<size_t>( usage )];
+      ++stats.allocationCount;
+      stats.allocationBytes += allocation._size;
 
-    /// Creates the image and allocates memory for it.
-    /// @param createInfo The Vulkan image create info.
-    void init( const vk::ImageCreateInfo& createInfo )
+      return allocation;
+    }
+
+    /// Allocates memory that is not shared with any other resource.
+    /// @param allocator The allocator whose statistics include the allocation. May be nullptr.
+    /// @param size The size in bytes.
+    /// @param memoryTypeIndex The memory type to allocate from.
+    /// @param usage What the memory is used for.
+    /// @param deviceAddress If true, the memory can be bound to buffers with a device address.
+    /// @param pNext Attachment to the memory's pNext chain, replaces the device address flags.
+    /// @return Returns the allocation.
+    static auto allocateDedicated( MemoryAllocator* allocator, vk::DeviceSize size, uint32_t memoryTypeIndex, MemoryUsage usage, bool deviceAddress = false, void* pNext = nullptr ) -> Allocation
     {
-      _extent = createInfo.extent;
-      _format = createInfo.format;
-      _layout = createInfo.initialLayout;
+      Allocation allocation;
+      allocation._allocator   = allocator;
+      allocation._allocatorId = allocator != nullptr ? allocator->_id : 0;
+      allocation._memory      = allocateBlock( size, memoryTypeIndex, deviceAddress, &allocation._mapped, pNext );
+      allocation._size        = size;
+      allocation._usage       = usage;
+
+      if ( allocator != nullptr )
+      {
+        std::lock_guard lock( allocator->_mutex );
 
-      _image = global::device.createImageUnique( createInfo );
-      VK_CORE_ASSERT( _image.get( ), "Failed to create image" );
-      _memory = allocateMemoryUnique( _image.get( ), vk::MemoryPropertyFlagBits::eDeviceLocal );
-      global::device.bindImageMemory( _image.get( ), _memory.get( ), 0 );
+        auto& stats = allocator->_stats[static_cast<size_t>( usage )];
+        ++stats.allocationCount;
+        ++stats.dedicatedCount;
+        stats.allocationBytes += size;
+        stats.dedicatedBytes += size;
+      }
+
+      return allocation;
     }
 
-    /// Used to transition this image's layout.
-    /// @param layout The target layout.
-    /// @param subresourceRange Optionally used to define a non-standard subresource range.
-    /// @note This function creates its own single-time usage command buffer.
-    void transitionToLayout( vk::ImageLayout layout, const vk::ImageSubresourceRange* subresourceRange = nullptr )
+    /// @return Returns the statistics of the given memory usage.
+    auto getStats( MemoryUsage usage ) const -> MemoryStats
     {
-      auto barrierInfo = getImageMemoryBarrierInfo( _image.get( ), _layout, layout, subresourceRange );
+      std::lock_guard lock( _mutex );
+      return _stats[static_cast<size_t>( usage )];
+    }
 
-      CommandBuffer commandBuffer;
-      commandBuffer.init( global::graphicsCmdPool );
-      commandBuffer.begin( );
+  private:
+    friend class Allocation;
 
-      commandBuffer.get( 0 ).pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
-                                              std::get<2>( barrierInfo ), // dstStageMask
-                                              vk::DependencyFlagBits::eByRegion,
-                                              0,
-                                              nullptr,
-                                              0,
-                                              nullptr,
-                                              1,
-                                              &std::get<0>( barrierInfo ) ); // barrier
+    struct Block
+    {
+      vk::DeviceMemory memory = nullptr;
+      void* mapped            = nullptr;
 
-      commandBuffer.end( );
-      commandBuffer.submitToQueue( global::graphicsQueue );
+      std::vector<std::set<vk::DeviceSize>> freeLists; ///< Free buddies by order.
 
-      _layout = layout;
-    }
+      vk::DeviceSize head = 0; ///< The end of the last linear allocation.
+      uint32_t liveCount  = 0;
+    };
 
-    /// Used to transition this image's layout using an already existing command buffer.
-    /// @param layout The target layout
-    /// @param commandBuffer The command buffer that will be used to set up a pipeline barrier.
-    /// @param subresourceRange Optionally used to define a non-standard subresource range.
-    void transitionToLayout( vk::ImageLayout layout, vk::CommandBuffer commandBuffer, const vk::ImageSubresourceRange* subresourceRange = nullptr )
+    struct Pool
     {
-      auto barrierInfo = getImageMemoryBarrierInfo( _image.get( ), _layout, layout, subresourceRange );
+      uint32_t memoryTypeIndex = 0;
+      MemoryUsage usage        = MemoryUsage::eDeviceLocal;
+      bool deviceAddress       = false;
+      bool image               = false;
+      bool linear              = false;
 
-      commandBuffer.pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
-                                     std::get<2>( barrierInfo ), // dstStageMask
-                                     vk::DependencyFlagBits::eByRegion,
-                                     0,
-                                     nullptr,
-                                     0,
-                                     nullptr,
-                                     1,
-                                     &std::get<0>( barrierInfo ) ); // barrier
+      std::vector<Block> blocks; ///< Freed blocks keep their slot with a null memory handle.
+    };
 
-      _layout = layout;
-    }
+    static auto allocateBlock( vk::DeviceSize size, uint32_t memoryTypeIndex, bool deviceAddress, void** mapped, void* pNext = nullptr ) -> vk::DeviceMemory
+    {
+      vk::MemoryAllocateFlagsInfo allocateFlags( vk::MemoryAllocateFlagBits::eDeviceAddress );
 
-  protected:
-    vk::UniqueImage _image;
-    vk::UniqueDeviceMemory _memory;
+      vk::MemoryAllocateInfo allocateInfo( size, memoryTypeIndex );
+      if ( pNext != nullptr )
+      {
+        allocateInfo.pNext = pNext;
+      }
+      else if ( deviceAddress )
+      {
+        allocateInfo.pNext = &allocateFlags;
+      }
 
-    vk::Extent3D _extent;
-    vk::Format _format;
-    vk::ImageLayout _layout;
-  };
+      auto memory = global::device.allocateMemory( allocateInfo );
+      VK_CORE_ASSERT( memory, "Failed to allocate memory." );
 
-  /// A wrapper class for a Vulkan buffer object.
-  /// @ingroup API
-  class Buffer
-  {
-  public:
-    Buffer( ) = default;
+      static vk::PhysicalDeviceMemoryProperties memoryProperties = global::physicalDevice.getMemoryProperties( );
+      if ( memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible )
+      {
+        if ( global::device.mapMemory( memory, 0, VK_WHOLE_SIZE, { }, mapped ) != vk::Result::eSuccess )
+        {
+          VK_CORE_THROW( "Failed to map memory." );
+        }
+      }
 
-    /// Call to init(k::DeviceSize, vk::BufferUsageFlags, const std::vector<uint32_t>&, vk::MemoryPropertyFlags).
-    Buffer( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices = { }, vk::MemoryPropertyFlags memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, void* pNextMemory = nullptr )
-    {
-      init( size, usage, queueFamilyIndices, memoryPropertyFlags, pNextMemory );
+      return memory;
     }
 
-    /// If memory was mapped previously, the destructor will automatically unmap it again.
-    ~Buffer( )
+    auto getPool( uint32_t memoryTypeIndex, MemoryUsage usage, bool deviceAddress, bool image, bool linear ) -> uint32_t
     {
-      if ( _memory && _mapped )
+      for ( size_t i = 0; i < _pools.size( ); ++i )
       {
-        global::device.unmapMemory( _memory.get( ) );
+        const auto& pool = _pools[i];
+        if ( pool.memoryTypeIndex == memoryTypeIndex && pool.usage == usage && pool.deviceAddress == deviceAddress && pool.image == image && pool.linear == linear )
+        {
+          return static_cast<uint32_t>( i );
+        }
+      }
+
+      _pools.push_back( { memoryTypeIndex, usage, deviceAddress, image, linear, { } } );
+      return static_cast<uint32_t>( _pools.size( ) - 1 );
+    }
+
+    /// @return Returns the index of a new block in the pool.
+    auto addBlock( Pool& pool ) -> uint32_t
+    {
+      uint32_t index = static_cast<uint32_t>( pool.blocks.size( ) );
+      for ( uint32_t i = 0; i < pool.blocks.size( ); ++i )
+      {
+        if ( !pool.blocks[i].memory )
+        {
+          index = i;
+          break;
+        }
+      }
+
+      if ( index == pool.blocks.size( ) )
+      {
+        pool.blocks.emplace_back( );
+      }
+
+      auto& block  = pool.blocks[index];
+      block        = Block( );
+      block.memory = allocateBlock( blockSize, pool.memoryTypeIndex, pool.deviceAddress, &block.mapped );
+
+      if ( !pool.linear )
+      {
+        block.freeLists.resize( maxOrder + 1 );
+        block.freeLists[maxOrder].insert( 0 );
+      }
+
+      auto& stats = _stats[static_cast<size_t>( pool.usage )];
+      ++stats.blockCount;
+      stats.blockBytes += blockSize;
+
+      return index;
+    }
+
+    /// Frees a block if it is not the last one of its pool, so a pool does not thrash at the boundary of a block.
+    void releaseBlock( Pool& pool, uint32_t index )
+    {
+      size_t liveBlocks = 0;
+      for ( const auto& block : pool.blocks )
+      {
+        if ( block.memory )
+        {
+          ++liveBlocks;
+        }
+      }
+
+      if ( liveBlocks <= 1 )
+      {
+        return;
+      }
+
+      global::device.freeMemory( pool.blocks[index].memory );
+      pool.blocks[index] = Block( );
+
+      auto& stats = _stats[static_cast<size_t>( pool.usage )];
+      --stats.blockCount;
+      stats.blockBytes -= blockSize;
+    }
+
+    void allocateLinear( Pool& pool, vk::DeviceSize size, vk::DeviceSize alignment, Allocation& allocation )
+    {
+      for ( uint32_t i = 0; i <= pool.blocks.size( ); ++i )
+      {
+        uint32_t index = i < pool.blocks.size( ) ? i : addBlock( pool );
+
+        auto& block = pool.blocks[index];
+        if ( !block.memory )
+        {
+          continue;
+        }
+
+        vk::DeviceSize offset = ( block.head + alignment - 1 ) / alignment * alignment;
+        if ( offset + size > blockSize )
+        {
+          continue;
+        }
+
+        block.head = offset + size;
+        ++block.liveCount;
+
+        allocation._block  = index;
+        allocation._offset = offset;
+        allocation._size   = size;
+        return;
+      }
+
+      VK_CORE_THROW( "Failed to allocate linear memory." );
+    }
+
+    void allocateBuddy( Pool& pool, vk::DeviceSize size, Allocation& allocation )
+    {
+      uint32_t order = 0;
+      while ( ( minBuddySize << order ) < size )
+      {
+        ++order;
+      }
+
+      for ( uint32_t i = 0; i <= pool.blocks.size( ); ++i )
+      {
+        uint32_t index = i < pool.blocks.size( ) ? i : addBlock( pool );
+
+        auto& block = pool.blocks[index];
+        if ( !block.memory )
+        {
+          continue;
+        }
+
+        // Split the smallest free buddy that is large enough.
+        uint32_t freeOrder = order;
+        while ( freeOrder <= maxOrder && block.freeLists[freeOrder].empty( ) )
+        {
+          ++freeOrder;
+        }
+
+        if ( freeOrder > maxOrder )
+        {
+          continue;
+        }
+
+        vk::DeviceSize offset = *block.freeLists[freeOrder].begin( );
+        block.freeLists[freeOrder].erase( block.freeLists[freeOrder].begin( ) );
+
+        while ( freeOrder > order )
+        {
+          --freeOrder;
+          block.freeLists[freeOrder].insert( offset + ( minBuddySize << freeOrder ) );
+        }
+
+        ++block.liveCount;
+
+        allocation._block  = index;
+        allocation._offset = offset;
+        allocation._size   = minBuddySize << order;
+        allocation._order  = order;
+        return;
+      }
+
+      VK_CORE_THROW( "Failed to allocate memory from buddy allocator." );
+    }
+
+    void free( Allocation& allocation )
+    {
+      std::lock_guard lock( _mutex );
+
+      auto& stats = _stats[static_cast<size_t>( allocation._usage )];
+      --stats.allocationCount;
+      stats.allocationBytes -= allocation._size;
+
+      if ( allocation._pool == Allocation::dedicated )
+      {
+        global::device.freeMemory( allocation._memory );
+
+        --stats.dedicatedCount;
+        stats.dedicatedBytes -= allocation._size;
+        return;
+      }
+
+      auto& pool  = _pools[allocation._pool];
+      auto& block = pool.blocks[allocation._block];
+      --block.liveCount;
+
+      if ( pool.linear )
+      {
+        if ( block.liveCount == 0 )
+        {
+          block.head = 0;
+          releaseBlock( pool, allocation._block );
+        }
+        return;
+      }
+
+      // Merge with free buddies as far as possible.
+      vk::DeviceSize offset = allocation._offset;
+      uint32_t order        = allocation._order;
+      while ( order < maxOrder )
+      {
+        vk::DeviceSize buddy = offset ^ ( minBuddySize << order );
+
+        auto it = block.freeLists[order].find( buddy );
+        if ( it == block.freeLists[order].end( ) )
+        {
+          break;
+        }
+
+        block.freeLists[order].erase( it );
+        offset = std::min( offset, buddy );
+        ++order;
+      }
+
+      block.freeLists[order].insert( offset );
+
+      if ( block.liveCount == 0 )
+      {
+        releaseBlock( pool, allocation._block );
+      }
+    }
+
+    std::vector<Pool> _pools;
+    std::array<MemoryStats, static_cast<size_t>( MemoryUsage::eCount )> _stats;
+    mutable std::mutex _mutex;
+
+    uint64_t _id = 0; ///< Set by init(), 0 if the allocator was never made the global one.
+    static inline std::atomic<uint64_t> _nextId = 1;
+  };
+
+  inline void Allocation::free( )
+  {
+    if ( !_memory )
+    {
+      return;
+    }
+
+    if ( _allocator == nullptr )
+    {
+      global::device.freeMemory( _memory );
+    }
+    else if ( _allocator == global::allocator && _allocatorId == global::allocator->_id )
+    {
+      _allocator->free( *this );
+    }
+    else if ( _pool == dedicated )
+    {
+      // The memory is not part of any block, it is freed even though its allocator is gone.
+      global::device.freeMemory( _memory );
+    }
+    else
+    {
+      // The block was freed with its allocator, the range must not be returned to another one.
+      std::cerr << "vkCore: Allocation outlived its memory allocator." << std::endl;
+    }
+
+    _allocator   = nullptr;
+    _allocatorId = 0;
+    _memory      = nullptr;
+    _mapped      = nullptr;
+  }
+
+  /// Returns the memory property flags of a memory usage.
+  inline auto getMemoryPropertyFlags( MemoryUsage usage ) -> vk::MemoryPropertyFlags
+  {
+    switch ( usage )
+    {
+      case MemoryUsage::eHostVisible:
+      case MemoryUsage::eStaging:
+        return vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+      case MemoryUsage::eReadback:
+        return vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostCached;
+      default:
+        return vk::MemoryPropertyFlagBits::eDeviceLocal;
+    }
+  }
+
+  /// Returns the memory usage that fits the given memory property flags best.
+  inline auto getMemoryUsage( vk::MemoryPropertyFlags flags ) -> MemoryUsage
+  {
+    if ( flags & vk::MemoryPropertyFlagBits::eHostVisible )
+    {
+      return ( flags & vk::MemoryPropertyFlagBits::eHostCached ) ? MemoryUsage::eReadback : MemoryUsage::eHostVisible;
+    }
+
+    return MemoryUsage::eDeviceLocal;
+  }
+
+  /// Allocates memory, from the global allocator if there is one.
+  /// @param requirements The memory requirements of the resource.
+  /// @param usage What the memory is used for. Readback memory falls back to uncached memory if there is none.
+  /// @param deviceAddress If true, the memory can be bound to buffers with a device address.
+  /// @param image If true, the memory is bound to an image with optimal tiling.
+  /// @param dedicated If true, the memory is never shared with other resources, e.g. because it is exported.
+  /// @param pNext Attachment to the memory's pNext chain, only used for dedicated allocations.
+  /// @return Returns the allocation.
+  inline auto allocateDeviceMemory( const vk::MemoryRequirements& requirements, MemoryUsage usage, bool deviceAddress = false, bool image = false, bool dedicated = false, void* pNext = nullptr ) -> Allocation
+  {
+    auto propertyFlags = getMemoryPropertyFlags( usage );
+
+    uint32_t memoryTypeIndex = 0;
+    if ( usage == MemoryUsage::eReadback )
+    {
+      try
+      {
+        memoryTypeIndex = findMemoryType( global::physicalDevice, requirements.memoryTypeBits, propertyFlags );
+      }
+      catch ( const std::runtime_error& )
+      {
+        memoryTypeIndex = findMemoryType( global::physicalDevice, requirements.memoryTypeBits, getMemoryPropertyFlags( MemoryUsage::eHostVisible ) );
+      }
+    }
+    else
+    {
+      memoryTypeIndex = findMemoryType( global::physicalDevice, requirements.memoryTypeBits, propertyFlags );
+    }
+
+    if ( global::allocator == nullptr || dedicated || pNext != nullptr )
+    {
+      return MemoryAllocator::allocateDedicated( global::allocator, requirements.size, memoryTypeIndex, usage, deviceAddress, pNext );
+    }
+
+    return global::allocator->allocate( requirements, memoryTypeIndex, usage, deviceAddress, image );
+  }
+
+  /// Allocates memory for a buffer and binds it.
+  /// @param buffer The buffer.
+  /// @param usage What the memory is used for.
+  /// @param deviceAddress If true, the buffer is used with a device address.
+  /// @return Returns the allocation.
+  inline auto allocateBufferMemory( vk::Buffer buffer, MemoryUsage usage, bool deviceAddress = false ) -> Allocation
+  {
+    auto allocation = allocateDeviceMemory( global::device.getBufferMemoryRequirements( buffer ), usage, deviceAddress );
+    global::device.bindBufferMemory( buffer, allocation.getMemory( ), allocation.getOffset( ) );
+
+    return allocation;
+  }
+
+  /// Allocates device local memory for an image with optimal tiling and binds it.
+  /// @param image The image.
+  /// @return Returns the allocation.
+  inline auto allocateImageMemory( vk::Image image ) -> Allocation
+  {
+    auto allocation = allocateDeviceMemory( global::device.getImageMemoryRequirements( image ), MemoryUsage::eDeviceLocal, false, true );
+    global::device.bindImageMemory( image, allocation.getMemory( ), allocation.getOffset( ) );
+
+    return allocation;
+  }
+
+  /// A wrapper class for Vulkan command buffer objects.
+  class CommandBuffer
+  {
+  public:
+    CommandBuffer( ) = default;
+
+    /// Call to init(vk::CommandPool, uint32_t, vk::CommandBufferUsageFlags).
+    CommandBuffer( vk::CommandPool commandPool, uint32_t count = 1, vk::CommandBufferUsageFlags usageFlags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    {
+      init( commandPool, count, usageFlags );
+    }
+
+    /// Creates the command buffers.
+    /// @param commandPool The command pool from which the command buffers will be allocated from.
+    /// @param count The amount of Vulkan command buffers to initialize (the same as the amount of images in the swapchain).
+    /// @param usageFlags Specifies what the buffer will be used for.
+    void init( vk::CommandPool commandPool, uint32_t count = 1, vk::CommandBufferUsageFlags usageFlags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    {
+      _commandPool = commandPool;
+
+      _commandBuffers.resize( count );
+
+      vk::CommandBufferAllocateInfo allocateInfo( commandPool,                      // commandPool
+                                                  vk::CommandBufferLevel::ePrimary, // level
+                                                  count );                          // commandBufferCount
+
+      _commandBuffers = global::device.allocateCommandBuffers( allocateInfo );
+      for ( const vk::CommandBuffer& commandBuffer : _commandBuffers )
+      {
+        VK_CORE_ASSERT( commandBuffer, "Failed to create command buffers." );
+      }
+
+      // Set up begin info.
+      _beginInfo.flags = usageFlags;
+    }
+
+    auto get( ) const -> const std::vector<vk::CommandBuffer> { return _commandBuffers; }
+
+    auto get( size_t index ) const -> const vk::CommandBuffer { return _commandBuffers[index]; }
+
+    void free( )
+    {
+      global::device.freeCommandBuffers( _commandPool, static_cast<uint32_t>( _commandBuffers.size( ) ), _commandBuffers.data( ) );
+    }
+
+    void reset( )
+    {
+      for ( vk::CommandBuffer& buffer : _commandBuffers )
+      {
+        buffer.reset( vk::CommandBufferResetFlagBits::eReleaseResources );
+      }
+    }
+
+    /// Used to begin the command buffer recording.
+    /// @param index An index to a command buffer to record to.
+    void begin( size_t index = 0 )
+    {
+      _commandBuffers[index].begin( _beginInfo );
+    }
+
+    /// Used to stop the command buffer recording.
+    /// @param index An index to a command buffer to stop recording.
+    void end( size_t index = 0 )
+    {
+      _commandBuffers[index].end( );
+    }
+
+    /// Submits the recorded commands to a queue.
+    /// @param queue The queue to submit to.
+    /// @param waitSemaphores A std::vector of semaphores to wait for.
+    /// @param signalSemaphores A std::vector of semaphores to signal.
+    /// @param waitDstStageMask The pipeline stage where the commands will be executed.
+    void submitToQueue( vk::Queue queue, vk::Fence fence = nullptr, const std::vector<vk::Semaphore>& waitSemaphores = { }, const std::vector<vk::Semaphore>& signalSemaphores = { }, vk::PipelineStageFlags* waitDstStageMask = { } )
+    {
+      if ( _beginInfo.flags & vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+      {
+        vk::SubmitInfo submitInfo( static_cast<uint32_t>( waitSemaphores.size( ) ),   // waitSemaphoreCount
+                                   waitSemaphores.data( ),                            // pWaitSemaphores
+                                   waitDstStageMask,                                  // pWaitDstStageMask
+                                   static_cast<uint32_t>( _commandBuffers.size( ) ),  // commandBufferCount
+                                   _commandBuffers.data( ),                           // pCommandBuffers
+                                   static_cast<uint32_t>( signalSemaphores.size( ) ), // signalSemaphoreCount
+                                   signalSemaphores.data( ) );                        // pSignalSemaphores
+
+        if ( queue.submit( 1, &submitInfo, fence ) != vk::Result::eSuccess )
+        {
+          VK_CORE_THROW( "Failed to submit" );
+        }
+
+        queue.waitIdle( );
+      }
+      else
+      {
+        VK_CORE_THROW( "Only command buffers with a usage flag containing eOneTimeSubmit should be submitted automatically" );
+      }
+    }
+
+  private:
+    std::vector<vk::CommandBuffer> _commandBuffers;
+
+    vk::CommandPool _commandPool; ///< The command pool used to allocate the command buffer from.
+    vk::CommandBufferBeginInfo _beginInfo;
+  };
+
+  // @todo move up to functions.
+  /// Transitions the image layout of any given image. The function will generate its own command buffer.
+  /// @param image The vulkan image for which you want to change the image layout.
+  /// @param oldLayout The current image layout of the given vulkan image.
+  /// @param newLayout The target image layout.
+  inline void transitionImageLayout( vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout )
+  {
+    auto barrierInfo = getImageMemoryBarrierInfo( image, oldLayout, newLayout );
+
+    CommandBuffer commandBuffer;
+    commandBuffer.init( global::graphicsCmdPool );
+    commandBuffer.begin( );
+
+    commandBuffer.get( 0 ).pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
+                                            std::get<2>( barrierInfo ), // dstStageMask
+                                            vk::DependencyFlagBits::eByRegion,
+                                            0,
+                                            nullptr,
+                                            0,
+                                            nullptr,
+                                            1,
+                                            &std::get<0>( barrierInfo ) ); // barrier
+
+    commandBuffer.end( );
+    commandBuffer.submitToQueue( global::graphicsQueue );
+  }
+
+  /// A wrapper class for a Vulkan image.
+  /// @ingroup API
+  class Image
+  {
+  public:
+    auto get( ) const -> vk::Image { return _image.get( ); }
+
+    auto getExtent( ) const -> vk::Extent3D { return _extent; }
+
+    auto getFormat( ) const -> vk::Format { return _format; }
+
+    auto getLayout( ) const -> vk::ImageLayout { return _layout; }
+
+    /// Creates the image and allocates memory for it.
+    /// @param createInfo The Vulkan image create info.
+    void init( const vk::ImageCreateInfo& createInfo )
+    {
+      _extent = createInfo.extent;
+      _format = createInfo.format;
+      _layout = createInfo.initialLayout;
+
+      _image = global::device.createImageUnique( createInfo );
+      VK_CORE_ASSERT( _image.get( ), "Failed to create image" );
+      _allocation = allocateImageMemory( _image.get( ) );
+    }
+
+    /// Used to transition this image's layout.
+    /// @param layout The target layout.
+    /// @param subresourceRange Optionally used to define a non-standard subresource range.
+    /// @note This function creates its own single-time usage command buffer.
+    void transitionToLayout( vk::ImageLayout layout, const vk::ImageSubresourceRange* subresourceRange = nullptr )
+    {
+      auto barrierInfo = getImageMemoryBarrierInfo( _image.get( ), _layout, layout, subresourceRange );
+
+      CommandBuffer commandBuffer;
+      commandBuffer.init( global::graphicsCmdPool );
+      commandBuffer.begin( );
+
+      commandBuffer.get( 0 ).pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
+                                              std::get<2>( barrierInfo ), // dstStageMask
+                                              vk::DependencyFlagBits::eByRegion,
+                                              0,
+                                              nullptr,
+                                              0,
+                                              nullptr,
+                                              1,
+                                              &std::get<0>( barrierInfo ) ); // barrier
+
+      commandBuffer.end( );
+      commandBuffer.submitToQueue( global::graphicsQueue );
+
+      _layout = layout;
+    }
+
+    /// Used to transition this image's layout using an already existing command buffer.
+    /// @param layout The target layout
+    /// @param commandBuffer The command buffer that will be used to set up a pipeline barrier.
+    /// @param subresourceRange Optionally used to define a non-standard subresource range.
+    void transitionToLayout( vk::ImageLayout layout, vk::CommandBuffer commandBuffer, const vk::ImageSubresourceRange* subresourceRange = nullptr )
+    {
+      auto barrierInfo = getImageMemoryBarrierInfo( _image.get( ), _layout, layout, subresourceRange );
+
+      commandBuffer.pipelineBarrier( std::get<1>( barrierInfo ), // srcStageMask
+                                     std::get<2>( barrierInfo ), // dstStageMask
+                                     vk::DependencyFlagBits::eByRegion,
+                                     0,
+                                     nullptr,
+                                     0,
+                                     nullptr,
+                                     1,
+                                     &std::get<0>( barrierInfo ) ); // barrier
+
+      _layout = layout;
+    }
+
+  protected:
+    Allocation _allocation; ///< Declared first, so the memory is released after the image was destroyed.
+    vk::UniqueImage _image;
+
+    vk::Extent3D _extent;
+    vk::Format _format;
+    vk::ImageLayout _layout;
+  };
+
+  /// A wrapper class for a Vulkan buffer object.
+  /// @ingroup API
+  class Buffer
+  {
+  public:
+    Buffer( ) = default;
+
+    /// Call to init(k::DeviceSize, vk::BufferUsageFlags, const std::vector<uint32_t>&, vk::MemoryPropertyFlags).
+    Buffer( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices = { }, vk::MemoryPropertyFlags memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, void* pNextMemory = nullptr, bool dedicated = false )
+    {
+      init( size, usage, queueFamilyIndices, memoryPropertyFlags, pNextMemory, dedicated );
+    }
+
+    /// Call to init(k::DeviceSize, vk::BufferUsageFlags, const std::vector<uint32_t>&, MemoryUsage, bool).
+    Buffer( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices, MemoryUsage memoryUsage, bool deviceAddress = false )
+    {
+      init( size, usage, queueFamilyIndices, memoryUsage, deviceAddress );
+    }
+
+    ~Buffer( ) = default;
+
+    /// @param buffer The target for the copy operation.
+    Buffer( const Buffer& buffer )
+    {
+      copyToBuffer( buffer );
+    }
+
+    Buffer( const Buffer&& ) = delete;
+
+    /// Call to copyToBuffer(Buffer).
+    auto operator=( const Buffer& buffer ) -> Buffer&
+    {
+      buffer.copyToBuffer( *this );
+      return *this;
+    }
+
+    auto operator=( const Buffer&& ) -> Buffer& = delete;
+
+    auto get( ) const -> const vk::Buffer { return _buffer.get( ); }
+
+    /// @note The buffer might only use a part of the memory, starting at getMemoryOffset().
+    auto getMemory( ) const -> const vk::DeviceMemory { return _allocation.getMemory( ); }
+
+    auto getMemoryOffset( ) const -> const vk::DeviceSize { return _allocation.getOffset( ); }
+
+    auto getSize( ) const -> const vk::DeviceSize { return _size; }
+
+    /// Creates the buffer and allocates memory for it.
+    /// @param queueFamilyIndices Specifies which queue family will access the buffer.
+    /// @param memoryPropertyFlags Flags for memory allocation.
+    /// @param pNextMemory Attachment to the memory's pNext chain. Anything but the device address flag results in a dedicated allocation.
+    /// @param dedicated If true, the buffer gets its own memory, e.g. because the memory is exported.
+    void init( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices = { }, vk::MemoryPropertyFlags memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, void* pNextMemory = nullptr, bool dedicated = false )
+    {
+      bool deviceAddress = false;
+      if ( pNextMemory != nullptr )
+      {
+        auto pAllocateFlags = static_cast<const vk::MemoryAllocateFlagsInfo*>( pNextMemory );
+        if ( pAllocateFlags->sType == vk::StructureType::eMemoryAllocateFlagsInfo && pAllocateFlags->pNext == nullptr && pAllocateFlags->flags == vk::MemoryAllocateFlags( vk::MemoryAllocateFlagBits::eDeviceAddress ) )
+        {
+          deviceAddress = true;
+          pNextMemory   = nullptr;
+        }
+      }
+
+      createBuffer( size, usage, queueFamilyIndices );
+
+      _allocation = allocateDeviceMemory( global::device.getBufferMemoryRequirements( _buffer.get( ) ), getMemoryUsage( memoryPropertyFlags ), deviceAddress, false, dedicated, pNextMemory );
+      global::device.bindBufferMemory( _buffer.get( ), _allocation.getMemory( ), _allocation.getOffset( ) );
+    }
+
+    /// Creates the buffer and suballocates memory for it.
+    /// @param queueFamilyIndices Specifies which queue family will access the buffer.
+    /// @param memoryUsage What the memory is used for.
+    /// @param deviceAddress If true, the buffer can be used with a device address.
+    void init( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices, MemoryUsage memoryUsage, bool deviceAddress = false )
+    {
+      createBuffer( size, usage, queueFamilyIndices );
+
+      _allocation = allocateBufferMemory( _buffer.get( ), memoryUsage, deviceAddress );
+    }
+
+    /// Copies the content of this buffer to another Buffer.
+    /// @param buffer The target for the copy operation.
+    /// @param fence A fence to wait for when submitting the local single-time-use command buffer to the command queue.
+    void copyToBuffer( const Buffer& buffer, vk::Fence fence = nullptr ) const
+    {
+      copyToBuffer( buffer.get( ), fence );
+    }
+
+    /// Copies the content of this buffer to another vk::Buffer.
+    /// @param buffer The target for the copy operation.
+    /// @param fence A fence to wait for when submitting the local single-time-use command buffer to the command queue.
+    void copyToBuffer( vk::Buffer buffer, vk::Fence fence = nullptr ) const
+    {
+      CommandBuffer commandBuffer( global::transferCmdPool );
+      commandBuffer.begin( );
+      {
+        vk::BufferCopy copyRegion( 0, 0, _size );
+        commandBuffer.get( 0 ).copyBuffer( _buffer.get( ), buffer, 1, &copyRegion ); // CMD
+      }
+      commandBuffer.end( );
+      commandBuffer.submitToQueue( global::transferQueue, fence );
+    }
+
+    /// Copies the content of this buffer to an image.
+    /// @param image The target for the copy operation.
+    void copyToImage( const Image& image ) const
+    {
+      copyToImage( image.get( ), image.getExtent( ) );
+    }
+
+    /// Copies the content of this buffer to an image.
+    /// @param image The target for the copy operation.
+    /// @param extent The target's extent.
+    void copyToImage( vk::Image image, vk::Extent3D extent ) const
+    {
+      CommandBuffer commandBuffer( global::graphicsCmdPool );
+      commandBuffer.begin( );
+      {
+        vk::BufferImageCopy region( 0,                                            // bufferOffset
+                                    0,                                            // bufferRowLength
+                                    0,                                            // bufferImageHeight
+                                    { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, // imageSubresource (aspectMask, mipLevel, baseArrayLayer, layerCount)
+                                    vk::Offset3D { 0, 0, 0 },                     // imageOffset
+                                    extent );                                     // imageExtent
+
+        commandBuffer.get( 0 ).copyBufferToImage( _buffer.get( ), image, vk::ImageLayout::eTransferDstOptimal, 1, &region ); // CMD
+      }
+      commandBuffer.end( );
+      commandBuffer.submitToQueue( global::graphicsQueue );
+    }
+
+    /// Maps the entire buffer persistently.
+    ///
+    /// The memory stays mapped until the buffer is initialized again or destroyed.
+    /// @return Returns a pointer to the mapped memory.
+    /// @note The buffer's memory must be host visible.
+    auto map( ) -> void*
+    {
+      VK_CORE_ASSERT( _allocation.getMapped( ), "Failed to map memory." );
+      return _allocation.getMapped( );
+    }
+
+    /// Used to fill the buffer with the content of a given std::vector.
+    /// @param data The data to fill the buffer with.
+    /// @param offset The data's offset within the buffer.
+    template <class T>
+    void fill( const std::vector<T>& data, vk::DeviceSize offset = 0, std::optional<vk::DeviceSize> size = { } )
+    {
+      vk::DeviceSize actualSize = data.size( ) * sizeof( data[0] );
+
+      VK_CORE_ASSERT( ( _allocation.getMapped( ) != nullptr ), "Failed to copy data to storage staging buffer." );
+      memcpy( static_cast<uint8_t*>( _allocation.getMapped( ) ) + offset, data.data( ), static_cast<uint32_t>( actualSize ) );
+    }
+
+    /// Used to fill the buffer by using a pointer and (optionally) passing the underlying memory size.
+    /// @param data The data to fill the buffer with.
+    /// @param offset The data's offset within the buffer.
+    /// @param size An optional size parameter to pass the size of data. If omitted, the size passed when calling init() will be used instead.
+    template <class T>
+    void fill( const T* data, vk::DeviceSize offset = 0, std::optional<vk::DeviceSize> size = { } )
+    {
+      vk::DeviceSize finalSize = _size;
+      if ( size.has_value( ) )
+      {
+        finalSize = size.value( );
       }
+
+      VK_CORE_ASSERT( ( _allocation.getMapped( ) != nullptr ), "Failed to copy data to storage staging buffer." );
+      memcpy( static_cast<uint8_t*>( _allocation.getMapped( ) ) + offset, data, static_cast<uint32_t>( finalSize ) );
+    }
+
+  protected:
+    void createBuffer( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices )
+    {
+      // Destroy the previous buffer before its memory is released.
+      _buffer.reset( );
+      _allocation = { };
+
+      _size = size;
+
+      vk::SharingMode sharingMode = queueFamilyIndices.size( ) > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+
+      vk::BufferCreateInfo createInfo( { },                                                 // flags
+                                       size,                                                // size
+                                       usage,                                               // usage
+                                       sharingMode,                                         // sharingMode
+                                       static_cast<uint32_t>( queueFamilyIndices.size( ) ), // queueFamilyIndexCount
+                                       queueFamilyIndices.data( ) );                        // pQueueFamilyIndices
+
+      _buffer = global::device.createBufferUnique( createInfo );
+      VK_CORE_ASSERT( _buffer.get( ), "Failed to create buffer." );
     }
 
-    /// @param buffer The target for the copy operation.
-    Buffer( const Buffer& buffer )
+    Allocation _allocation; ///< Declared first, so the memory is released after the buffer was destroyed.
+    vk::UniqueBuffer _buffer;
+
+    vk::DeviceSize _size = 0;
+  };
+
+  /// Records uploads of many resources into a single command buffer and submits them at once.
+  ///
+  /// Nothing waits for an upload on the host. Every submission signals the next value of a timeline semaphore that the
+  /// consumers of the uploaded data wait for, see getSemaphore() and getValue(). Staging buffers and resources that have
+  /// to outlive the recorded commands are kept alive until their submission finished.
+  /// @note Not thread-safe, record from one thread only.
+  /// @ingroup API
+  class UploadBatch
+  {
+  public:
+    UploadBatch( ) = default;
+
+    UploadBatch( const UploadBatch& ) = delete;
+
+    UploadBatch( UploadBatch&& ) = delete;
+
+    auto operator=( const UploadBatch& ) -> UploadBatch& = delete;
+
+    auto operator=( UploadBatch&& ) -> UploadBatch& = delete;
+
+    ~UploadBatch( )
     {
-      copyToBuffer( buffer );
+      destroy( );
     }
 
-    Buffer( const Buffer&& ) = delete;
+    /// @param queue The queue the uploads are submitted to.
+    /// @param commandPool The command pool to allocate command buffers from, it must belong to the queue's family.
+    /// @param queueFamilyIndex The queue's family.
+    void init( vk::Queue queue, vk::CommandPool commandPool, uint32_t queueFamilyIndex )
+    {
+      destroy( );
 
-    /// Call to copyToBuffer(Buffer).
-    auto operator=( const Buffer& buffer ) -> Buffer&
+      _queue            = queue;
+      _commandPool      = commandPool;
+      _queueFamilyIndex = queueFamilyIndex;
+      _value            = 0;
+
+      vk::SemaphoreTypeCreateInfo timelineCreateInfo( vk::SemaphoreType::eTimeline, 0 );
+
+      vk::SemaphoreCreateInfo createInfo;
+      createInfo.pNext = &timelineCreateInfo;
+
+      _semaphore = global::device.createSemaphoreUnique( createInfo );
+      VK_CORE_ASSERT( _semaphore.get( ), "Failed to create upload semaphore." );
+    }
+
+    /// Waits for all submissions and frees their resources.
+    void destroy( )
     {
-      buffer.copyToBuffer( *this );
-      return *this;
+      if ( !_semaphore )
+      {
+        return;
+      }
+
+      wait( );
+
+      _resources.clear( );
+      _semaphore.reset( );
     }
 
-    auto operator=( const Buffer&& ) -> Buffer& = delete;
+    /// @return Returns the command buffer of the current batch. Recording starts with the first call.
+    auto getCommandBuffer( ) -> vk::CommandBuffer
+    {
+      if ( !_recording )
+      {
+        collect( );
 
-    auto get( ) const -> const vk::Buffer { return _buffer.get( ); }
+        vk::CommandBufferAllocateInfo allocateInfo( _commandPool, vk::CommandBufferLevel::ePrimary, 1 );
+        _commandBuffer = global::device.allocateCommandBuffers( allocateInfo ).front( );
+        _commandBuffer.begin( vk::CommandBufferBeginInfo( vk::CommandBufferUsageFlagBits::eOneTimeSubmit ) );
 
-    auto getMemory( ) const -> const vk::DeviceMemory { return _memory.get( ); }
+        _recording = true;
 
-    auto getSize( ) const -> const vk::DeviceSize { return _size; }
+        // Orders this batch after the transfers of previous batches on the same queue.
+        barrier( );
+      }
 
-    /// Creates the buffer and allocates memory for it.
-    /// @param queueFamilyIndices Specifies which queue family will access the buffer.
-    /// @param memoryPropertyFlags Flags for memory allocation.
-    /// @param pNextMemory Attachment to the memory's pNext chain.
-    void init( vk::DeviceSize size, vk::BufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices = { }, vk::MemoryPropertyFlags memoryPropertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, void* pNextMemory = nullptr )
-    {
-        if ( _memory && _mapped )
-            global::device.unmapMemory( _memory.get( ) );
+      return _commandBuffer;
+    }
 
-      _mapped = false;
-      _size   = size;
+    auto getSemaphore( ) const -> vk::Semaphore { return _semaphore.get( ); }
 
-      vk::SharingMode sharingMode = queueFamilyIndices.size( ) > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+    /// @return Returns the value the semaphore reaches once the last submitted batch finished.
+    auto getValue( ) const -> uint64_t { return _value; }
 
-      vk::BufferCreateInfo createInfo( { },                                                 // flags
-                                       size,                                                // size
-                                       usage,                                               // usage
-                                       sharingMode,                                         // sharingMode
-                                       static_cast<uint32_t>( queueFamilyIndices.size( ) ), // queueFamilyIndexCount
-                                       queueFamilyIndices.data( ) );                        // pQueueFamilyIndices
+    auto getQueueFamilyIndex( ) const -> uint32_t { return _queueFamilyIndex; }
 
-      _buffer = global::device.createBufferUnique( createInfo );
-      VK_CORE_ASSERT( _buffer.get( ), "Failed to create buffer." );
+    /// @return Returns true if nothing was recorded since the last submission.
+    auto empty( ) const -> bool { return !_recording; }
 
-      _memory = allocateMemoryUnique( _buffer, memoryPropertyFlags, pNextMemory );
-      global::device.bindBufferMemory( _buffer.get( ), _memory.get( ), 0 );
+    /// Keeps a resource alive until the current batch finished.
+    void keepAlive( std::shared_ptr<void> resource )
+    {
+      _resources.emplace_back( _value + 1, std::move( resource ) );
     }
 
-    /// Copies the content of this buffer to another Buffer.
-    /// @param buffer The target for the copy operation.
-    /// @param fence A fence to wait for when submitting the local single-time-use command buffer to the command queue.
-    void copyToBuffer( const Buffer& buffer, vk::Fence fence = nullptr ) const
+    /// Copies data to a buffer through a temporary staging buffer.
+    /// @param data The data to copy.
+    /// @param size The size of the data in bytes.
+    /// @param buffer The target buffer.
+    /// @param offset The offset in the target buffer.
+    void upload( const void* data, vk::DeviceSize size, vk::Buffer buffer, vk::DeviceSize offset = 0 )
     {
-      copyToBuffer( buffer.get( ), fence );
+      if ( size == 0 )
+      {
+        return;
+      }
+
+      auto stagingBuffer = std::make_shared<Buffer>( size, vk::BufferUsageFlagBits::eTransferSrc, std::vector<uint32_t> { _queueFamilyIndex }, MemoryUsage::eStaging );
+      memcpy( stagingBuffer->map( ), data, size );
+
+      copyBuffer( stagingBuffer->get( ), buffer, { vk::BufferCopy( 0, offset, size ) } );
+      keepAlive( std::move( stagingBuffer ) );
     }
 
-    /// Copies the content of this buffer to another vk::Buffer.
-    /// @param buffer The target for the copy operation.
-    /// @param fence A fence to wait for when submitting the local single-time-use command buffer to the command queue.
-    void copyToBuffer( vk::Buffer buffer, vk::Fence fence = nullptr ) const
+    /// Copies regions between buffers.
+    void copyBuffer( vk::Buffer source, vk::Buffer destination, const std::vector<vk::BufferCopy>& regions )
     {
-      CommandBuffer commandBuffer( global::transferCmdPool );
-      commandBuffer.begin( );
+      if ( !regions.empty( ) )
       {
-        vk::BufferCopy copyRegion( 0, 0, _size );
-        commandBuffer.get( 0 ).copyBuffer( _buffer.get( ), buffer, 1, &copyRegion ); // CMD
+        getCommandBuffer( ).copyBuffer( source, destination, regions );
       }
-      commandBuffer.end( );
-      commandBuffer.submitToQueue( global::transferQueue, fence );
     }
 
-    /// Copies the content of this buffer to an image.
-    /// @param image The target for the copy operation.
-    void copyToImage( const Image& image ) const
+    /// Makes all transfer writes recorded so far visible to the following transfers of this batch.
+    void barrier( )
     {
-      copyToImage( image.get( ), image.getExtent( ) );
+      vk::MemoryBarrier memoryBarrier( vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite );
+      getCommandBuffer( ).pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, { }, memoryBarrier, nullptr, nullptr );
     }
 
-    /// Copies the content of this buffer to an image.
-    /// @param image The target for the copy operation.
-    /// @param extent The target's extent.
-    void copyToImage( vk::Image image, vk::Extent3D extent ) const
+    /// Transitions an image's layout.
+    ///
+    /// Stages the queue might not support are replaced by all commands, the consumers on other queues are synchronized
+    /// by the semaphore.
+    /// @param image The image.
+    /// @param oldLayout The current layout.
+    /// @param newLayout The target layout.
+    /// @param subresourceRange Optionally used to define a non-standard subresource range.
+    void transitionImageLayout( vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, const vk::ImageSubresourceRange* subresourceRange = nullptr )
     {
-      CommandBuffer commandBuffer( global::graphicsCmdPool );
-      commandBuffer.begin( );
+      auto [barrier, srcStageMask, dstStageMask] = getImageMemoryBarrierInfo( image, oldLayout, newLayout, subresourceRange );
+
+      const vk::PipelineStageFlags transferStages = vk::PipelineStageFlagBits::eTopOfPipe | vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eBottomOfPipe;
+      if ( srcStageMask & ~transferStages )
       {
-        vk::BufferImageCopy region( 0,                                            // bufferOffset
-                                    0,                                            // bufferRowLength
-                                    0,                                            // bufferImageHeight
-                                    { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, // imageSubresource (aspectMask, mipLevel, baseArrayLayer, layerCount)
-                                    vk::Offset3D { 0, 0, 0 },                     // imageOffset
-                                    extent );                                     // imageExtent
+        srcStageMask = vk::PipelineStageFlagBits::eAllCommands;
+      }
 
-        commandBuffer.get( 0 ).copyBufferToImage( _buffer.get( ), image, vk::ImageLayout::eTransferDstOptimal, 1, &region ); // CMD
+      if ( dstStageMask & ~transferStages )
+      {
+        dstStageMask = vk::PipelineStageFlagBits::eAllCommands;
+        barrier.dstAccessMask = { };
       }
-      commandBuffer.end( );
-      commandBuffer.submitToQueue( global::graphicsQueue );
+
+      getCommandBuffer( ).pipelineBarrier( srcStageMask, dstStageMask, vk::DependencyFlagBits::eByRegion, nullptr, nullptr, barrier );
     }
 
-    /// Used to fill the buffer with the content of a given std::vector.
-    /// @param data The data to fill the buffer with.
-    /// @param offset The data's offset within the buffer.
-    template <class T>
-    void fill( const std::vector<T>& data, vk::DeviceSize offset = 0, std::optional<vk::DeviceSize> size = { } )
+    /// Hands a buffer written by this batch over to another queue family.
+    ///
+    /// Records the release half of the ownership transfer, the acquire half is recorded by recordAcquireBarriers() once
+    /// the batch was submitted. Nothing is recorded if the family is the batch's own, the semaphore already makes the
+    /// writes visible.
+    /// @param buffer The buffer, it must have been created with exclusive sharing.
+    /// @param queueFamilyIndex The family that reads the buffer.
+    void releaseBuffer( vk::Buffer buffer, uint32_t queueFamilyIndex )
     {
-      vk::DeviceSize actualSize = data.size( ) * sizeof( data[0] );
+      if ( queueFamilyIndex == _queueFamilyIndex )
+      {
+        return;
+      }
+
+      vk::BufferMemoryBarrier barrier( vk::AccessFlagBits::eTransferWrite, // srcAccessMask
+                                       { },                                // dstAccessMask
+                                       _queueFamilyIndex,                  // srcQueueFamilyIndex
+                                       queueFamilyIndex,                   // dstQueueFamilyIndex
+                                       buffer,                             // buffer
+                                       0,                                  // offset
+                                       VK_WHOLE_SIZE );                    // size
+
+      getCommandBuffer( ).pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, { }, nullptr, barrier, nullptr );
+
+      barrier.srcAccessMask = { };
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      _bufferAcquires.emplace_back( _value + 1, barrier );
+    }
 
-      // Only call mapMemory once or every time the buffer has been initialized again.
-      if ( !_mapped )
+    /// Hands an image written by this batch over to another queue family and transitions its layout.
+    ///
+    /// Like releaseBuffer(), if the family is the batch's own only the layout is transitioned.
+    /// @param image The image, it must have been created with exclusive sharing.
+    /// @param oldLayout The current layout.
+    /// @param newLayout The layout the other family uses the image in.
+    /// @param queueFamilyIndex The family that reads the image.
+    void releaseImage( vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t queueFamilyIndex )
+    {
+      if ( queueFamilyIndex == _queueFamilyIndex )
       {
-        _mapped = true;
+        transitionImageLayout( image, oldLayout, newLayout );
+        return;
+      }
+
+      auto barrier                = std::get<0>( getImageMemoryBarrierInfo( image, oldLayout, newLayout ) );
+      barrier.dstAccessMask       = { };
+      barrier.srcQueueFamilyIndex = _queueFamilyIndex;
+      barrier.dstQueueFamilyIndex = queueFamilyIndex;
+
+      getCommandBuffer( ).pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, { }, nullptr, nullptr, barrier );
+
+      barrier.srcAccessMask = { };
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      _imageAcquires.emplace_back( _value + 1, barrier );
+    }
+
+    /// Records the acquire half of the ownership transfers of all submitted batches to a command buffer.
+    ///
+    /// The command buffer has to be submitted to a queue of the family the resources were released to, waiting for the
+    /// batch's semaphore. Acquires of batches that were not submitted yet stay pending.
+    /// @param commandBuffer The command buffer to record the barriers to.
+    /// @param queueFamilyIndex The family of the queue the command buffer is submitted to.
+    void recordAcquireBarriers( vk::CommandBuffer commandBuffer, uint32_t queueFamilyIndex )
+    {
+      std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+      std::vector<vk::ImageMemoryBarrier> imageBarriers;
 
-        if ( global::device.mapMemory( _memory.get( ), offset, actualSize, { }, &_ptrToData ) != vk::Result::eSuccess )
+      auto take = [&]( auto& acquires, auto& barriers ) {
+        for ( auto it = acquires.begin( ); it != acquires.end( ); )
         {
-          VK_CORE_THROW( "Failed to map memory." );
+          if ( it->first <= _value && it->second.dstQueueFamilyIndex == queueFamilyIndex )
+          {
+            barriers.push_back( it->second );
+            it = acquires.erase( it );
+          }
+          else
+          {
+            ++it;
+          }
         }
+      };
+
+      take( _bufferAcquires, bufferBarriers );
+      take( _imageAcquires, imageBarriers );
+
+      if ( bufferBarriers.empty( ) && imageBarriers.empty( ) )
+      {
+        return;
       }
 
-      VK_CORE_ASSERT( ( _ptrToData != nullptr ), "Failed to copy data to storage staging buffer." );
-      memcpy( _ptrToData, data.data( ), static_cast<uint32_t>( actualSize ) );
+      commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, { }, nullptr, bufferBarriers, imageBarriers );
     }
 
-    /// Used to fill the buffer by using a pointer and (optionally) passing the underlying memory size.
-    /// @param data The data to fill the buffer with.
-    /// @param offset The data's offset within the buffer.
-    /// @param size An optional size parameter to pass the size of data. If omitted, the size passed when calling init() will be used instead.
-    template <class T>
-    void fill( const T* data, vk::DeviceSize offset = 0, std::optional<vk::DeviceSize> size = { } )
+    /// Submits everything recorded since the last submission.
+    /// @return Returns the semaphore value that is signaled once the batch finished.
+    auto submit( ) -> uint64_t
     {
-      vk::DeviceSize finalSize = _size;
-      if ( size.has_value( ) )
+      if ( !_recording )
       {
-        finalSize = size.value( );
+        return _value;
+      }
+
+      _commandBuffer.end( );
+      _recording = false;
+
+      ++_value;
+
+      vk::TimelineSemaphoreSubmitInfo timelineInfo( 0, nullptr, 1, &_value );
+
+      auto semaphore = _semaphore.get( );
+      vk::SubmitInfo submitInfo( 0, nullptr, nullptr, 1, &_commandBuffer, 1, &semaphore );
+      submitInfo.pNext = &timelineInfo;
+
+      if ( _queue.submit( 1, &submitInfo, nullptr ) != vk::Result::eSuccess )
+      {
+        VK_CORE_THROW( "Failed to submit upload batch." );
       }
 
-      // Only call mapMemory once or every time the buffer has been initialized again.
-      if ( !_mapped )
+      _submitted.emplace_back( _value, _commandBuffer );
+      _commandBuffer = nullptr;
+
+      return _value;
+    }
+
+    /// Submits pending uploads and waits on the host until all of them finished.
+    void wait( )
+    {
+      submit( );
+
+      if ( _value == 0 )
       {
-        _mapped = true;
+        return;
+      }
 
-        if ( global::device.mapMemory( _memory.get( ), offset, finalSize, { }, &_ptrToData ) != vk::Result::eSuccess )
-        {
-          VK_CORE_THROW( "Failed to map memory." );
-        }
+      auto semaphore = _semaphore.get( );
+      vk::SemaphoreWaitInfo waitInfo( { }, 1, &semaphore, &_value );
+      if ( global::device.waitSemaphores( waitInfo, UINT64_MAX ) != vk::Result::eSuccess )
+      {
+        VK_CORE_THROW( "Failed to wait for upload batch." );
       }
 
-      VK_CORE_ASSERT( ( _ptrToData != nullptr ), "Failed to copy data to storage staging buffer." );
-      memcpy( _ptrToData, data, static_cast<uint32_t>( _size ) );
-      // @todo unmap memory in destructor
+      collect( );
     }
 
-  protected:
-    vk::UniqueBuffer _buffer;
-    vk::UniqueDeviceMemory _memory;
+  private:
+    /// Frees the command buffers and resources of finished submissions.
+    void collect( )
+    {
+      if ( !_semaphore )
+      {
+        return;
+      }
 
-    vk::DeviceSize _size = 0;
+      uint64_t finished = global::device.getSemaphoreCounterValue( _semaphore.get( ) );
+
+      while ( !_submitted.empty( ) && _submitted.front( ).first <= finished )
+      {
+        global::device.freeCommandBuffers( _commandPool, _submitted.front( ).second );
+        _submitted.pop_front( );
+      }
+
+      while ( !_resources.empty( ) && _resources.front( ).first <= finished )
+      {
+        _resources.pop_front( );
+      }
+    }
 
-    void* _ptrToData = nullptr;
-    bool _mapped     = false;
+    vk::Queue _queue             = nullptr;
+    vk::CommandPool _commandPool = nullptr;
+    uint32_t _queueFamilyIndex   = 0;
+
+    vk::UniqueSemaphore _semaphore;
+    uint64_t _value = 0; ///< The value signaled by the last submission.
+
+    vk::CommandBuffer _commandBuffer = nullptr;
+    bool _recording                  = false;
+
+    std::deque<std::pair<uint64_t, vk::CommandBuffer>> _submitted;    ///< Command buffers by the value their submission signals.
+    std::deque<std::pair<uint64_t, std::shared_ptr<void>>> _resources; ///< Resources by the value they are released at.
+
+    std::deque<std::pair<uint64_t, vk::BufferMemoryBarrier>> _bufferAcquires; ///< Pending acquires by the value of their release.
+    std::deque<std::pair<uint64_t, vk::ImageMemoryBarrier>> _imageAcquires;
   };
 
   /// A specialization class for creating textures using the sbt_image header.
@@ -1778,7 +2849,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       Buffer stagingBuffer( size,
                             vk::BufferUsageFlagBits::eTransferSrc,
                             { global::graphicsFamilyIndex },
-                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                            MemoryUsage::eStaging );
 
       stagingBuffer.fill<stbi_uc>( pixels );
 
@@ -1816,7 +2887,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       Buffer stagingBuffer( textureSize,
                             vk::BufferUsageFlagBits::eTransferSrc,
                             { global::graphicsFamilyIndex },
-                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                            MemoryUsage::eStaging );
 
       stagingBuffer.fill<ktx_uint8_t>( textureData );
 
@@ -1833,6 +2904,70 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       */
     }
 
+    /// Creates the texture from RGBA8 pixels in a staging buffer and records the upload to a command buffer.
+    /// @param path The path the pixels were loaded from.
+    /// @param extent The texture's extent.
+    /// @param stagingBuffer The buffer holding the pixels.
+    /// @param offset The offset of the pixels in the staging buffer.
+    /// @param commandBuffer The command buffer to record the upload to.
+    /// @note The staging buffer has to stay alive until the command buffer was executed.
+    void init( std::string_view path, vk::Extent3D extent, vk::Buffer stagingBuffer, vk::DeviceSize offset, vk::CommandBuffer commandBuffer )
+    {
+      _path = path;
+
+      auto imageCreateInfo = getImageCreateInfo( extent );
+      Image::init( imageCreateInfo );
+
+      transitionToLayout( vk::ImageLayout::eTransferDstOptimal, commandBuffer );
+
+      vk::BufferImageCopy region( offset,                                       // bufferOffset
+                                  0,                                            // bufferRowLength
+                                  0,                                            // bufferImageHeight
+                                  { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, // imageSubresource (aspectMask, mipLevel, baseArrayLayer, layerCount)
+                                  vk::Offset3D { 0, 0, 0 },                     // imageOffset
+                                  extent );                                     // imageExtent
+
+      commandBuffer.copyBufferToImage( stagingBuffer, _image.get( ), vk::ImageLayout::eTransferDstOptimal, 1, &region );
+
+      transitionToLayout( vk::ImageLayout::eShaderReadOnlyOptimal, commandBuffer );
+
+      _imageView = initImageViewUnique( getImageViewCreateInfo( _image.get( ), _format ) );
+    }
+
+    /// Creates the texture from RGBA8 pixels in a staging buffer and records the upload to an upload batch.
+    ///
+    /// The image is owned by the graphics queue family, if the batch's queue belongs to another family the ownership
+    /// is transferred, see UploadBatch::releaseImage().
+    /// @param path The path the pixels were loaded from.
+    /// @param extent The texture's extent.
+    /// @param stagingBuffer The buffer holding the pixels.
+    /// @param offset The offset of the pixels in the staging buffer.
+    /// @param batch The batch to record the upload to.
+    /// @note The staging buffer has to stay alive until the batch finished, see UploadBatch::keepAlive().
+    void init( std::string_view path, vk::Extent3D extent, vk::Buffer stagingBuffer, vk::DeviceSize offset, UploadBatch& batch )
+    {
+      _path = path;
+
+      auto imageCreateInfo = getImageCreateInfo( extent );
+      Image::init( imageCreateInfo );
+
+      batch.transitionImageLayout( _image.get( ), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal );
+
+      vk::BufferImageCopy region( offset,                                       // bufferOffset
+                                  0,                                            // bufferRowLength
+                                  0,                                            // bufferImageHeight
+                                  { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, // imageSubresource (aspectMask, mipLevel, baseArrayLayer, layerCount)
+                                  vk::Offset3D { 0, 0, 0 },                     // imageOffset
+                                  extent );                                     // imageExtent
+
+      batch.getCommandBuffer( ).copyBufferToImage( stagingBuffer, _image.get( ), vk::ImageLayout::eTransferDstOptimal, 1, &region );
+
+      batch.releaseImage( _image.get( ), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, global::graphicsFamilyIndex );
+      _layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+      _imageView = initImageViewUnique( getImageViewCreateInfo( _image.get( ), _format ) );
+    }
+
   private:
     std::string _path; ///< The relative path to the texture file.
 
@@ -1880,7 +3015,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       Buffer stagingBuffer( textureSize,
                             vk::BufferUsageFlagBits::eTransferSrc,
                             { global::graphicsFamilyIndex },
-                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                            MemoryUsage::eStaging );
 
       vk::MemoryRequirements reqs = global::device.getBufferMemoryRequirements( stagingBuffer.get( ) );
 
@@ -1986,7 +3121,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       Buffer stagingBuffer( textureSize,
                             vk::BufferUsageFlagBits::eTransferSrc,
                             { global::graphicsFamilyIndex },
-                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                            MemoryUsage::eStaging );
 
       vk::MemoryRequirements reqs = global::device.getBufferMemoryRequirements( stagingBuffer.get( ) );
 
@@ -2089,6 +3224,44 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
 
     auto getDescriptorInfos( ) const -> const std::vector<vk::DescriptorBufferInfo>& { return _bufferInfos; }
 
+    /// @return Returns true if the buffer has no copies and no staging buffer.
+    auto isImmutable( ) const -> bool { return _stagingBuffers.empty( ); }
+
+    /// Creates a single device local storage buffer without a persistent staging buffer.
+    ///
+    /// Meant for data that rarely changes, every upload goes through a temporary staging buffer that is released as
+    /// soon as the copy finished.
+    /// @param data The data to fill the storage buffer with.
+    /// @param deviceAddressVisible If true, the buffer will be device visible.
+    void initImmutable( const std::vector<T>& data, bool deviceAddressVisible = false, const std::vector<vk::BufferUsageFlags>& additionalBufferUsageFlags = { } )
+    {
+      createImmutable( data.size( ), global::transferFamilyIndex, deviceAddressVisible, additionalBufferUsageFlags );
+      upload( data );
+    }
+
+    /// Creates a single device local storage buffer without a persistent staging buffer and records the upload of its
+    /// data to an upload batch.
+    /// @param data The data to fill the storage buffer with.
+    /// @param batch The batch to record the upload to.
+    /// @param deviceAddressVisible If true, the buffer will be device visible.
+    void initImmutable( const std::vector<T>& data, UploadBatch& batch, bool deviceAddressVisible = false, const std::vector<vk::BufferUsageFlags>& additionalBufferUsageFlags = { } )
+    {
+      createImmutable( data.size( ), global::transferFamilyIndex, deviceAddressVisible, additionalBufferUsageFlags );
+      upload( data, batch );
+    }
+
+    /// Creates a single device local storage buffer without any staging buffer and leaves its content undefined.
+    ///
+    /// Meant for buffers that are written by command buffers of a single queue family, e.g. with copies from staging
+    /// buffers the caller owns. The upload functions must not be used on such a buffer.
+    /// @param count The amount of elements the buffer holds.
+    /// @param queueFamilyIndex The queue family that exclusively owns the buffer.
+    /// @param deviceAddressVisible If true, the buffer will be device visible.
+    void initDeviceLocal( size_t count, uint32_t queueFamilyIndex, bool deviceAddressVisible = false, const std::vector<vk::BufferUsageFlags>& additionalBufferUsageFlags = { } )
+    {
+      createImmutable( count, queueFamilyIndex, deviceAddressVisible, additionalBufferUsageFlags );
+    }
+
     /// Creates a storage buffer and n copies.
     /// @param data The data to fill the storage buffer(s) with.
     /// @param copies The amount of copies to make.
@@ -2101,6 +3274,8 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
 
       _maxSize = sizeof( data[0] ) * data.size( );
 
+      VK_CORE_ASSERT( copies > 0, "A storage buffer needs at least one copy, use initImmutable() for a buffer without staging." );
+
       _stagingBuffers.resize( copies );
       _storageBuffers.resize( copies );
       _bufferInfos.resize( copies );
@@ -2154,6 +3329,15 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
     {
       VK_CORE_ASSERT( _maxSize >= sizeof( data[0] ) * data.size( ), "Exceeded maximum storage buffer size." );
 
+      if ( isImmutable( ) )
+      {
+        // The copy is synchronous, the staging memory goes back to the allocator right after it.
+        Buffer stagingBuffer( _maxSize, vk::BufferUsageFlagBits::eTransferSrc, { global::transferFamilyIndex }, MemoryUsage::eStaging );
+        stagingBuffer.fill<T>( data );
+        stagingBuffer.copyToBuffer( _storageBuffers[0].get( ) );
+        return;
+      }
+
       if ( !index.has_value( ) )
       {
         for ( size_t i = 0; i < _storageBuffers.size( ); ++i )
@@ -2169,7 +3353,57 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
       }
     }
 
+    /// Records the upload of data to the buffer to an upload batch.
+    ///
+    /// Immutable buffers are written through a staging buffer owned by the batch, all others through their own staging
+    /// buffers. Afterwards the buffers are released to the graphics queue family, see UploadBatch::releaseBuffer().
+    /// @param data The data to upload.
+    /// @param batch The batch to record the copies to.
+    void upload( const std::vector<T>& data, UploadBatch& batch )
+    {
+      VK_CORE_ASSERT( _maxSize >= sizeof( data[0] ) * data.size( ), "Exceeded maximum storage buffer size." );
+
+      if ( isImmutable( ) )
+      {
+        batch.upload( data.data( ), sizeof( data[0] ) * data.size( ), _storageBuffers[0].get( ) );
+        batch.releaseBuffer( _storageBuffers[0].get( ), global::graphicsFamilyIndex );
+        return;
+      }
+
+      for ( size_t i = 0; i < _storageBuffers.size( ); ++i )
+      {
+        _stagingBuffers[i].fill<T>( data );
+        batch.copyBuffer( _stagingBuffers[i].get( ), _storageBuffers[i].get( ), { vk::BufferCopy( 0, 0, _maxSize ) } );
+        batch.releaseBuffer( _storageBuffers[i].get( ), global::graphicsFamilyIndex );
+      }
+    }
+
   private:
+    void createImmutable( size_t count, uint32_t queueFamilyIndex, bool deviceAddressVisible, const std::vector<vk::BufferUsageFlags>& additionalBufferUsageFlags )
+    {
+      _count   = static_cast<uint32_t>( count );
+      _maxSize = sizeof( T ) * count;
+
+      _stagingBuffers.clear( );
+      _storageBuffers.resize( 1 );
+      _bufferInfos.resize( 1 );
+
+      vk::BufferUsageFlags bufferUsageFlags = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer;
+      if ( deviceAddressVisible )
+        bufferUsageFlags |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
+
+      for ( auto flag : additionalBufferUsageFlags )
+        bufferUsageFlags |= flag;
+
+      _storageBuffers[0].init( _maxSize,                  // size
+                               bufferUsageFlags,          // usage
+                               { queueFamilyIndex },      // queueFamilyIndices
+                               MemoryUsage::eDeviceLocal, // memoryUsage
+                               deviceAddressVisible );    // deviceAddress
+
+      _bufferInfos[0] = vk::DescriptorBufferInfo( _storageBuffers[0].get( ), 0, VK_WHOLE_SIZE );
+    }
+
     std::vector<Buffer> _stagingBuffers; ///< Holds the staging buffer and all its copies.
     std::vector<Buffer> _storageBuffers; ///< Holds the storage buffer and all its copies.
 
@@ -3003,6 +4237,27 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
 
     // Additional Utilities by Jet
 
+    /// @return Returns the size of a texel in bytes, for the formats used by frames and render targets.
+    inline uint32_t getFormatSize(vk::Format format) {
+        switch (format) {
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+            case vk::Format::eB8G8R8A8Unorm:
+            case vk::Format::eB8G8R8A8Srgb:
+            case vk::Format::eR32Sfloat:
+            case vk::Format::eR32Uint:
+                return 4;
+            case vk::Format::eR32G32Sfloat:
+            case vk::Format::eR32G32Uint:
+                return 8;
+            case vk::Format::eR32G32B32A32Sfloat:
+            case vk::Format::eR32G32B32A32Uint:
+                return 16;
+            default:
+                throw std::runtime_error("unsupported format.");
+        }
+    }
+
     ///
     /// @param
     inline void download(vk::Image _image, vk::Format _format, vk::ImageLayout _layout, vk::Extent3D _extent,
@@ -3081,7 +4336,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
         Buffer stagingBuffer(size,
                              vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
                              { global::transferFamilyIndex },  // TODO: check this
-                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                             MemoryUsage::eReadback );
         CommandBuffer commandBuffer(global::transferCmdPool);
         commandBuffer.begin();
 
@@ -3103,11 +4358,7 @@ inline vk::PipelineStageFlagBits pipelineStageForLayout(vk::ImageLayout layout)
         commandBuffer.end();
         commandBuffer.submitToQueue(global::transferQueue, {}, waitSemaphores);  // wait idle inside
 
-        void *mapped;
-        auto result = vkCore::global::device.mapMemory(
-                stagingBuffer.getMemory(), 0, stagingBuffer.getSize(), {}, &mapped);
-        std::memcpy(data, mapped, size);
-        vkCore::global::device.unmapMemory(stagingBuffer.getMemory());
+        std::memcpy(data, stagingBuffer.map(), size);
     }
 
     inline void download(vk::Image _image, vk::Format _format, vk::ImageLayout _layout, vk::Extent3D _extent,
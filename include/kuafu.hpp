@@ -42,10 +42,36 @@ public:
 
     void run();
 
+    /// Renders all given cameras with a single trace (offscreen only).
+    ///
+    /// The scene and acceleration structures are updated once for all cameras.
+    /// Use downloadLatestFrame() to retrieve each camera's image afterwards.
+    /// @param cameras The cameras to render, at most global::maxCameras.
+    void run(const std::vector<Camera*> &cameras);
+
     [[nodiscard]] bool isRunning() const;
 
     [[nodiscard]] std::vector<uint8_t> downloadLatestFrame(Camera* cam);
 
+    /// Asynchronously downloads the next frame rendered by the given camera.
+    ///
+    /// Unlike downloadLatestFrame() this neither idles the device nor allocates staging resources,
+    /// the copy is part of the frame and the following frames can be rendered while it is in flight.
+    /// @param cam The camera to download, ignored when using the viewer.
+    /// @param callback Invoked by a later run() once the frame is available (optional).
+    /// @return Returns a handle to poll or wait for the frame.
+    std::shared_ptr<Readback> downloadNextFrameAsync(Camera* cam, Readback::Callback callback = nullptr);
+
+    /// Asynchronously downloads channels of the next frame rendered by the given camera, e.g. its depth and segmentation.
+    ///
+    /// All channels are copied by the same frame to a single buffer, see downloadNextFrameAsync(Camera*, Readback::Callback).
+    /// @param cam The camera to download, ignored when using the viewer.
+    /// @param channels The kuafu::Readback::Channel bits to download.
+    /// @param callback Invoked by a later run() once the channels are available (optional).
+    /// @return Returns a handle to poll or wait for the channels.
+    std::shared_ptr<Readback> downloadNextFrameAsync(Camera* cam, Readback::Channels channels,
+                                                     Readback::Callback callback = nullptr);
+
     void setWindow(std::shared_ptr<Window> other);
 
     void setWindow(int width, int height, const char *title = "App", uint32_t flags = 0);
@@ -56,6 +82,10 @@ public:
 
     inline auto& getConfig() { return *mContext.pConfig; }
 
+    /// @return Returns the trace times and TLAS statistics of the most recently rendered frames, oldest first.
+    /// @note Timings are 0 if the device does not support timestamps on the graphics queue.
+    inline const auto& getFrameTelemetry() const { return mContext.mRayTracer.getTelemetry(); }
+
     inline Scene* getScene() { return mContext.mCurrentScene; }
 
     inline void setScene(Scene* scene) {
@@ -12,6 +12,7 @@
 
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/hash.hpp>
 #include <glm/glm.hpp>
@@ -26,6 +27,7 @@
 #include <any>
 #include <array>
 #include <charconv>
+#include <deque>
 #include <filesystem>
 #include <forward_list>
 #include <fstream>
@@ -37,6 +39,7 @@
 #include <optional>
 #include <random>
 #include <set>
+#include <span>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
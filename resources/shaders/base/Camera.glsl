@@ -1,4 +1,6 @@
-layout( binding = 0, set = 1 ) readonly uniform CameraProperties
+layout ( constant_id = 2 ) const uint MAX_CAMERAS = 16;
+
+struct Camera
 {
   mat4 view;
   mat4 proj;
@@ -7,7 +9,11 @@ layout( binding = 0, set = 1 ) readonly uniform CameraProperties
   vec4 position;
   vec4 viewingDirection;
 
-  vec4 padding1;
-  vec4 padding2;
-}
-cam;
+  ivec4 info;         // width + height + frameCount + padding
+  vec4 padding;
+};
+
+layout( binding = 0, set = 1 ) readonly uniform CameraProperties
+{
+  Camera cams[MAX_CAMERAS];
+};
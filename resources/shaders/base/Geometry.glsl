@@ -18,6 +18,11 @@ struct Material
   uint padding1;
 };
 
+// Buffer layout flags of a geometry, see kuafu::GeometryLayout.
+const uint GEOMETRY_INDEX_16 = 1;  // two 16 bit indices per word
+const uint GEOMETRY_COMPACT  = 2;  // octahedral normal + half uv, full precision otherwise
+const uint GEOMETRY_COLOR    = 4;  // vertex colors follow the other attributes
+
 struct Vertex
 {
   vec3 pos;
@@ -26,12 +31,53 @@ struct Vertex
   vec2 texCoord;
 };
 
+// Analytic primitives of procedural geometries, see kuafu::Primitive.
+const uint PRIMITIVE_SPHERE  = 0;  // size.x = radius
+const uint PRIMITIVE_CAPSULE = 1;  // size.x = half height along the x axis, size.y = radius
+const uint PRIMITIVE_BOX     = 2;  // size = half extents
+
+// Hit kinds reported by PathTrace.rint
+const uint HIT_KIND_OUTSIDE = 0;
+const uint HIT_KIND_INSIDE  = 1;
+
+struct Primitive
+{
+  vec3 center;
+  uint type;
+  vec3 size;
+  float padding0;
+};
+
+// The data of all geometries is stored in a single buffer, every geometry has a record with the addresses of its
+// data, see kuafu::GeometryBuffer. Includers need GL_EXT_buffer_reference and
+// GL_EXT_shader_explicit_arithmetic_types_int64.
+layout( buffer_reference, scalar, buffer_reference_align = 4 ) readonly buffer Words
+{
+  uint w[];
+};
+
+layout( buffer_reference, scalar, buffer_reference_align = 16 ) readonly buffer Primitives
+{
+  Primitive p[];
+};
+
+struct GeometryRecord
+{
+  uint64_t attributes;  // vertex attributes, or the primitives of procedural geometries
+  uint64_t indices;
+  uint64_t matIndices;
+  uint flags;
+  uint padding0;
+};
+
+const uint NO_MATERIAL = 0xFFFFFFFF;
+
 struct GeometryInstance
 {
-  mat4 transform;
+  vec4 transform[3];  // rows of the 3x4 world transform
   uint geometryIndex;
+  uint materialIndex;  // overrides the geometry's material indices if not NO_MATERIAL
 
-  uint padding0;
   uint padding1;
   uint padding2;
 };
@@ -11,4 +11,7 @@ struct RayPayLoad
   uint type;     // 0 == view, 1 == shadow, 2 == bounce
   vec3 shadow_color;
   bool refractive;
+  float hitDistance;     // of the last hit
+  uint instanceIndex;    // of the last hit
+  uint geometryIndex;    // of the last hit
 };
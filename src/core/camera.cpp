@@ -6,7 +6,7 @@
 
 namespace kuafu {
 Camera::Camera(int width, int height, const glm::vec3 &position)
-              : mWidth(width), mHeight(height), mPosition(position) {
+              : mWidth(width), mHeight(height), mPosition(position), mPrevPosition(position) {
     mRenderTargets = std::make_shared<RenderTargets>();
     mFrames = std::make_shared<Frames>();
 
@@ -26,7 +26,7 @@ void Camera::resetView() {
     mDirFront = {1.0F, 0.0F, 0.0F};
 
     updateViewMatrix();
-    global::frameCount = -1;
+    mFrameCount = -1;
 }
 
 glm::mat4 Camera::getPose() const {
@@ -40,10 +40,9 @@ glm::mat4 Camera::getPose() const {
 
 void Camera::update() {
     // If position has changed, reset frame counter for jitter cam.
-    static glm::vec3 prevPosition = mPosition;
-    if (prevPosition != mPosition) {
-        global::frameCount = -1;
-        prevPosition = mPosition;
+    if (mPrevPosition != mPosition) {
+        mFrameCount = -1;
+        mPrevPosition = mPosition;
     }
 
     processKeyboard();
@@ -125,6 +124,7 @@ void Camera::updateProjectionMatrix() {
 
     clearRenderTargets();
     mFrames->destroy();
+    mFrameCount = -1;
 }
 
 
@@ -135,7 +135,7 @@ void Camera::setPose(glm::mat4 pose) {
     mDirFront = {-pose[2][0], -pose[2][1], -pose[2][2]};
     mDirUp = {pose[1][0], pose[1][1], pose[1][2]};
 
-    global::frameCount = -1;
+    mFrameCount = -1;
 }
 
 
@@ -156,7 +156,7 @@ void Camera::processMouse(float xOffset, float yOffset) {
     tmp = rrot * glm::vec4(mDirUp, 0);
 //    mDirUp = {tmp[0], tmp[1],tmp[2]};
 
-    global::frameCount = -1;
+    mFrameCount = -1;
 }
 
 void Camera::processKeyboard() {
@@ -196,7 +196,7 @@ std::vector<uint8_t> Camera::downloadLatestFrame() {
 
     mSync.waitForFrame(downloadTarget);
 
-    vk::Image image = mFrames->getImage(downloadTarget);
+    vk::Image image = mFrames->getImage(mFrames->getCurrentImageIndex());
     vk::Format format = mFrames->getFormat();
     vk::Extent3D extent {mFrames->getExtent(), 1};
     vk::ImageLayout layout = vk::ImageLayout::ePresentSrcKHR;
@@ -99,24 +99,7 @@ void Config::setGeometryInstanceLimit(uint32_t amount) {
 }
 
 void Config::setGeometryLimit(size_t amount) {
-    if (amount == 0) {
-//            KF_WARN( "Can not use value 0 for the maximum number of geometries. Using 16 instead." );
-        amount = 16;
-    }
-
-    if (amount < 16) {
-//            KF_WARN( "Can not use value ", amount, " for the maximum number of geometries. Using 16 instead." );
-        amount = 16;
-    }
-
-    if (amount % 4 != 0) {
-//            KF_WARN( "Minimum storage buffer for geometries alignment must be a multiple of 4. Using 16 instead." );
-        amount = 16;
-    }
-
-    mMaxGeometry = ++amount;
-
-    mMaxGeometryChanged = true;
+    KF_DEBUG("The number of geometries is not limited anymore, ignoring the geometry limit of {}.", amount);
 }
 
 void Config::setTextureLimit(size_t amount) {
@@ -150,6 +133,15 @@ void Config::setPerPixelSampleRate(uint32_t sampleRate) {
 void Config::setAccumulatingFrames(bool flag) { mAccumulateFrames = flag;
 }
 
+void Config::setFramesInFlight(uint32_t n) {
+    if (n == 0) {
+        KF_WARN("Can not use value 0 for the number of frames in flight. Using 1 instead.");
+        n = 1;
+    }
+
+    mFramesInFlight = n;
+}
+
 void Config::updateVariance(bool flag) { mUpdateVariance = flag;
 }
 }
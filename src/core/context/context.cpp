@@ -93,11 +93,9 @@ void Context::init() {
 
       deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     } else {
-        vkCore::global::dataCopies = 1U;
-        vkCore::global::swapchainImageCount = 1U;
-
-//        vkCore::global::dataCopies = 2U;
-//        vkCore::global::swapchainImageCount = 2U;
+        // One copy of the per-frame resources (uniform buffers, descriptor sets, command buffers and frames) per frame in flight.
+        vkCore::global::dataCopies = pConfig->mFramesInFlight;
+        vkCore::global::swapchainImageCount = pConfig->mFramesInFlight;
     }
 
     if (pConfig->mUseDenoiser) {
@@ -185,6 +183,7 @@ void Context::init() {
     indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
     indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
     indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    indexingFeatures.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
     indexingFeatures.pNext = &rtPipelineFeatures;
 
     vk::PhysicalDeviceRobustness2FeaturesEXT robustness2FeaturesEXT;
@@ -198,6 +197,7 @@ void Context::init() {
     vk::PhysicalDeviceFeatures deviceFeatures;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.shaderInt64 = VK_TRUE;
+    deviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;    // rg32ui segmentation targets
 
     vk::PhysicalDeviceFeatures2 deviceFeatures2{deviceFeatures};
     deviceFeatures2.pNext = &bufferDeviceAddressFeatures;
@@ -206,10 +206,12 @@ void Context::init() {
     KF_DEBUG("Device initialized!");
 
     vkCore::global::device = mDevice.get();
+    mAllocator.init();
 
     // Retrieve all queue handles.
     vkCore::global::device.getQueue(vkCore::global::graphicsFamilyIndex, 0, &vkCore::global::graphicsQueue);
     vkCore::global::device.getQueue(vkCore::global::transferFamilyIndex, 0, &vkCore::global::transferQueue);
+    vkCore::global::device.getQueue(vkCore::global::computeFamilyIndex, 0, &vkCore::global::computeQueue);
 
     // Command pools
     mGraphicsCmdPool = vkCore::initCommandPoolUnique(vkCore::global::graphicsFamilyIndex,
@@ -221,6 +223,12 @@ void Context::init() {
     KF_DEBUG("TransferCmdPool initialized!");
     vkCore::global::transferCmdPool = mTransferCmdPool.get();
 
+    mComputeCmdPool = vkCore::initCommandPoolUnique(vkCore::global::computeFamilyIndex, {});
+    KF_DEBUG("ComputeCmdPool initialized!");
+    vkCore::global::computeCmdPool = mComputeCmdPool.get();
+
+    mUploadBatch.init(vkCore::global::transferQueue, mTransferCmdPool.get(), vkCore::global::transferFamilyIndex);
+
     // Post processing renderer
     //mPostProcessingRenderer.initDepthImage(getExtent());
     mPostProcessingRenderer.initRenderPass(getFormat());
@@ -234,9 +242,9 @@ void Context::init() {
         getSync().init(2);
     } else {
         getCamera()->mFrames->init(
-                1, getExtent(), getFormat(), getColorSpace(),
+                pConfig->mFramesInFlight, getExtent(), getFormat(), getColorSpace(),
                 mPostProcessingRenderer.getRenderPass().get());
-        getSync().init(1);
+        getSync().init(pConfig->mFramesInFlight);
     }
 
     KF_DEBUG("Sync initialized!");
@@ -296,10 +304,23 @@ void Context::init() {
 }
 
 void Context::update() {
+    dispatchReadbackCallbacks();
+
+    // Frames in flight are tracked by the current camera, those of the previous one are not waited for otherwise.
+    if (!pConfig->mPresent && getCamera() != pPrevCamera) {
+        mDevice->waitIdle();
+        pPrevCamera = getCamera();
+    }
+
     updateSettings();
+    bool renderTargetsChanged = prepareCameras();
 
-    auto imageIndex = getCurrentImageIndex();
-    auto maxFramesInFlight = static_cast<uint32_t>(getSync().getMaxFramesInFlight());
+    // The uniform buffers, TLAS instances and command buffers of this frame's slot are reused, the frame
+    // that used them last has to be done.
+    auto frameIndex = getCurrentFrameIndex();
+    getSync().waitForFrame(frameIndex);
+    mRayTracer.beginFrame(frameIndex, getSync().getMaxFramesInFlight());
+    mRayTracer.collectTelemetry(frameIndex, getSync().getMaxFramesInFlight());
 
     // If the scene is empty add a dummy triangle so that the acceleration structures can be built successfully.
 
@@ -314,33 +335,89 @@ void Context::update() {
         mCurrentScene->removeDummy();
     }
 
+    bool geometriesChanged = mCurrentScene->mUploadGeometries;
+    // A new instance limit recreates the instance buffer that all frames in flight read.
+    bool instancesChanged = mCurrentScene->mUploadGeometryInstancesToBuffer || pConfig->mMaxGeometryInstancesChanged;
+    bool instancesDirty = !mCurrentScene->mDirtyGeometryInstances.empty();
+    bool posesChanged = mCurrentScene->mUploadInstancePoses;
+    mCurrentScene->mUploadInstancePoses = false;
+
+    // New materials, e.g. of instances of shared geometries, are uploaded even if no geometry changed.
+    bool materialsChanged = mCurrentScene->mUploadedMaterialVersion != global::materials().getVersion();
+
+    // Buffers, acceleration structures and descriptor sets shared by all frames in flight are about to change.
+    // Instances that only changed in place are written by the frame's command buffer instead.
+    if (renderTargetsChanged || geometriesChanged || instancesChanged || materialsChanged ||
+        mCurrentScene->mUploadEnvironmentMap)
+        waitForFramesInFlight();
+
     if (mCurrentScene->mUploadEnvironmentMap) {
-        getSync().waitForFrame(getPrevFrameIndex());
         mCurrentScene->uploadEnvironmentMap();
         mCurrentScene->updateSceneDescriptors();
     }
 
-    if (mCurrentScene->mUploadGeometries) {                // will upload active light tex in this step
-        mCurrentScene->uploadGeometries();
+    if (geometriesChanged) {                // will upload active light tex in this step
+        mCurrentScene->uploadGeometries(mUploadBatch);
+        mCurrentScene->updateGeometryDescriptors();
+    } else if (materialsChanged) {
+        mCurrentScene->uploadMaterials(mUploadBatch);
         mCurrentScene->updateGeometryDescriptors();
     }
 
-    if (mCurrentScene->mUploadGeometryInstancesToBuffer) {
-        mCurrentScene->uploadGeometryInstances();
+    std::vector<uint32_t> uploadedInstances;
+    if (instancesChanged || instancesDirty)
+        uploadedInstances = mCurrentScene->uploadGeometryInstances(frameIndex);
+
+    // All uploads of this frame are a single submission. Rendering and the BLAS builds below wait for it on the device.
+    mUploadBatch.submit();
+
+    // Compacted copies of finished builds replace the structures the TLAS refers to.
+    bool blasChanged = mRayTracer.collectBlasBuilds();
+
+    // Only new or modified geometries get their BLAS (re)built, instance-only changes just rebuild the TLAS and
+    // instances changed in place only refit it.
+    if (geometriesChanged || instancesChanged)
+        blasChanged |= mRayTracer.updateBottomLevelAS(
+                mCurrentScene->mGeometryBuffer, mCurrentScene->mGeometryAllocations, mCurrentScene->getGeometries(),
+                mUploadBatch);
+
+    // Deformed geometries are written and refit in the frame's command buffer.
+    if (!mCurrentScene->mVertexUpdates.empty()) {
+        blasChanged |= mRayTracer.updateGeometryVertices(
+                mCurrentScene->mGeometryBuffer, mCurrentScene->mGeometryAllocations, mCurrentScene->mVertexUpdates,
+                frameIndex, pConfig->mBlasRebuildInterval);
+        mCurrentScene->mVertexUpdates.clear();
+    }
 
-        // @TODO Try to call this as few times as possible.
-        mRayTracer.createBottomLevelAS(mCurrentScene->mVertexBuffers, mCurrentScene->mIndexBuffers, mCurrentScene->mGeometries);
-        mRayTracer.buildTlas(mCurrentScene->mGeometryInstances,
+    // Only the raw poses are copied, the transforms of posed instances are computed right before the TLAS build.
+    mRayTracer.setInstancePoses(mCurrentScene->getInstancePoses(), mCurrentScene->getInstancePoseLayout(), posesChanged,
+                                mCurrentScene->mGeometryInstancesBuffer.get(0), frameIndex);
+
+    mRayTracer.setTlasRebuildPolicy(pConfig->mTlasRebuildInterval, pConfig->mTlasRebuildDisplacement);
+
+    bool tlasRebuilt = instancesChanged || blasChanged;
+    if (tlasRebuilt) {
+        mRayTracer.buildTlas(mCurrentScene->getGeometryInstances(), frameIndex,
                              vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
                              vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
-        mRayTracer.updateDescriptors();
     } else {
-        mRayTracer.updateTlas(mCurrentScene->mGeometryInstances,
+        mRayTracer.updateTlas(mCurrentScene->getGeometryInstances(), uploadedInstances, frameIndex,
                               vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
                               vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
     }
 
-    mCurrentScene->uploadUniformBuffers(imageIndex % maxFramesInFlight);
+    if (tlasRebuilt || renderTargetsChanged)
+        mRayTracer.updateDescriptors();
+
+    // Accumulation is tracked per camera, a global reset (e.g. a changed scene) restarts it for all of them.
+    if (!pConfig->mAccumulateFrames || global::frameCount < 0)
+        for (auto &camera : mCurrentScene->mRegisteredCameras)
+            camera->mFrameCount = -1;
+
+    for (auto camera : mCameras)
+        ++camera->mFrameCount;
+
+    mCurrentScene->uploadUniformBuffers(static_cast<uint32_t>(frameIndex), mCameras);
 
     // Increment frame counter for jitter cam.
     if (pConfig->mAccumulateFrames)
@@ -349,12 +426,54 @@ void Context::update() {
         global::frameCount = -1;
 }
 
+bool Context::prepareCameras() {
+    // The current camera's frames and render targets are also used by the post processing, refresh all of it.
+    if (!pConfig->mPresent && (!getCamera()->mFrames->initialized() || getCamera()->getRenderTargets()->empty()))
+        recreateSwapchain();
+
+    bool changed = false;
+    std::vector<std::shared_ptr<RenderTargets>> renderTargets;
+    renderTargets.reserve(mCameras.size());
+
+    for (auto camera : mCameras) {
+        if (camera != getCamera()) {
+            vk::Extent2D extent{static_cast<uint32_t>(camera->getWidth()),
+                                static_cast<uint32_t>(camera->getHeight())};
+
+            // Both are no-ops once initialized.
+            camera->mSync.init(pConfig->mFramesInFlight);
+            camera->mFrames->init(pConfig->mFramesInFlight, extent, getFormat(), getColorSpace(),
+                                  mPostProcessingRenderer.getRenderPass().get());
+
+            if (camera->getRenderTargets()->empty()) {
+                RayTracer::createStorageImage(*camera->getRenderTargets(), extent);
+                camera->mFrameCount = -1;
+                changed = true;
+            }
+        }
+
+        renderTargets.push_back(camera->getRenderTargets());
+    }
+
+    if (changed || renderTargets != mRayTracer.getRenderTargets()) {
+        mRayTracer.setRenderTargets(renderTargets);
+        return true;
+    }
+
+    return false;
+}
+
 void Context::prepareFrame() {
     if (pConfig->mPresent) {
         mSwapchain.acquireNextImage(getSync().getImageAvailableSemaphore(getCurrentFrameIndex()), nullptr);
     } else {
 //        mFrames.acquireNextImage(getSync().getImageAvailableSemaphore(currentFrame));
         getCamera()->mFrames->acquireNextImage();            // FIXME
+
+        if (mBatched)
+            for (auto camera : mCameras)
+                if (camera != getCamera())
+                    camera->mFrames->acquireNextImage();
     }
 }
 
@@ -384,10 +503,29 @@ void Context::submitWithTLSemaphore(const vk::CommandBuffer& cmdBuf)
     signalSemaphore.setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
     signalSemaphore.setValue(mFenceValue);
 
+    // Scene uploads still in flight on the transfer queue.
+    vk::SemaphoreSubmitInfoKHR uploadSemaphore;
+    uploadSemaphore.setSemaphore(mUploadBatch.getSemaphore());
+    uploadSemaphore.setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
+    uploadSemaphore.setValue(mUploadBatch.getValue());
+
+    // Bottom level acceleration structures built on the compute queue.
+    vk::SemaphoreSubmitInfoKHR blasSemaphore;
+    blasSemaphore.setSemaphore(mRayTracer.getBlasSemaphore());
+    blasSemaphore.setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
+    blasSemaphore.setValue(mRayTracer.getBlasValue());
+
+    std::vector<vk::SemaphoreSubmitInfoKHR> waitSemaphores;
+    if (pConfig->mPresent)                                 // TODO: FIXME
+        waitSemaphores.push_back(waitSemaphore);           // TODO: FIXME
+    if (mUploadBatch.getValue() > 0)
+        waitSemaphores.push_back(uploadSemaphore);
+    if (mRayTracer.getBlasValue() > 0)
+        waitSemaphores.push_back(blasSemaphore);
+
     vk::SubmitInfo2KHR submits;
     submits.setCommandBufferInfos(cmdBufInfo);
-    if (pConfig->mPresent)                                 // TODO: FIXME
-        submits.setWaitSemaphoreInfos(waitSemaphore);      // TODO: FIXME
+    submits.setWaitSemaphoreInfos(waitSemaphores);
     submits.setSignalSemaphoreInfos(signalSemaphore);
 
     vkCore::global::graphicsQueue.submit2KHR(submits);
@@ -410,14 +548,20 @@ void Context::submitFrame(const vk::CommandBuffer& cmdBuf)
     waitSemaphore.setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
     waitSemaphore.setValue(mFenceValue);
 
-    vk::SemaphoreSubmitInfoKHR signalSemaphore;
-    signalSemaphore.setSemaphore(currentFinishedSemaphore);
-    signalSemaphore.setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
+    // Increment for signaling the end of the frame, readbacks wait for this value.
+    mFenceValue++;
+
+    std::array<vk::SemaphoreSubmitInfoKHR, 2> signalSemaphores;
+    signalSemaphores[0].setSemaphore(currentFinishedSemaphore);
+    signalSemaphores[0].setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
+    signalSemaphores[1].setSemaphore(getCmdSemaphore());
+    signalSemaphores[1].setStageMask(vk::PipelineStageFlagBits2KHR::eAllCommands);
+    signalSemaphores[1].setValue(mFenceValue);
 
     vk::SubmitInfo2KHR submits;
     submits.setCommandBufferInfos(cmdBufInfo);
     submits.setWaitSemaphoreInfos(waitSemaphore);
-    submits.setSignalSemaphoreInfos(signalSemaphore);
+    submits.setSignalSemaphoreInfos(signalSemaphores);
 
     vkCore::global::graphicsQueue.submit2KHR(submits, currentInFlightFence);
 
@@ -483,16 +627,155 @@ std::vector<uint8_t> Context::downloadLatestFrameFromSwapchain() {
 }
 
 
+std::shared_ptr<Readback> Context::requestReadback(Camera* camera, Readback::Channels channels,
+                                                   Readback::Callback callback) {
+    KF_ASSERT(pConfig->mPresent || camera, "Trying to read back an invalid camera!");
+    KF_ASSERT(channels != 0 && channels < (1U << Readback::channelCount), "Invalid readback channels: {}", channels);
+
+    auto readback = std::make_shared<Readback>(camera, channels, std::move(callback));
+    mPendingReadbacks.push_back(readback);
+    return readback;
+}
+
+std::vector<std::shared_ptr<Readback>> Context::recordReadbacks(vk::CommandBuffer cmdBuf, size_t imageIndex) {
+    std::vector<std::shared_ptr<Readback>> recorded;
+
+    static const std::array<std::string, Readback::channelCount> targets = {"", "albedo", "normal", "depth", "segmentation"};
+
+    // The render targets were written by the trace of this frame.
+    vk::MemoryBarrier targetsBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
+    bool targetsBarrierRecorded = false;
+
+    for (auto &readback : mPendingReadbacks) {
+        Camera *camera;
+        vk::Image image;
+        vk::Extent2D extent;
+        vk::Format format;
+
+        if (pConfig->mPresent) {
+            camera = getCamera();
+            image = getImage(imageIndex);
+            extent = getExtent();
+            format = getFormat();
+        } else {
+            camera = readback->pCamera;
+            if (std::find(mCameras.begin(), mCameras.end(), camera) == mCameras.end())
+                continue;
+
+            image = camera->mFrames->getImage(camera->mFrames->getCurrentImageIndex());
+            extent = camera->mFrames->getExtent();
+            format = camera->mFrames->getFormat();
+        }
+
+        // All channels share a single buffer, each one starts at a 16 byte aligned offset.
+        vk::DeviceSize bufferSize = 0;
+        auto pixelCount = static_cast<vk::DeviceSize>(extent.width) * extent.height;
+
+        for (size_t i = 0; i < Readback::channelCount; ++i) {
+            auto &region = readback->mRegions[i];
+            if (!readback->hasChannel(static_cast<Readback::Channel>(1U << i))) {
+                region = {};
+                continue;
+            }
+
+            region.format = i == 0 ? format : camera->getRenderTargets()->at(targets[i]).getFormat();
+            region.offset = bufferSize;
+            region.size = pixelCount * vkCore::getFormatSize(region.format);
+            bufferSize = (bufferSize + region.size + 15) / 16 * 16;
+        }
+
+        readback->mExtent = extent;
+        readback->pBuffer = mReadbackRing.acquire(bufferSize);
+
+        vk::BufferImageCopy region(0,                                            // bufferOffset
+                                   0,                                            // bufferRowLength
+                                   0,                                            // bufferImageHeight
+                                   {vk::ImageAspectFlagBits::eColor, 0, 0, 1},   // imageSubresource
+                                   vk::Offset3D{0, 0, 0},                        // imageOffset
+                                   vk::Extent3D{extent, 1});                     // imageExtent
+
+        if (readback->hasChannel(Readback::eColor)) {
+            // The frame was written by the post processing pass or a blit, both leave it in present layout.
+            vk::ImageMemoryBarrier barrier(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite,
+                                           vk::AccessFlagBits::eTransferRead,
+                                           vk::ImageLayout::ePresentSrcKHR,
+                                           vk::ImageLayout::eTransferSrcOptimal,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           image,
+                                           {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eTransfer,
+                                   {}, nullptr, nullptr, barrier);
+
+            cmdBuf.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, readback->pBuffer->buffer.get(), region);
+
+            vkCore::transitionImageLayout(image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::ePresentSrcKHR, cmdBuf);
+        }
+
+        for (size_t i = 1; i < Readback::channelCount; ++i) {
+            if (!readback->hasChannel(static_cast<Readback::Channel>(1U << i)))
+                continue;
+
+            if (!targetsBarrierRecorded) {
+                cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eTransfer,
+                                       {}, targetsBarrier, nullptr, nullptr);
+                targetsBarrierRecorded = true;
+            }
+
+            // Render targets stay in general layout.
+            region.bufferOffset = readback->mRegions[i].offset;
+            cmdBuf.copyImageToBuffer(camera->getRenderTargets()->at(targets[i]).get(), vk::ImageLayout::eGeneral,
+                                     readback->pBuffer->buffer.get(), region);
+        }
+
+        recorded.push_back(readback);
+    }
+
+    if (!recorded.empty()) {
+        // Make the copies visible to the host once the frame's timeline value is signaled.
+        vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+                               {}, barrier, nullptr, nullptr);
+
+        mPendingReadbacks.erase(
+                std::remove_if(mPendingReadbacks.begin(), mPendingReadbacks.end(),
+                               [](auto &readback) { return readback->submitted(); }),
+                mPendingReadbacks.end());
+    }
+
+    return recorded;
+}
+
+void Context::waitForFramesInFlight() {
+    for (size_t i = 0; i < getSync().getMaxFramesInFlight(); ++i)
+        getSync().waitForFrame(i);
+}
+
+void Context::dispatchReadbackCallbacks() {
+    std::vector<std::shared_ptr<Readback>> done;
+
+    mReadbackCallbacks.erase(
+            std::remove_if(mReadbackCallbacks.begin(), mReadbackCallbacks.end(),
+                           [&done](auto &readback) {
+                               if (!readback->ready())
+                                   return false;
+                               done.push_back(readback);
+                               return true;
+                           }),
+            mReadbackCallbacks.end());
+
+    for (auto &readback : done)
+        readback->mCallback(*readback);
+}
+
 void Context::updateSettings() {
-    if (pConfig->mMaxGeometryChanged || pConfig->mMaxTexturesChanged) {
-        getSync().waitForFrame(getPrevFrameIndex());
+    if (pConfig->mMaxTexturesChanged) {
+        waitForFramesInFlight();
 
-        pConfig->mMaxGeometryChanged = false;
         pConfig->mMaxTexturesChanged = false;
 
-        mCurrentScene->mVertexBuffers.resize(pConfig->mMaxGeometry);
-        mCurrentScene->mIndexBuffers.resize(pConfig->mMaxGeometry);
-        mCurrentScene->mMaterialIndexBuffers.resize(pConfig->mMaxGeometry);
         mCurrentScene->mTextures.resize(pConfig->mMaxTextures);
 
         mCurrentScene->initGeometryDescriptorSets();
@@ -520,6 +803,9 @@ void Context::updateSettings() {
 }
 
 void Context::render() {
+    mCameras = {getCamera()};
+    mBatched = false;
+
     update();
 
     if (pConfig->mPresent) {
@@ -539,6 +825,27 @@ void Context::render() {
 //    submitFrame();
 }
 
+void Context::render(const std::vector<Camera*> &cameras) {
+    KF_ASSERT(!pConfig->mPresent, "Rendering multiple cameras at once is only available in offscreen mode!");
+    KF_ASSERT(!pConfig->mUseDenoiser, "Rendering multiple cameras at once does not support the denoiser!");
+    KF_ASSERT(!cameras.empty() && cameras.size() <= global::maxCameras,
+              "Trying to render {} cameras at once, at most {} are supported!", cameras.size(), global::maxCameras);
+
+    for (auto camera : cameras) {
+        KF_ASSERT(camera, "Trying to render with an invalid camera!");
+        KF_ASSERT(std::find_if(mCurrentScene->mRegisteredCameras.begin(), mCurrentScene->mRegisteredCameras.end(),
+                               [camera](auto &c) { return camera == c.get(); }) != mCurrentScene->mRegisteredCameras.end(),
+                  "Trying to render a camera that does not belong to the scene!");
+    }
+
+    mCameras = cameras;
+    mBatched = true;
+
+    update();
+    prepareFrame();
+    recordSwapchainCommandBuffers();
+}
+
 void Context::recreateSwapchain() {
     // Waiting idle because this event is considered to be very rare.
     mDevice->waitIdle();
@@ -561,7 +868,7 @@ void Context::recreateSwapchain() {
         KF_DEBUG("Switching Framebuffer...");
 
         getCamera()->mFrames->init(
-                1, getExtent(),
+                pConfig->mFramesInFlight, getExtent(),
                 getFormat(), getColorSpace(),
                 mPostProcessingRenderer.getRenderPass().get());
     }
@@ -569,6 +876,7 @@ void Context::recreateSwapchain() {
     // Recreate storage image with the new swapchain image size and update the path tracing descriptor set to use the new storage image view.
     mRayTracer.setRenderTargets(getCamera()->getRenderTargets());
     mRayTracer.createStorageImage(getExtent());
+    getCamera()->mFrameCount = -1;
 
     if (pConfig->mUseDenoiser)
         mDenoiser.allocateBuffers(getExtent());
@@ -600,8 +908,6 @@ void Context::initGui() {
 }
 
 void Context::recordSwapchainCommandBuffers() {
-    getSync().waitForFrame(getPrevFrameIndex());
-
     RtPushConstants pushConstants = {
             mCurrentScene->getClearColor(),
             global::frameCount,
@@ -618,10 +924,30 @@ void Context::recordSwapchainCommandBuffers() {
     vk::CommandBuffer cmdBuf = mCommandBuffers.get(imageIndex);
     vk::CommandBuffer cmdBuf2 = mCommandBuffers2.get(imageIndex);
 
-    size_t index = imageIndex % getSync().getMaxFramesInFlight();
+    size_t index = getCurrentFrameIndex();
 
     mCommandBuffers.begin(imageIndex);
     {
+        // Take over the buffers and textures the upload batches released from the transfer queue.
+        mUploadBatch.recordAcquireBarriers(cmdBuf, vkCore::global::graphicsFamilyIndex);
+
+        // The render targets are shared by all frames in flight, the previous frame has to be done with them.
+        vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite,                                     // srcAccessMask
+                                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite); // dstAccessMask
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,        // srcStageMask
+                               vk::PipelineStageFlagBits::eRayTracingShaderKHR, // dstStageMask
+                               {},                                              // dependencyFlags
+                               1,                                               // memoryBarrierCount
+                               &barrier,                                        // pMemoryBarriers
+                               0,                                               // bufferMemoryBarrierCount
+                               nullptr,                                         // pBufferMemoryBarriers
+                               0,                                               // imageMemoryBarrierCount
+                               nullptr);                                       // pImageMemoryBarriers
+
+        mCurrentScene->recordGeometryInstanceUploads(cmdBuf);
+        mRayTracer.recordTlasBuild(cmdBuf);
+
         cmdBuf.pushConstants(
                 mRayTracer.getPipelineLayout(),
                 vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR |
@@ -645,7 +971,17 @@ void Context::recordSwapchainCommandBuffers() {
                                   nullptr);
 
         // rt
-        mRayTracer.trace(cmdBuf, getImage(imageIndex), getExtent());
+        if (mBatched) {
+            // One launch layer per camera, covering the largest one.
+            vk::Extent2D extent{0, 0};
+            for (auto camera : mCameras) {
+                extent.width = std::max(extent.width, static_cast<uint32_t>(camera->getWidth()));
+                extent.height = std::max(extent.height, static_cast<uint32_t>(camera->getHeight()));
+            }
+
+            mRayTracer.trace(cmdBuf, getImage(imageIndex), extent, static_cast<uint32_t>(mCameras.size()));
+        } else
+            mRayTracer.trace(cmdBuf, getImage(imageIndex), getExtent());
 
         // denoise
         if (pConfig->mUseDenoiser)
@@ -669,17 +1005,57 @@ void Context::recordSwapchainCommandBuffers() {
         if(pConfig->mUseDenoiser)
             mDenoiser.bufferToImage(cmdBuf2, mRayTracer.getStorageImage("rgba"));
 
-        // pp
-        mPostProcessingRenderer.beginRenderPass(cmdBuf2, getFramebuffer(imageIndex), getExtent());
-        {
-            mPostProcessingRenderer.render(cmdBuf2, getExtent(), index);
+        if (mBatched)
+            recordCameraBlits(cmdBuf2);
+        else {
+            // pp
+            mPostProcessingRenderer.beginRenderPass(cmdBuf2, getFramebuffer(imageIndex), getExtent());
+            {
+                mPostProcessingRenderer.render(cmdBuf2, getExtent(), index);
 
-            if (pGui != nullptr)
-                pGui->renderDrawData(cmdBuf2);
+                if (pGui != nullptr)
+                    pGui->renderDrawData(cmdBuf2);
+            }
+            mPostProcessingRenderer.endRenderPass(cmdBuf2);
         }
-        mPostProcessingRenderer.endRenderPass(cmdBuf2);
     }
+    auto readbacks = recordReadbacks(cmdBuf2, imageIndex);
     mCommandBuffers2.end(imageIndex);
     submitFrame(cmdBuf2);
+
+    for (auto &readback : readbacks) {
+        readback->pBuffer->semaphore = getCmdSemaphore();
+        readback->pBuffer->value = mFenceValue;
+
+        if (readback->mCallback)
+            mReadbackCallbacks.push_back(readback);
+    }
+}
+
+void Context::recordCameraBlits(vk::CommandBuffer cmdBuf) {
+    // The post processing pass only samples the path traced image, a blit does the same conversion per camera.
+    // The trace was submitted before, waiting for its timeline semaphore makes its writes visible here.
+    for (auto camera : mCameras) {
+        const auto &storageImage = camera->getRenderTargets()->at("rgba");
+        auto frameImage = camera->mFrames->getImage(camera->mFrames->getCurrentImageIndex());
+        auto extent = storageImage.getExtent();
+
+        vkCore::transitionImageLayout(frameImage, vk::ImageLayout::eUndefined,
+                                      vk::ImageLayout::eTransferDstOptimal, cmdBuf);
+
+        vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+        std::array<vk::Offset3D, 2> offsets = {
+                vk::Offset3D{0, 0, 0},
+                vk::Offset3D{static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1}};
+        vk::ImageBlit region(subresource, offsets, subresource, offsets);
+
+        cmdBuf.blitImage(storageImage.get(), vk::ImageLayout::eGeneral,
+                         frameImage, vk::ImageLayout::eTransferDstOptimal,
+                         region, vk::Filter::eNearest);
+
+        // Leave the frame as the post processing render pass would, see Camera::downloadLatestFrame().
+        vkCore::transitionImageLayout(frameImage, vk::ImageLayout::eTransferDstOptimal,
+                                      vk::ImageLayout::ePresentSrcKHR, cmdBuf);
+    }
 }
 }
@@ -23,14 +23,29 @@
 #include "core/context/global.hpp"
 
 namespace kuafu::global {
+static std::string getDefaultMeshCachePath() {
+    if (auto cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome != nullptr && *cacheHome != '\0')
+        return (std::filesystem::path(cacheHome) / "kuafu" / "meshes").string();
+
+    if (auto home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        return (std::filesystem::path(home) / ".cache" / "kuafu" / "meshes").string();
+
+    return "";
+}
+
 std::shared_ptr<spdlog::logger> logger =
         spdlog::stderr_color_mt("kuafu");
 
 int frameCount = -1;
 std::string assetsPath;
-uint32_t materialIndex = 0;
+std::string meshCachePath = getDefaultMeshCachePath();
 uint32_t textureIndex = 0;
-std::vector<NiceMaterial> materials;
+
+MaterialRegistry &materials() {
+    // Intentionally leaked, the destruction order of globals in different translation units is unspecified.
+    static auto *registry = new MaterialRegistry;
+    return *registry;
+}
 
 namespace keys {
 bool eW;
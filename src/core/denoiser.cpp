@@ -120,7 +120,7 @@ void DenoiserOptix::allocateBuffers(const vk::Extent2D& imgSize)
     vk::DeviceSize bufferSize =
             static_cast<unsigned long long>(mImageSize.width) * mImageSize.height * 4 * sizeof(float);
 
-    // Using direct method
+    // Using direct method, the buffers get dedicated memory since CUDA imports the whole allocation.
     vk::BufferUsageFlags usage{
           vk::BufferUsageFlagBits::eUniformBuffer
         | vk::BufferUsageFlagBits::eTransferDst
@@ -129,27 +129,27 @@ void DenoiserOptix::allocateBuffers(const vk::Extent2D& imgSize)
 
     mPixelBufferIn[0].buffer.init(
             bufferSize, usage,
-            {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+            {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal, nullptr, true);
 
     createBufferCuda(mPixelBufferIn[0]);  // Exporting the buffer to Cuda handle and pointers
 
     if(mDOptions.inputKind > OPTIX_DENOISER_INPUT_RGB) {
         mPixelBufferIn[1].buffer.init(
                 bufferSize, usage,
-                {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+                {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal, nullptr, true);
         createBufferCuda(mPixelBufferIn[1]);
     }
     if(mDOptions.inputKind == OPTIX_DENOISER_INPUT_RGB_ALBEDO_NORMAL) {
         mPixelBufferIn[2].buffer.init(
                 bufferSize, usage,
-                {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+                {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal, nullptr, true);
         createBufferCuda(mPixelBufferIn[2]);
     }
 
     // Output image/buffer
     mPixelBufferOut.buffer.init(
             bufferSize, usage,
-            {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+            {vkCore::global::graphicsFamilyIndex}, vk::MemoryPropertyFlagBits::eDeviceLocal, nullptr, true);
     createBufferCuda(mPixelBufferOut);
 
     // Computing the amount of memory needed to do the denoiser
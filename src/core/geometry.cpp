@@ -3,28 +3,17 @@
 //
 #include "kuafu_utils.hpp"
 #include "core/geometry.hpp"
+#include "core/scene.hpp"
 #include "core/context/global.hpp"
+#include "core/mesh_cache.hpp"
+#include <functional>
+#include <mutex>
+#include <glm/gtc/packing.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
 namespace kuafu {
-bool operator==(const NiceMaterial &m1, const NiceMaterial &m2) {   // C++20 should allow defaulting this
-    return (m1.diffuseColor == m2.diffuseColor) &&
-           (m1.alpha == m2.alpha) &&
-           (m1.diffuseTexPath == m2.diffuseTexPath) &&
-           (m1.metallicTexPath == m2.metallicTexPath) &&
-           (m1.roughnessTexPath == m2.roughnessTexPath) &&
-           (m1.transmissionTexPath == m2.transmissionTexPath) &&
-           (m1.transmission == m2.transmission) &&
-           (m1.metallic == m2.metallic) &&
-           (m1.specular == m2.specular) &&
-           (m1.roughness == m2.roughness) &&
-           (m1.ior == m2.ior) &&
-           (m1.emission == m2.emission) &&
-           (m1.emissionStrength == m2.emissionStrength);
-}
-
 static inline std::string getTexPath(const aiScene *scene, const aiMaterial *m, aiTextureType t,
                               const std::filesystem::path& baseDir) {
     aiString tpath;
@@ -43,14 +32,10 @@ static inline std::string getTexPath(const aiScene *scene, const aiMaterial *m,
     return "";
 }
 
-std::vector<std::shared_ptr<Geometry> > loadScene(
-        std::string_view fname, bool dynamic) {
-    auto path = std::filesystem::absolute(fname);
+static ImportedScene importScene(const std::filesystem::path &path, uint32_t flags) {
+    auto fname = path.string();
 
     Assimp::Importer importer;
-    uint32_t flags = aiProcess_CalcTangentSpace | aiProcess_Triangulate |
-                     aiProcess_GenNormals | aiProcess_FlipUVs |
-                     aiProcess_PreTransformVertices;
     importer.SetPropertyBool(AI_CONFIG_IMPORT_COLLADA_IGNORE_UP_DIRECTION, true);
     const aiScene *scene = importer.ReadFile(path, flags);
 
@@ -68,8 +53,8 @@ std::vector<std::shared_ptr<Geometry> > loadScene(
 
 //    const uint32_t MIP_LEVEL = 3;
 
-    std::vector<std::shared_ptr<Geometry>> geometries;
-    std::vector<NiceMaterial> materials;
+    ImportedScene imported;
+    auto &materials = imported.materials;
 
     // Known issue:
     //   1. Blender 2.93 still do not export Specular, Transmission, IOR
@@ -151,29 +136,6 @@ std::vector<std::shared_ptr<Geometry> > loadScene(
                             });
     }
 
-    // Upload materials to global resources
-    std::vector<uint32_t> matLocal2GlobalIdx(
-            materials.size(), std::numeric_limits<uint32_t>::max());
-    for (size_t i = 0; i < materials.size(); i++) {
-        // lookup dups
-        bool found = false;
-        size_t materialIndex = 0;
-        for (size_t j = 0; j < global::materials.size(); j++) {
-            if (materials[i] == global::materials[j]) {
-                found = true;
-                materialIndex = j;
-                break;
-            }
-        }
-
-        if (found)
-            matLocal2GlobalIdx[i] = materialIndex;
-        else {
-            global::materials.push_back(std::move(materials[i]));
-            matLocal2GlobalIdx[i] = global::materialIndex++;
-        }
-    }
-
     // Meshes
     for (uint32_t mesh_idx = 0; mesh_idx < scene->mNumMeshes; ++mesh_idx) {
         auto mesh = scene->mMeshes[mesh_idx];
@@ -212,17 +174,139 @@ std::vector<std::shared_ptr<Geometry> > loadScene(
             continue;
         }
 
+        imported.meshes.push_back({
+                                          .vertices = std::move(vertices),
+                                          .indices = std::move(indices),
+                                          .materialIndex = mesh->mMaterialIndex,
+                                          .hasColors = mesh->HasVertexColors(0)
+                                  });
+    }
+
+    return imported;
+}
+
+// Spreads the lower 10 bits of v to every third bit.
+static uint32_t expandBits(uint32_t v) {
+    v = (v * 0x00010001U) & 0xFF0000FFU;
+    v = (v * 0x00000101U) & 0x0F00F00FU;
+    v = (v * 0x00000011U) & 0xC30C30C3U;
+    v = (v * 0x00000005U) & 0x49249249U;
+    return v;
+}
+
+/// Welds duplicate vertices and sorts triangles and vertices for locality, see Geometry::optimize().
+/// @return Returns the old index of every triangle in the new order.
+static std::vector<uint32_t> optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, bool hasColors) {
+    size_t triangleCount = indices.size() / 3;
+
+    // Weld
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(vertices.size());
+
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    std::vector<uint32_t> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        Vertex v = vertices[i];
+        if (!hasColors)
+            v.color = glm::vec3(0.F);
+        v.padding0 = 0.F;
+
+        auto [it, inserted] = uniqueVertices.try_emplace(v, static_cast<uint32_t>(welded.size()));
+        if (inserted)
+            welded.push_back(v);
+        remap[i] = it->second;
+    }
+
+    for (auto &index : indices)
+        index = remap[index];
+
+    // Sort triangles along a Morton curve through their centroids
+    glm::vec3 lower(std::numeric_limits<float>::max());
+    glm::vec3 upper(std::numeric_limits<float>::lowest());
+    for (const auto &v : welded) {
+        lower = glm::min(lower, v.pos);
+        upper = glm::max(upper, v.pos);
+    }
+    glm::vec3 extent = glm::max(upper - lower, glm::vec3(std::numeric_limits<float>::min()));
+
+    std::vector<std::pair<uint32_t, uint32_t>> keys(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        glm::vec3 centroid = (welded[indices[3 * t]].pos +
+                              welded[indices[3 * t + 1]].pos +
+                              welded[indices[3 * t + 2]].pos) / 3.F;
+        glm::uvec3 cell = glm::uvec3(glm::clamp((centroid - lower) / extent, 0.F, 1.F) * 1023.F);
+        keys[t] = {(expandBits(cell.x) << 2U) | (expandBits(cell.y) << 1U) | expandBits(cell.z),
+                   static_cast<uint32_t>(t)};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // Renumber vertices in the order they are first referenced
+    std::vector<uint32_t> order(triangleCount);
+    std::vector<uint32_t> newIndex(welded.size(), std::numeric_limits<uint32_t>::max());
+    std::vector<uint32_t> sortedIndices(triangleCount * 3);
+    vertices.clear();
+    vertices.reserve(welded.size());
+
+    for (size_t t = 0; t < triangleCount; ++t) {
+        order[t] = keys[t].second;
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t index = indices[3 * order[t] + k];
+            if (newIndex[index] == std::numeric_limits<uint32_t>::max()) {
+                newIndex[index] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(welded[index]);
+            }
+            sortedIndices[3 * t + k] = newIndex[index];
+        }
+    }
+
+    indices = std::move(sortedIndices);
+    return order;
+}
 
+std::vector<std::shared_ptr<Geometry> > loadScene(
+        std::string_view fname, bool dynamic, bool optimize) {
+    auto path = std::filesystem::absolute(fname);
+
+    uint32_t flags = aiProcess_CalcTangentSpace | aiProcess_Triangulate |
+                     aiProcess_GenNormals | aiProcess_FlipUVs |
+                     aiProcess_PreTransformVertices;
+
+    // Files imported before are read from the mesh cache and skip Assimp
+    auto cached = meshcache::load(path, flags, optimize);
+    ImportedScene imported;
+    if (cached) {
+        imported = std::move(*cached);
+    } else {
+        imported = importScene(path, flags);
+        if (optimize)
+            for (auto &mesh : imported.meshes)
+                optimizeMesh(mesh.vertices, mesh.indices, mesh.hasColors);
+
+        meshcache::store(path, flags, optimize, imported);
+    }
+
+    // Register materials, equal materials of previously loaded scenes are shared
+    std::vector<MaterialHandle> materialHandles;
+    materialHandles.reserve(imported.materials.size());
+    for (const auto &material : imported.materials)
+        materialHandles.push_back(global::materials().acquire(material));
+
+    std::vector<std::shared_ptr<Geometry>> geometries;
+    for (auto &mesh : imported.meshes) {
         // Create Geometry
         std::shared_ptr<Geometry> geometry = std::make_shared<Geometry>();
         geometry->path = path;
         geometry->dynamic = dynamic;
-        geometry->vertices = vertices;
-        geometry->indices = indices;
         geometry->initialized = false;
-        geometry->matIndex = std::vector<uint32_t>(
-                indices.size() / 3, matLocal2GlobalIdx[mesh->mMaterialIndex]);
-        geometry->isOpaque = global::materials[geometry->matIndex.front()].alpha >= 1.F;
+        geometry->hasVertexColors = mesh.hasColors;
+        const auto &material = materialHandles[mesh.materialIndex];
+        geometry->matIndex = std::vector<uint32_t>(mesh.indices.size() / 3, material.getIndex());
+        geometry->materials = {material};
+        geometry->isOpaque = global::materials()[material.getIndex()].alpha >= 1.F;
+        geometry->vertices = std::move(mesh.vertices);
+        geometry->indices = std::move(mesh.indices);
 
         // Add to ret
         geometries.push_back(std::move(geometry));
@@ -232,20 +316,20 @@ std::vector<std::shared_ptr<Geometry> > loadScene(
 }
 
 
-std::shared_ptr<Geometry> loadObj(std::string_view path, bool dynamic) {
-    auto scene = loadScene(path, dynamic);
+std::shared_ptr<Geometry> loadObj(std::string_view path, bool dynamic, bool optimize) {
+    auto scene = loadScene(path, dynamic, optimize);
     KF_ASSERT(scene.size() == 1, "complex scene! use loadScene");
     return scene.front();
 }
 
 void Geometry::setMaterial(const NiceMaterial &material) {
     isOpaque = (material.alpha >= 1);
-    global::materials.push_back(material);
-    global::materialIndex++;
 
-    for (auto &it : matIndex) {
-        it = global::materialIndex - 1;
-    }
+    auto handle = global::materials().acquire(material);
+    std::fill(matIndex.begin(), matIndex.end(), handle.getIndex());
+
+    materials.clear();
+    materials.push_back(std::move(handle));
 }
 
 std::shared_ptr<GeometryInstance> instance(
@@ -262,6 +346,26 @@ std::shared_ptr<GeometryInstance> instance(
 
 void GeometryInstance::setTransform(const glm::mat4 &t) {
     this->transform = t;
+
+    if (pScene)
+        pScene->markGeometryInstanceDirty(this);
+}
+
+void Geometry::optimize() {
+    KF_ASSERT(matIndex.empty() || matIndex.size() == indices.size() / 3,
+              "Geometry needs either no material indices or one per triangle!");
+
+    auto order = optimizeMesh(vertices, indices, hasVertexColors);
+
+    // The material indices follow their triangles.
+    if (!matIndex.empty()) {
+        std::vector<uint32_t> reordered(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            reordered[i] = matIndex[order[i]];
+        matIndex = std::move(reordered);
+    }
+
+    initialized = false;
 }
 
 // From optifuser by Fanbo
@@ -294,7 +398,126 @@ void Geometry::recalculateNormals() {
     }
 }
 
-std::shared_ptr<Geometry> createYZPlane(bool dynamic, NiceMaterial mat) {
+// Maps a unit vector to the octahedron and unfolds it to [-1, 1]^2, decoded by octDecode() in PathTrace.rchit.
+static glm::vec2 octEncode(const glm::vec3 &n) {
+    float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (length == 0.F)
+        return glm::vec2(0.F);
+
+    glm::vec2 p = glm::vec2(n.x, n.y) / length;
+    if (n.z < 0.F) {
+        glm::vec2 sign(p.x >= 0.F ? 1.F : -1.F, p.y >= 0.F ? 1.F : -1.F);
+        p = (1.F - glm::abs(glm::vec2(p.y, p.x))) * sign;
+    }
+    return p;
+}
+
+std::pair<glm::vec3, glm::vec3> Primitive::getBounds() const {
+    glm::vec3 halfExtents;
+    switch (type) {
+        case Type::eSphere:
+            halfExtents = glm::vec3(size.x);
+            break;
+        case Type::eCapsule:
+            halfExtents = glm::vec3(size.x + size.y, size.y, size.y);
+            break;
+        case Type::eBox:
+            halfExtents = size;
+            break;
+    }
+    return {center - halfExtents, center + halfExtents};
+}
+
+// Procedural geometries store the bounding boxes of their primitives as pairs of positions, matching VkAabbPositionsKHR.
+static PackedGeometry packPrimitives(const Geometry &geometry) {
+    PackedGeometry packed;
+
+    auto &layout = packed.layout;
+    layout.flags = GeometryLayout::eProcedural;
+    layout.vertexCount = static_cast<uint32_t>(geometry.primitives.size() * 2);
+    layout.primitiveCount = static_cast<uint32_t>(geometry.primitives.size());
+
+    packed.positions.reserve(geometry.primitives.size() * 2);
+    packed.attributes.resize(geometry.primitives.size() * sizeof(PrimitiveSSBO) / sizeof(uint32_t));
+    for (size_t i = 0; i < geometry.primitives.size(); ++i) {
+        const auto &primitive = geometry.primitives[i];
+
+        auto [lower, upper] = primitive.getBounds();
+        packed.positions.push_back(lower);
+        packed.positions.push_back(upper);
+
+        PrimitiveSSBO data{
+                .center = primitive.center,
+                .type = static_cast<uint32_t>(primitive.type),
+                .size = primitive.size
+        };
+        std::memcpy(packed.attributes.data() + i * sizeof(PrimitiveSSBO) / sizeof(uint32_t), &data, sizeof(data));
+    }
+
+    // Procedural geometries are not indexed, the buffer only exists to keep the bindings valid.
+    packed.indices = {0};
+
+    return packed;
+}
+
+PackedGeometry packVertices(const Geometry &geometry) {
+    PackedGeometry packed;
+
+    auto &layout = packed.layout;
+    layout.vertexCount = static_cast<uint32_t>(geometry.vertices.size());
+    layout.primitiveCount = static_cast<uint32_t>(geometry.indices.size() / 3);
+
+    bool compact = geometry.vertexLayout == VertexLayout::eCompact;
+    if (compact)
+        layout.flags |= GeometryLayout::eCompact;
+    if (geometry.hasVertexColors)
+        layout.flags |= GeometryLayout::eColor;
+
+    size_t stride = layout.getAttributeStride();
+    packed.positions.reserve(geometry.vertices.size());
+    packed.attributes.reserve(geometry.vertices.size() * stride);
+
+    for (const auto &v : geometry.vertices) {
+        packed.positions.push_back(v.pos);
+
+        if (compact) {
+            packed.attributes.push_back(glm::packSnorm2x16(octEncode(v.normal)));
+            packed.attributes.push_back(glm::packHalf2x16(v.texCoord));
+            if (geometry.hasVertexColors)
+                packed.attributes.push_back(glm::packUnorm4x8(glm::vec4(v.color, 1.F)));
+        } else {
+            for (auto value : {v.normal.x, v.normal.y, v.normal.z, v.texCoord.x, v.texCoord.y})
+                packed.attributes.push_back(glm::floatBitsToUint(value));
+            if (geometry.hasVertexColors)
+                for (auto value : {v.color.r, v.color.g, v.color.b})
+                    packed.attributes.push_back(glm::floatBitsToUint(value));
+        }
+    }
+
+    return packed;
+}
+
+PackedGeometry packGeometry(const Geometry &geometry) {
+    if (!geometry.primitives.empty())
+        return packPrimitives(geometry);
+
+    auto packed = packVertices(geometry);
+    auto &layout = packed.layout;
+
+    if (geometry.vertices.size() <= std::numeric_limits<uint16_t>::max() + size_t(1)) {
+        // Little endian, so the builds read the words as a plain uint16 array.
+        layout.flags |= GeometryLayout::eIndex16;
+        packed.indices.resize((geometry.indices.size() + 1) / 2, 0);
+        for (size_t i = 0; i < geometry.indices.size(); ++i)
+            packed.indices[i / 2] |= geometry.indices[i] << (16U * (i % 2));
+    } else {
+        packed.indices = geometry.indices;
+    }
+
+    return packed;
+}
+
+static std::shared_ptr<Geometry> buildYZPlane() {
     auto ret = std::make_shared<Geometry>();
     ret->vertices = {
             {.pos = {0, 1, 1}, .normal = {1, 0, 0}, .texCoord = {1, 0}},
@@ -307,17 +530,10 @@ std::shared_ptr<Geometry> createYZPlane(bool dynamic, NiceMaterial mat) {
             0, 2, 3
     };
 
-    ret->path = "";
-    ret->initialized = false;
-    ret->dynamic = dynamic;
-    ret->isOpaque = (mat.alpha >= 1.0F);
-    ret->matIndex = std::vector<uint32_t>(ret->indices.size(), kuafu::global::materialIndex++);
-    kuafu::global::materials.push_back(std::move(mat));      // TODO: check existing dup mat
-
     return ret;
 }
 
-std::shared_ptr<Geometry> createCube(bool dynamic, NiceMaterial mat) {
+static std::shared_ptr<Geometry> buildCube() {
     auto ret = std::make_shared<Geometry>();
 
     ret->vertices = {
@@ -361,22 +577,13 @@ std::shared_ptr<Geometry> createCube(bool dynamic, NiceMaterial mat) {
             15, 23, 16
     };
 
-    ret->path = "";
-    ret->initialized = false;
-    ret->dynamic = dynamic;
-    ret->isOpaque = (mat.alpha >= 1.0F);
-    ret->matIndex = std::vector<uint32_t>(ret->indices.size(), kuafu::global::materialIndex++);
-    kuafu::global::materials.push_back(std::move(mat));       // TODO: check existing dup mat
-
     return ret;
 }
 
 // Modified from optifuser by Fanbo
-std::shared_ptr<Geometry> createSphere(bool dynamic, NiceMaterial mat) {
+static std::shared_ptr<Geometry> buildSphere(uint32_t stacks, uint32_t slices) {
     auto ret = std::make_shared<Geometry>();
 
-    uint32_t stacks = 50;
-    uint32_t slices = 50;
     float radius = 1.f;
 
     for (uint32_t i = 1; i < stacks; ++i) {
@@ -420,13 +627,6 @@ std::shared_ptr<Geometry> createSphere(bool dynamic, NiceMaterial mat) {
         ret->indices.push_back(right);
     }
 
-    ret->path = "";
-    ret->initialized = false;
-    ret->dynamic = dynamic;
-    ret->isOpaque = (mat.alpha >= 1.0F);
-    ret->matIndex = std::vector<uint32_t>(ret->indices.size(), kuafu::global::materialIndex++);
-    kuafu::global::materials.push_back(std::move(mat));          // TODO: check existing dup mat
-
     ret->recalculateNormals();
 
     return ret;
@@ -434,8 +634,7 @@ std::shared_ptr<Geometry> createSphere(bool dynamic, NiceMaterial mat) {
 
 // Modified from svulkan2 by Fanbo
 // TODO: avoid copies
-std::shared_ptr<Geometry> createCapsule(
-        float halfLength, float radius, bool dynamic, NiceMaterial mat) {
+static std::shared_ptr<Geometry> buildCapsule(float halfLength, float radius) {
     auto ret = std::make_shared<Geometry>();
 
     int segments = 32;
@@ -526,13 +725,107 @@ std::shared_ptr<Geometry> createCapsule(
         for (int j = 0; j < 3; ++j)
             ret->indices[3 * i + j] = indices[i][j];
 
-    ret->path = "";
-    ret->initialized = false;
-    ret->dynamic = dynamic;
-    ret->isOpaque = (mat.alpha >= 1.0F);
-    ret->matIndex = std::vector<uint32_t>(ret->indices.size(), kuafu::global::materialIndex++);
-    kuafu::global::materials.push_back(std::move(mat));          // TODO: check existing dup mat
-
     return ret;
 }
+
+// Sets up a freshly built primitive with one material index per triangle, or per analytic primitive.
+static std::shared_ptr<Geometry> finishPrimitive(
+        std::shared_ptr<Geometry> geometry, bool dynamic, const NiceMaterial &material) {
+    geometry->path = "";
+    geometry->initialized = false;
+    geometry->dynamic = dynamic;
+    geometry->matIndex = std::vector<uint32_t>(
+            geometry->primitives.empty() ? geometry->indices.size() / 3 : geometry->primitives.size());
+    geometry->setMaterial(material);
+
+    return geometry;
+}
+
+std::shared_ptr<Geometry> createYZPlane(bool dynamic, NiceMaterial mat) {
+    return finishPrimitive(buildYZPlane(), dynamic, mat);
+}
+
+std::shared_ptr<Geometry> createCube(bool dynamic, NiceMaterial mat) {
+    return finishPrimitive(buildCube(), dynamic, mat);
+}
+
+std::shared_ptr<Geometry> createSphere(bool dynamic, NiceMaterial mat) {
+    return finishPrimitive(buildSphere(50, 50), dynamic, mat);
+}
+
+std::shared_ptr<Geometry> createCapsule(float halfHeight, float radius, bool dynamic, NiceMaterial mat) {
+    return finishPrimitive(buildCapsule(halfHeight, radius), dynamic, mat);
+}
+
+std::shared_ptr<Geometry> createPrimitives(const std::vector<Primitive> &primitives, bool dynamic, NiceMaterial mat) {
+    KF_ASSERT(!primitives.empty(), "A procedural geometry needs at least one primitive.");
+
+    auto ret = std::make_shared<Geometry>();
+    ret->primitives = primitives;
+
+    return finishPrimitive(ret, dynamic, mat);
+}
+
+std::shared_ptr<Geometry> createAnalyticSphere(float radius, bool dynamic, NiceMaterial mat) {
+    return createPrimitives({{.type = Primitive::Type::eSphere, .size = {radius, 0.F, 0.F}}}, dynamic, std::move(mat));
+}
+
+std::shared_ptr<Geometry> createAnalyticCapsule(float halfHeight, float radius, bool dynamic, NiceMaterial mat) {
+    return createPrimitives({{.type = Primitive::Type::eCapsule, .size = {halfHeight, radius, 0.F}}},
+                            dynamic, std::move(mat));
+}
+
+std::shared_ptr<Geometry> createAnalyticBox(const glm::vec3 &halfExtents, bool dynamic, NiceMaterial mat) {
+    return createPrimitives({{.type = Primitive::Type::eBox, .size = halfExtents}}, dynamic, std::move(mat));
+}
+
+// Shared primitives are kept as long as anything references them.
+static std::shared_ptr<Geometry> getSharedPrimitive(
+        const std::string &key, const std::function<std::shared_ptr<Geometry>()> &build) {
+    static std::mutex lock;
+    static std::unordered_map<std::string, std::weak_ptr<Geometry>> primitives;
+
+    std::lock_guard guard(lock);
+
+    if (auto it = primitives.find(key); it != primitives.end()) {
+        if (auto geometry = it->second.lock())
+            return geometry;
+    }
+
+    // Keys like the capsules' aspects are practically unbounded, entries of released primitives are dropped before the
+    // map grows.
+    std::erase_if(primitives, [](const auto &entry) { return entry.second.expired(); });
+
+    auto geometry = finishPrimitive(build(), false, {});
+    primitives[key] = geometry;
+    return geometry;
+}
+
+std::shared_ptr<Geometry> getSharedYZPlane() {
+    return getSharedPrimitive("plane", [] { return buildYZPlane(); });
+}
+
+std::shared_ptr<Geometry> getSharedCube() {
+    return getSharedPrimitive("cube", [] { return buildCube(); });
+}
+
+std::shared_ptr<Geometry> getSharedSphere(uint32_t stacks, uint32_t slices) {
+    KF_ASSERT(stacks >= 3 && slices >= 3, "A sphere needs at least 3 stacks and slices.");
+    return getSharedPrimitive(fmt::format("sphere/{}/{}", stacks, slices),
+                              [=] { return buildSphere(stacks, slices); });
+}
+
+std::shared_ptr<Geometry> getSharedCapsule(float aspect) {
+    // Capsules of nearly the same aspect share a geometry.
+    auto halfHeight = std::round(std::max(aspect, 0.F) * 1000.F) / 1000.F;
+    return getSharedPrimitive(fmt::format("capsule/{:.3f}", halfHeight),
+                              [=] { return buildCapsule(halfHeight, 1.F); });
+}
+
+void GeometryInstance::setMaterial(const NiceMaterial &m) {
+    material = global::materials().acquire(m);
+
+    if (pScene)
+        pScene->markGeometryInstanceDirty(this);
+}
 }
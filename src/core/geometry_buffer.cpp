@@ -0,0 +1,159 @@
+#include "core/geometry_buffer.hpp"
+
+namespace kuafu {
+static vk::DeviceSize alignUp(vk::DeviceSize size, vk::DeviceSize alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+void GeometryBuffer::init(vk::DeviceSize capacity) {
+    pBuffer = nullptr;
+    mAddress = 0;
+    mCapacity = alignUp(std::max(capacity, alignment), alignment);
+    mStaging.clear();
+    mPendingCopies.clear();
+
+    clear();
+}
+
+vk::DeviceSize GeometryBuffer::add(const void *data, vk::DeviceSize size) {
+    // Empty data still gets a range, so every offset identifies a range.
+    auto alignedSize = alignUp(std::max(size, alignment), alignment);
+
+    auto offset = allocate(alignedSize);
+    if (!offset) {
+        // Grow, the new space is appended to the free range at the end if there is one.
+        auto capacity = std::max(mCapacity * 2, mCapacity + alignedSize);
+        insertFreeRange(mCapacity, capacity - mCapacity);
+        mCapacity = capacity;
+
+        offset = allocate(alignedSize);
+        KF_ASSERT(offset.has_value(), "Failed to allocate {} bytes of geometry data.", alignedSize);
+    }
+
+    if (size > 0) {
+        auto stagingOffset = alignUp(mStaging.size(), alignment);
+        mStaging.resize(stagingOffset + size);
+        std::memcpy(mStaging.data() + stagingOffset, data, size);
+
+        mPendingCopies.emplace_back(stagingOffset, *offset, size);
+    }
+
+    return *offset;
+}
+
+void GeometryBuffer::free(vk::DeviceSize offset) {
+    auto it = mRanges.find(offset);
+    KF_ASSERT(it != mRanges.end(), "Freeing geometry data at {} which is not allocated.", offset);
+
+    mUsedSize -= it->second;
+    insertFreeRange(it->first, it->second);
+    mRanges.erase(it);
+}
+
+void GeometryBuffer::clear() {
+    mRanges.clear();
+    mFreeRanges.clear();
+    mUsedSize = 0;
+
+    if (mCapacity > 0)
+        mFreeRanges.emplace(0, mCapacity);
+}
+
+bool GeometryBuffer::flush(vkCore::UploadBatch &batch) {
+    bool reallocate = !pBuffer || pBuffer->getSize() != mCapacity;
+    if (!reallocate && mPendingCopies.empty())
+        return false;
+
+    // Written by transfers, read by acceleration structure builds on the compute queue and by the shaders, so the
+    // buffer is shared by all queue families instead of being handed over after every upload.
+    std::unique_ptr<vkCore::Buffer> pOldBuffer;
+    if (reallocate) {
+        pOldBuffer = std::move(pBuffer);
+        pBuffer = std::make_unique<vkCore::Buffer>();
+        pBuffer->init(mCapacity,
+                      vk::BufferUsageFlagBits::eTransferSrc |
+                      vk::BufferUsageFlagBits::eTransferDst |
+                      vk::BufferUsageFlagBits::eStorageBuffer |
+                      vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                      vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+                      vkCore::getQueueFamilyIndices(),
+                      vkCore::MemoryUsage::eDeviceLocal,
+                      true);
+
+        mAddress = vkCore::global::device.getBufferAddress(pBuffer->get());
+        KF_DEBUG("Geometry buffer reallocated: {} bytes ({} in use)", mCapacity, mUsedSize);
+    }
+
+    if (!pOldBuffer && mPendingCopies.empty())
+        return reallocate;
+
+    std::unique_ptr<vkCore::Buffer> pStagingBuffer;
+    if (!mPendingCopies.empty()) {
+        pStagingBuffer = std::make_unique<vkCore::Buffer>(
+                mStaging.size(),
+                vk::BufferUsageFlagBits::eTransferSrc,
+                std::vector<uint32_t>{vkCore::global::transferFamilyIndex},
+                vkCore::MemoryUsage::eStaging);
+
+        std::memcpy(pStagingBuffer->map(), mStaging.data(), mStaging.size());
+    }
+
+    // Moving the old content and writing the new data is part of the same batch.
+    if (pOldBuffer) {
+        batch.copyBuffer(pOldBuffer->get(), pBuffer->get(), {vk::BufferCopy(0, 0, pOldBuffer->getSize())});
+
+        // New data may be written to ranges that were freed after the old content was copied.
+        batch.barrier();
+        batch.keepAlive(std::move(pOldBuffer));
+    }
+
+    if (pStagingBuffer) {
+        batch.copyBuffer(pStagingBuffer->get(), pBuffer->get(), mPendingCopies);
+        batch.keepAlive(std::move(pStagingBuffer));
+    }
+
+    // The data is in the staging buffer now, static geometry is not kept on the host.
+    mStaging = {};
+    mPendingCopies = {};
+
+    return reallocate;
+}
+
+std::optional<vk::DeviceSize> GeometryBuffer::allocate(vk::DeviceSize size) {
+    // First fit, ranges at low offsets are reused first.
+    for (auto it = mFreeRanges.begin(); it != mFreeRanges.end(); ++it) {
+        auto [offset, freeSize] = *it;
+        if (freeSize < size)
+            continue;
+
+        mFreeRanges.erase(it);
+        if (freeSize > size)
+            mFreeRanges.emplace(offset + size, freeSize - size);
+
+        mRanges.emplace(offset, size);
+        mUsedSize += size;
+        return offset;
+    }
+
+    return std::nullopt;
+}
+
+void GeometryBuffer::insertFreeRange(vk::DeviceSize offset, vk::DeviceSize size) {
+    auto next = mFreeRanges.lower_bound(offset);
+
+    if (next != mFreeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = mFreeRanges.erase(next);
+    }
+
+    if (next != mFreeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+
+    mFreeRanges.emplace(offset, size);
+}
+}
@@ -0,0 +1,137 @@
+#include "stdafx.hpp"
+#include "core/material.hpp"
+
+namespace kuafu {
+bool operator==(const NiceMaterial &m1, const NiceMaterial &m2) {   // C++20 should allow defaulting this
+    return (m1.diffuseColor == m2.diffuseColor) &&
+           (m1.alpha == m2.alpha) &&
+           (m1.diffuseTexPath == m2.diffuseTexPath) &&
+           (m1.metallicTexPath == m2.metallicTexPath) &&
+           (m1.roughnessTexPath == m2.roughnessTexPath) &&
+           (m1.transmissionTexPath == m2.transmissionTexPath) &&
+           (m1.transmission == m2.transmission) &&
+           (m1.metallic == m2.metallic) &&
+           (m1.specular == m2.specular) &&
+           (m1.roughness == m2.roughness) &&
+           (m1.ior == m2.ior) &&
+           (m1.emission == m2.emission) &&
+           (m1.emissionStrength == m2.emissionStrength);
+}
+
+MaterialHandle::MaterialHandle(const MaterialHandle &other) : pRegistry(other.pRegistry), mIndex(other.mIndex) {
+    if (pRegistry != nullptr)
+        pRegistry->retain(mIndex);
+}
+
+MaterialHandle::MaterialHandle(MaterialHandle &&other) noexcept : pRegistry(other.pRegistry), mIndex(other.mIndex) {
+    other.pRegistry = nullptr;
+    other.mIndex = invalid;
+}
+
+MaterialHandle &MaterialHandle::operator=(MaterialHandle other) noexcept {
+    std::swap(pRegistry, other.pRegistry);
+    std::swap(mIndex, other.mIndex);
+    return *this;
+}
+
+MaterialHandle::~MaterialHandle() {
+    if (pRegistry != nullptr)
+        pRegistry->release(mIndex);
+}
+
+MaterialHandle MaterialRegistry::acquire(const NiceMaterial &material) {
+    auto key = getKey(material);
+
+    if (auto it = mIndices.find(key); it != mIndices.end()) {
+        retain(it->second);
+        return {this, it->second};
+    }
+
+    uint32_t index;
+    if (!mFreeSlots.empty()) {
+        index = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    } else {
+        index = static_cast<uint32_t>(mSlots.size());
+        mSlots.emplace_back();
+    }
+
+    mSlots[index] = {material, key, 1};
+    mIndices.emplace(key, index);
+    ++mVersion;
+
+    return {this, index};
+}
+
+size_t MaterialRegistry::KeyHash::operator()(const Key &key) const {
+    size_t seed = 0;
+    auto combine = [&seed](size_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6U) + (seed >> 2U);
+    };
+
+    for (auto texture : key.textures)
+        combine(std::hash<uint32_t>()(texture));
+    for (auto scalar : key.scalars)
+        combine(std::hash<int32_t>()(scalar));
+
+    return seed;
+}
+
+MaterialRegistry::Key MaterialRegistry::getKey(const NiceMaterial &material) {
+    auto quantize = [](float value) {
+        auto scaled = std::round(static_cast<double>(value) * quantization);
+        return static_cast<int32_t>(std::clamp(
+                scaled,
+                static_cast<double>(std::numeric_limits<int32_t>::min()),
+                static_cast<double>(std::numeric_limits<int32_t>::max())));
+    };
+
+    return {
+            .textures = {
+                    getTextureId(material.diffuseTexPath),
+                    getTextureId(material.metallicTexPath),
+                    getTextureId(material.roughnessTexPath),
+                    getTextureId(material.transmissionTexPath)
+            },
+            .scalars = {
+                    quantize(material.diffuseColor.r),
+                    quantize(material.diffuseColor.g),
+                    quantize(material.diffuseColor.b),
+                    quantize(material.alpha),
+                    quantize(material.metallic),
+                    quantize(material.specular),
+                    quantize(material.roughness),
+                    quantize(material.ior),
+                    quantize(material.transmission),
+                    quantize(material.emission.r),
+                    quantize(material.emission.g),
+                    quantize(material.emission.b),
+                    quantize(material.emissionStrength)
+            }
+    };
+}
+
+uint32_t MaterialRegistry::getTextureId(const std::string &path) {
+    if (path.empty())
+        return 0;
+
+    auto [it, inserted] = mTextureIds.try_emplace(path, static_cast<uint32_t>(mTextureIds.size() + 1));
+    return it->second;
+}
+
+void MaterialRegistry::retain(uint32_t index) {
+    ++mSlots[index].refCount;
+}
+
+void MaterialRegistry::release(uint32_t index) {
+    auto &slot = mSlots[index];
+    KF_ASSERT(slot.refCount > 0, "Releasing material {} which is not referenced.", index);
+
+    if (--slot.refCount > 0)
+        return;
+
+    mIndices.erase(slot.key);
+    slot.material = {};
+    mFreeSlots.push_back(index);
+}
+}
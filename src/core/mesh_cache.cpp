@@ -0,0 +1,340 @@
+#include "core/mesh_cache.hpp"
+
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kuafu::meshcache {
+namespace {
+constexpr std::array<char, 4> magic = {'K', 'F', 'M', 'C'};
+constexpr uint32_t formatVersion = 3;
+constexpr size_t alignment = 16;
+
+struct Header {
+    std::array<char, 4> magic;
+    uint32_t version;
+    uint32_t vertexSize;        ///< Entries written with a different vertex layout are ignored.
+    uint32_t flags;
+    int64_t modificationTime;
+    uint64_t fileSize;
+    uint32_t pathLength;
+    uint32_t materialCount;
+    uint32_t meshCount;
+    uint32_t optimized;
+};
+
+struct MaterialRecord {
+    std::array<float, 3> diffuseColor;
+    float alpha;
+    float metallic;
+    float specular;
+    float roughness;
+    float ior;
+    float transmission;
+    std::array<float, 3> emission;
+    float emissionStrength;
+    std::array<uint32_t, 4> texPathLengths;
+};
+
+struct MeshRecord {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+    uint32_t hasColors;
+};
+
+/// Identifies the version of a mesh file the cache entry was created from.
+struct FileStamp {
+    int64_t modificationTime = 0;
+    uint64_t fileSize = 0;
+};
+
+std::optional<FileStamp> getStamp(const std::filesystem::path &path) {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return std::nullopt;
+
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return std::nullopt;
+
+    return FileStamp{static_cast<int64_t>(time.time_since_epoch().count()), static_cast<uint64_t>(size)};
+}
+
+std::filesystem::path getEntryPath(const std::filesystem::path &path, uint32_t flags, bool optimized) {
+    auto hash = std::hash<std::string>()(path.string()) ^ (std::hash<uint32_t>()(flags) << 1U) ^ (optimized ? 1U : 0U);
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".kfmesh";
+    return std::filesystem::path(global::meshCachePath) / name.str();
+}
+
+/// Reads a memory mapped entry front to back, every read is bounds checked.
+class Reader {
+public:
+    Reader(const char *data, size_t size) : pData(data), mSize(size) {}
+
+    template<typename T>
+    bool read(T &value) {
+        if (mOffset + sizeof(T) > mSize)
+            return false;
+
+        std::memcpy(&value, pData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    bool read(std::string &value, size_t length) {
+        if (mOffset + length > mSize)
+            return false;
+
+        value.assign(pData + mOffset, length);
+        mOffset += length;
+        return true;
+    }
+
+    template<typename T>
+    bool readAt(std::vector<T> &values, uint64_t offset, size_t count) {
+        if (offset > mSize || count > (mSize - offset) / sizeof(T))
+            return false;
+
+        values.resize(count);
+        std::memcpy(values.data(), pData + offset, count * sizeof(T));
+        return true;
+    }
+
+private:
+    const char *pData;
+    size_t mSize;
+    size_t mOffset = 0;
+};
+
+class Writer {
+public:
+    template<typename T>
+    void write(const T &value) {
+        auto bytes = reinterpret_cast<const char *>(&value);
+        mData.insert(mData.end(), bytes, bytes + sizeof(T));
+    }
+
+    void write(const std::string &value) { mData.insert(mData.end(), value.begin(), value.end()); }
+
+    /// Appends an array at an aligned offset.
+    /// @return Returns the array's offset.
+    template<typename T>
+    uint64_t writeArray(const std::vector<T> &values) {
+        mData.resize((mData.size() + alignment - 1) / alignment * alignment);
+
+        uint64_t offset = mData.size();
+        auto bytes = reinterpret_cast<const char *>(values.data());
+        mData.insert(mData.end(), bytes, bytes + values.size() * sizeof(T));
+        return offset;
+    }
+
+    /// Overwrites a previously written value.
+    template<typename T>
+    void patch(size_t offset, const T &value) { std::memcpy(mData.data() + offset, &value, sizeof(T)); }
+
+    [[nodiscard]] inline size_t size() const { return mData.size(); }
+
+    [[nodiscard]] inline const auto &data() const { return mData; }
+
+private:
+    std::vector<char> mData;
+};
+
+std::optional<ImportedScene> parse(const char *data, size_t size, const std::filesystem::path &path,
+                                   uint32_t flags, bool optimized, const FileStamp &stamp) {
+    Reader reader(data, size);
+
+    Header header{};
+    if (!reader.read(header) ||
+        header.magic != magic ||
+        header.version != formatVersion ||
+        header.vertexSize != sizeof(Vertex) ||
+        header.flags != flags ||
+        (header.optimized != 0) != optimized ||
+        header.modificationTime != stamp.modificationTime ||
+        header.fileSize != stamp.fileSize)
+        return std::nullopt;
+
+    // The file name is a hash, make sure the entry actually belongs to the file.
+    std::string entryPath;
+    if (!reader.read(entryPath, header.pathLength) || entryPath != path.string())
+        return std::nullopt;
+
+    ImportedScene scene;
+    scene.materials.resize(header.materialCount);
+    for (auto &material : scene.materials) {
+        MaterialRecord record{};
+        if (!reader.read(record))
+            return std::nullopt;
+
+        material.diffuseColor = {record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]};
+        material.alpha = record.alpha;
+        material.metallic = record.metallic;
+        material.specular = record.specular;
+        material.roughness = record.roughness;
+        material.ior = record.ior;
+        material.transmission = record.transmission;
+        material.emission = {record.emission[0], record.emission[1], record.emission[2]};
+        material.emissionStrength = record.emissionStrength;
+
+        if (!reader.read(material.diffuseTexPath, record.texPathLengths[0]) ||
+            !reader.read(material.metallicTexPath, record.texPathLengths[1]) ||
+            !reader.read(material.roughnessTexPath, record.texPathLengths[2]) ||
+            !reader.read(material.transmissionTexPath, record.texPathLengths[3]))
+            return std::nullopt;
+    }
+
+    scene.meshes.resize(header.meshCount);
+    for (auto &mesh : scene.meshes) {
+        MeshRecord record{};
+        if (!reader.read(record) ||
+            record.materialIndex >= header.materialCount ||
+            !reader.readAt(mesh.vertices, record.vertexOffset, record.vertexCount) ||
+            !reader.readAt(mesh.indices, record.indexOffset, record.indexCount))
+            return std::nullopt;
+
+        mesh.materialIndex = record.materialIndex;
+        mesh.hasColors = record.hasColors != 0;
+    }
+
+    return scene;
+}
+}
+
+std::optional<ImportedScene> load(const std::filesystem::path &path, uint32_t flags, bool optimized) {
+    if (global::meshCachePath.empty())
+        return std::nullopt;
+
+    auto stamp = getStamp(path);
+    if (!stamp)
+        return std::nullopt;
+
+    auto entryPath = getEntryPath(path, flags, optimized);
+    int fd = ::open(entryPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    auto size = static_cast<size_t>(info.st_size);
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return std::nullopt;
+
+    auto scene = parse(static_cast<const char *>(data), size, path, flags, optimized, *stamp);
+    ::munmap(data, size);
+
+    if (scene)
+        KF_DEBUG("Loaded {} from the mesh cache.", path.string());
+
+    return scene;
+}
+
+void store(const std::filesystem::path &path, uint32_t flags, bool optimized, const ImportedScene &scene) {
+    if (global::meshCachePath.empty())
+        return;
+
+    auto stamp = getStamp(path);
+    if (!stamp)
+        return;
+
+    Writer writer;
+
+    auto pathString = path.string();
+    writer.write(Header{
+            .magic = magic,
+            .version = formatVersion,
+            .vertexSize = sizeof(Vertex),
+            .flags = flags,
+            .modificationTime = stamp->modificationTime,
+            .fileSize = stamp->fileSize,
+            .pathLength = static_cast<uint32_t>(pathString.size()),
+            .materialCount = static_cast<uint32_t>(scene.materials.size()),
+            .meshCount = static_cast<uint32_t>(scene.meshes.size()),
+            .optimized = optimized ? 1U : 0U
+    });
+    writer.write(pathString);
+
+    for (const auto &material : scene.materials) {
+        writer.write(MaterialRecord{
+                .diffuseColor = {material.diffuseColor.r, material.diffuseColor.g, material.diffuseColor.b},
+                .alpha = material.alpha,
+                .metallic = material.metallic,
+                .specular = material.specular,
+                .roughness = material.roughness,
+                .ior = material.ior,
+                .transmission = material.transmission,
+                .emission = {material.emission.r, material.emission.g, material.emission.b},
+                .emissionStrength = material.emissionStrength,
+                .texPathLengths = {
+                        static_cast<uint32_t>(material.diffuseTexPath.size()),
+                        static_cast<uint32_t>(material.metallicTexPath.size()),
+                        static_cast<uint32_t>(material.roughnessTexPath.size()),
+                        static_cast<uint32_t>(material.transmissionTexPath.size())
+                }
+        });
+        writer.write(material.diffuseTexPath);
+        writer.write(material.metallicTexPath);
+        writer.write(material.roughnessTexPath);
+        writer.write(material.transmissionTexPath);
+    }
+
+    // Mesh records are patched once the arrays they point to are written.
+    auto recordsOffset = writer.size();
+    for (size_t i = 0; i < scene.meshes.size(); ++i)
+        writer.write(MeshRecord{});
+
+    for (size_t i = 0; i < scene.meshes.size(); ++i) {
+        const auto &mesh = scene.meshes[i];
+        MeshRecord record{
+                .vertexOffset = writer.writeArray(mesh.vertices),
+                .indexOffset = writer.writeArray(mesh.indices),
+                .vertexCount = static_cast<uint32_t>(mesh.vertices.size()),
+                .indexCount = static_cast<uint32_t>(mesh.indices.size()),
+                .materialIndex = mesh.materialIndex,
+                .hasColors = mesh.hasColors ? 1U : 0U
+        };
+        writer.patch(recordsOffset + i * sizeof(MeshRecord), record);
+    }
+
+    // Write to a temporary file first, so concurrent readers never see a partial entry.
+    std::error_code ec;
+    std::filesystem::create_directories(global::meshCachePath, ec);
+
+    auto entryPath = getEntryPath(path, flags, optimized);
+    auto tmpPath = entryPath;
+    tmpPath += ".tmp" + std::to_string(::getpid());
+
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(writer.data().data(), static_cast<std::streamsize>(writer.size()));
+        if (!file) {
+            KF_WARN("Failed to write the mesh cache entry for {}.", path.string());
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, entryPath, ec);
+    if (ec) {
+        KF_WARN("Failed to write the mesh cache entry for {}: {}", path.string(), ec.message());
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+}
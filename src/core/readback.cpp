@@ -0,0 +1,76 @@
+#include "core/readback.hpp"
+#include "core/context/global.hpp"
+
+namespace kuafu {
+bool Readback::ready() const {
+    return submitted() && vkCore::global::device.getSemaphoreCounterValue(pBuffer->semaphore) >= pBuffer->value;
+}
+
+void Readback::wait() const {
+    KF_ASSERT(submitted(), "Waiting for a readback whose frame has not been rendered yet!");
+
+    vk::SemaphoreWaitInfo waitInfo({}, 1, &pBuffer->semaphore, &pBuffer->value);
+    auto result = vkCore::global::device.waitSemaphores(waitInfo, UINT64_MAX);
+    KF_ASSERT(result == vk::Result::eSuccess, "Failed to wait for readback");
+}
+
+std::vector<uint8_t> Readback::get(Channel channel) const {
+    auto pixels = data(channel);
+    return {pixels, pixels + getSize(channel)};
+}
+
+const uint8_t *Readback::data(Channel channel) const {
+    KF_ASSERT(hasChannel(channel), "Trying to access a channel that was not read back!");
+
+    wait();
+    return pBuffer->pData + mRegions[getChannelIndex(channel)].offset;
+}
+
+size_t Readback::getChannelIndex(Channel channel) {
+    KF_ASSERT(channel != 0 && (channel & (channel - 1)) == 0, "Invalid readback channel: {}", channel);
+
+    size_t index = 0;
+    while ((channel >> index) != 1U)
+        ++index;
+
+    KF_ASSERT(index < channelCount, "Invalid readback channel: {}", channel);
+    return index;
+}
+
+std::shared_ptr<ReadbackBuffer> ReadbackRing::acquire(vk::DeviceSize size) {
+    for (size_t i = 0; i < mBuffers.size(); ++i) {
+        auto &buffer = mBuffers[(mNext + i) % mBuffers.size()];
+
+        // Still referenced by a readback handle.
+        if (buffer.use_count() > 1)
+            continue;
+
+        // Released before its copy was done.
+        if (buffer->value != 0 &&
+            vkCore::global::device.getSemaphoreCounterValue(buffer->semaphore) < buffer->value)
+            continue;
+
+        mNext = (mNext + i + 1) % mBuffers.size();
+
+        if (buffer->buffer.getSize() < size) {
+            buffer->buffer.init(size, vk::BufferUsageFlagBits::eTransferDst, {vkCore::global::graphicsFamilyIndex},
+                                vkCore::MemoryUsage::eReadback);
+            buffer->pData = static_cast<const uint8_t *>(buffer->buffer.map());
+        }
+
+        buffer->value = 0;
+        return buffer;
+    }
+
+    // All buffers are in use, grow the ring.
+    auto buffer = std::make_shared<ReadbackBuffer>();
+    buffer->buffer.init(size, vk::BufferUsageFlagBits::eTransferDst, {vkCore::global::graphicsFamilyIndex},
+                        vkCore::MemoryUsage::eReadback);
+    buffer->pData = static_cast<const uint8_t *>(buffer->buffer.map());
+
+    mBuffers.push_back(buffer);
+    KF_DEBUG("Readback buffers: {}", mBuffers.size());
+
+    return buffer;
+}
+}
@@ -31,33 +31,32 @@ void AccelerationStructure::destroy() {
     if (buffer)
         vkCore::global::device.destroyBuffer(buffer);
 
-    if (memory)
-        vkCore::global::device.freeMemory(memory);
+    memory = nullptr;
 }
 
 auto initAccelerationStructure(vk::AccelerationStructureCreateInfoKHR &asCreateInfo) -> AccelerationStructure {
     kuafu::AccelerationStructure resultAs;
 
-    vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+    // Bottom level structures are built on the compute queue and traced on the graphics queue.
+    std::vector<uint32_t> queueFamilyIndices = {vkCore::global::graphicsFamilyIndex};
+    if (vkCore::global::computeFamilyIndex != vkCore::global::graphicsFamilyIndex)
+        queueFamilyIndices.push_back(vkCore::global::computeFamilyIndex);
 
     vk::BufferCreateInfo createInfo(
             {},                                                                                                       // flags
             asCreateInfo.size,                                                                                         // size
             vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
             vk::BufferUsageFlagBits::eShaderDeviceAddress, // usage
-            vk::SharingMode::eExclusive,                                                                               // sharingMode
-            1,                                                                                                         // queueFamilyIndexCount
-            &vkCore::global::graphicsFamilyIndex);                                                                    // pQueueFamilyIndices
+            queueFamilyIndices.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,               // sharingMode
+            static_cast<uint32_t>(queueFamilyIndices.size()),                                                         // queueFamilyIndexCount
+            queueFamilyIndices.data());                                                                               // pQueueFamilyIndices
 
     resultAs.buffer = vkCore::global::device.createBuffer(createInfo);
 //        KF_ASSERT( resultAs.buffer, "Failed to create buffer." );
 
-    resultAs.memory = vkCore::allocateMemory(resultAs.buffer,
-                                             vk::MemoryPropertyFlagBits::eDeviceLocal |
-                                             vk::MemoryPropertyFlagBits::eHostCoherent,
-                                             &allocateFlags);
-
-    vkCore::global::device.bindBufferMemory(resultAs.buffer, resultAs.memory, 0);
+    // Suballocated with the alignment acceleration structures require.
+    resultAs.memory = std::make_shared<vkCore::Allocation>(
+            vkCore::allocateBufferMemory(resultAs.buffer, vkCore::MemoryUsage::eAccelerationStructure, true));
 
     asCreateInfo.buffer = resultAs.buffer;
 
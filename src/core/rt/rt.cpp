@@ -25,6 +25,14 @@
 #include "core/config.hpp"
 
 namespace kuafu {
+constexpr uint32_t poseGroupSize = 64; ///< The local size of InstancePoses.comp.
+constexpr uint32_t timestampsPerFrame = 3; ///< Start, after the TLAS build and after the trace.
+constexpr size_t telemetryHistory = 256; ///< The number of frames RayTracer::getTelemetry() keeps.
+
+/// Deformed geometries are rebuilt in the frame's command buffer, so their builds favor speed.
+constexpr vk::BuildAccelerationStructureFlagsKHR dynamicBlasFlags =
+        vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate | vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastBuild;
+
 RayTracer::~RayTracer() {
     destroy();
 }
@@ -36,15 +44,38 @@ void RayTracer::init() {
             vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
     mCapabilities.pipelineProperties = pipelineProperties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
     mCapabilities.accelerationStructureProperties = pipelineProperties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+
+    vk::SemaphoreTypeCreateInfo timelineCreateInfo(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphoreCreateInfo;
+    semaphoreCreateInfo.pNext = &timelineCreateInfo;
+
+    mBlasSemaphore = vkCore::global::device.createSemaphoreUnique(semaphoreCreateInfo);
+    mBlasValue = 0;
+
+    auto limits = vkCore::global::physicalDevice.getProperties().limits;
+    mTimestampPeriod = limits.timestampComputeAndGraphics ? limits.timestampPeriod : 0.0F;
 }
 
 void RayTracer::destroy() {
 //    vkCore::global::device.waitIdle();
 
-    for (Blas &blas : mBlas)
+    for (auto &[geometry, blas] : mBlas)
         blas.as.destroy();
     mTlas.as.destroy();
+    mTlas.as = {};
     mBlas.clear();
+
+    for (auto &release : mFrameReleases)
+        for (auto &as : release.structures)
+            as.destroy();
+    mFrameReleases.clear();
+    mBlasBuilds.clear();
+
+    mBlasSemaphore.reset();
+    mBlasValue = 0;
+
+    mTimestampPool.reset();
+    mTimestamps.clear();
 }
 
 
@@ -53,7 +84,7 @@ auto RayTracer::createDummyBlas() const {
     vk::AccelerationStructureGeometryTrianglesDataKHR trianglesData(
             Vertex::getVertexPositionFormat(),
             nullptr,
-            sizeof(Vertex),
+            sizeof(glm::vec3),
             0,
             vk::IndexType::eUint32,
             nullptr,
@@ -77,31 +108,29 @@ auto RayTracer::createDummyBlas() const {
 }
 
 
-auto RayTracer::modelToBlas(const vkCore::StorageBuffer<Vertex> &vertexBuffer,
-                            const vkCore::StorageBuffer<uint32_t> &indexBuffer, bool opaque) const {
-    // Using index 0, because there are no copies of these buffers.
-    vk::BufferDeviceAddressInfo vertexAddressInfo(vertexBuffer.get(0));
-    vk::BufferDeviceAddressInfo indexAddressInfo(indexBuffer.get(0));
-
-    vk::DeviceAddress vertexAddress = vkCore::global::device.getBufferAddress(vertexAddressInfo);
-    vk::DeviceAddress indexAddress = vkCore::global::device.getBufferAddress(indexAddressInfo);
-
-    vk::AccelerationStructureGeometryTrianglesDataKHR trianglesData(
-            Vertex::getVertexPositionFormat(),
-            vertexAddress,
-            sizeof(Vertex),
-            vertexBuffer.getCount(),
-            vk::IndexType::eUint32,
-            indexAddress,
-            {});
-
-    vk::AccelerationStructureGeometryKHR asGeom(
-            vk::GeometryTypeKHR::eTriangles,
-            trianglesData,
-            opaque ? vk::GeometryFlagBitsKHR::eOpaque
-                   : vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation);
+auto RayTracer::modelToBlas(vk::DeviceAddress positionAddress, vk::DeviceAddress indexAddress,
+                            const GeometryLayout &layout, bool opaque) const {
+    vk::GeometryFlagsKHR geometryFlags = opaque ? vk::GeometryFlagBitsKHR::eOpaque
+                                                : vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation;
+
+    vk::AccelerationStructureGeometryKHR asGeom;
+    if (layout.flags & GeometryLayout::eProcedural) {
+        // The positions of procedural geometries are pairs of bounding box corners.
+        vk::AccelerationStructureGeometryAabbsDataKHR aabbsData(positionAddress, sizeof(vk::AabbPositionsKHR));
+        asGeom = vk::AccelerationStructureGeometryKHR(vk::GeometryTypeKHR::eAabbs, aabbsData, geometryFlags);
+    } else {
+        vk::AccelerationStructureGeometryTrianglesDataKHR trianglesData(
+                Vertex::getVertexPositionFormat(),
+                positionAddress,
+                sizeof(glm::vec3),
+                layout.vertexCount,
+                layout.getIndexType(),
+                indexAddress,
+                {});
+        asGeom = vk::AccelerationStructureGeometryKHR(vk::GeometryTypeKHR::eTriangles, trianglesData, geometryFlags);
+    }
 
-    vk::AccelerationStructureBuildRangeInfoKHR offset(indexBuffer.getCount() / 3,
+    vk::AccelerationStructureBuildRangeInfoKHR offset(layout.primitiveCount,
                                                       0,
                                                       0,
                                                       0);
@@ -114,12 +143,13 @@ auto RayTracer::modelToBlas(const vkCore::StorageBuffer<Vertex> &vertexBuffer,
 }
 
 auto RayTracer::geometryInstanceToAccelerationStructureInstance(
-        std::shared_ptr<GeometryInstance> &geometryInstance) {
+        const std::shared_ptr<GeometryInstance> &geometryInstance) -> vk::AccelerationStructureInstanceKHR {
     KF_ASSERT(geometryInstance->geometryIndex >= 0, "Invalid geometry instance!");
-    KF_ASSERT(static_cast<int>(mBlas.size()) > geometryInstance->geometryIndex,
-              "Geometry index is out of bounds. "
+    auto it = mBlas.find(geometryInstance->geometry.get());
+    KF_ASSERT(it != mBlas.end(),
+              "No acceleration structure for this geometry. "
               "Hint for SAPIEN users: Are you creating two active renders?");
-    Blas &blas{mBlas[geometryInstance->geometryIndex]};
+    Blas &blas{it->second};
 
     vk::AccelerationStructureDeviceAddressInfoKHR addressInfo(blas.as.as);
     vk::DeviceAddress blasAddress = vkCore::global::device.getAccelerationStructureAddressKHR(addressInfo);
@@ -130,63 +160,112 @@ auto RayTracer::geometryInstanceToAccelerationStructureInstance(
             {},                                                         // transform
             geometryInstance->geometryIndex,                             // instanceCustomIndex
             0xFF,                                                        // mask
-            0,                                                           // instanceShaderBindingTableRecordOffset
+            geometryInstance->geometry->primitives.empty() ? 0 : 1,      // instanceShaderBindingTableRecordOffset
             vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable, // flags
             blasAddress);                                               // accelerationStructureReference
 
     memcpy(reinterpret_cast<glm::mat4 *>(&gInst.transform), &transpose, sizeof(gInst.transform));
 
+    // The instance's material decides whether the any hit shader has to run.
+    if (geometryInstance->material.valid())
+        gInst.flags |= static_cast<VkGeometryInstanceFlagsKHR>(
+                global::materials()[geometryInstance->material.getIndex()].alpha >= 1.F
+                ? vk::GeometryInstanceFlagBitsKHR::eForceOpaque
+                : vk::GeometryInstanceFlagBitsKHR::eForceNoOpaque);
+
     return gInst;
 }
 
-void RayTracer::createBottomLevelAS(std::vector<vkCore::StorageBuffer<Vertex>> &vertexBuffers,
-                                    const std::vector<vkCore::StorageBuffer<uint32_t>> &indexBuffers,
-                                    const std::vector<std::shared_ptr<Geometry>> &geometries) {
-    KF_ASSERT(!vertexBuffers.empty(),
+bool RayTracer::updateBottomLevelAS(const GeometryBuffer &geometryBuffer,
+                                    const std::unordered_map<const Geometry *, GeometryAllocation> &allocations,
+                                    const std::vector<std::shared_ptr<Geometry>> &geometries,
+                                    const vkCore::UploadBatch &uploads) {
+    KF_ASSERT(!geometries.empty(),
               "Failed to build bottom level acceleration structures because no geometry was provided.");
 
-    // Clean up previous acceleration structures and free all memory.
-    destroy();
+    // Drop acceleration structures of geometries that left the scene or went stale.
+    std::unordered_set<const Geometry *> alive;
+    alive.reserve(geometries.size());
+    for (const auto &geometry : geometries)
+        if (geometry)
+            alive.insert(geometry.get());
+
+    std::vector<AccelerationStructure> cleanupAS;
+    for (auto it = mBlas.begin(); it != mBlas.end();) {
+        const Geometry *geometry = it->first;
+        const Blas &blas = it->second;
+        bool stale = !alive.contains(geometry) ||
+                     blas.version != geometry->version ||
+                     blas.opaque != geometry->isOpaque ||
+                     blas.hidden != geometry->hideRender;
+
+        if (stale) {
+            cleanupAS.push_back(blas.as);
+            it = mBlas.erase(it);
+        } else
+            ++it;
+    }
+
+    // The frames in flight might still trace against these.
+    for (auto &as : cleanupAS)
+        retire(as);
+
+    // Prepare acceleration structures for new geometries only. Dynamic geometries are built to be refit right away.
+    std::vector<const Geometry *> pending;
+    std::vector<const Geometry *> pendingDynamic;
+    for (const auto &geometry : geometries) {
+        if (!geometry || mBlas.contains(geometry.get()))
+            continue;
+
+        const auto &allocation = allocations.at(geometry.get());
+        Blas blas = geometry->hideRender ? createDummyBlas()
+                                         : modelToBlas(geometryBuffer.getAddress(allocation.positionOffset),
+                                                       geometryBuffer.getAddress(allocation.indexOffset),
+                                                       allocation.layout, geometry->isOpaque);
+        blas.version = geometry->version;
+        blas.opaque = geometry->isOpaque;
+        blas.hidden = geometry->hideRender;
+
+        mBlas[geometry.get()] = std::move(blas);
+        (geometry->dynamic ? pendingDynamic : pending).push_back(geometry.get());
+    }
 
-    mBlas.reserve(vertexBuffers.size());
+    if (!pending.empty())
+        buildBlas(pending, uploads,
+                  vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction |
+                  vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
 
-    for (size_t i = 0; i < vertexBuffers.size(); ++i)
-        if (i < geometries.size())
-            if (geometries[i])
-                mBlas.push_back(geometries[i]->hideRender ? createDummyBlas()
-                                : modelToBlas(vertexBuffers[i], indexBuffers[i], geometries[i]->isOpaque));
+    if (!pendingDynamic.empty())
+        buildBlas(pendingDynamic, uploads, dynamicBlasFlags);
 
-    buildBlas(vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction |
-              vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    return !cleanupAS.empty() || !pending.empty() || !pendingDynamic.empty();
 }
 
-void RayTracer::buildBlas(vk::BuildAccelerationStructureFlagsKHR flags) {
-    KF_DEBUG("Rebuilding BLAS... This is very heavy!");
+void RayTracer::buildBlas(const std::vector<const Geometry *> &geometries, const vkCore::UploadBatch &uploads,
+                          vk::BuildAccelerationStructureFlagsKHR flags) {
+    KF_DEBUG("Building {} BLAS...", geometries.size());
 
-    uint32_t blasCount = static_cast<uint32_t>(mBlas.size());
+    uint32_t blasCount = static_cast<uint32_t>(geometries.size());
 
     bool doCompaction = (flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction) ==
                         vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
 
     vk::DeviceSize maxScratch = 0; // Largest scratch buffer for our BLAS
 
-    std::vector<vk::DeviceSize> originalSizes;
-    originalSizes.resize(mBlas.size());
-
     std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos;
-    buildInfos.reserve(mBlas.size());
+    buildInfos.reserve(blasCount);
+
+    BlasBuild build;
 
     // Iterate over the groups of geometries, creating one BLAS for each group
-    int index = 0;
-    for (Blas &blas : mBlas) {
-        if (blas.as.as)
-            vkCore::global::device.destroyAccelerationStructureKHR(blas.as.as);
+    for (const Geometry *geometry : geometries) {
+        Blas &blas = mBlas.at(geometry);
 
-        if (blas.as.memory)
-            vkCore::global::device.freeMemory(blas.as.memory);
+        // Frames in flight might still trace against the structure that is replaced.
+        if (blas.as.as)
+            retire(blas.as);
 
-        if (blas.as.buffer)
-            vkCore::global::device.destroyBuffer(blas.as.buffer);
+        blas.as = {};
 
         vk::AccelerationStructureBuildGeometryInfoKHR buildInfo(
                 vk::AccelerationStructureTypeKHR::eBottomLevel,   // type
@@ -226,38 +305,40 @@ void RayTracer::buildBlas(vk::BuildAccelerationStructureFlagsKHR flags) {
         buildInfo.dstAccelerationStructure = blas.as.as;
 
         maxScratch = std::max(maxScratch, sizeInfo.buildScratchSize);
-        originalSizes[index] = sizeInfo.accelerationStructureSize;
 
-        buildInfos.push_back(buildInfo);
+        blas.updatable = (flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate) ==
+                         vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+        blas.refitCount = 0;
+        blas.scratchSize = std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize);
 
-        ++index;
+        buildInfos.push_back(buildInfo);
+        build.structures.push_back({geometry, blas.as.as, sizeInfo.accelerationStructureSize});
     }
 
     // Allocate the scratch buffers holding the temporary data of the acceleration structure builder.
     vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
 
-    vkCore::Buffer scratchBuffer(
+    build.scratchBuffer = std::make_shared<vkCore::Buffer>(
             maxScratch,                                                                              // size
             vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer, // usage
-            {vkCore::global::graphicsFamilyIndex},                                                 // queueFamilyIndices
+            std::vector<uint32_t>{vkCore::global::computeFamilyIndex},                              // queueFamilyIndices
             vk::MemoryPropertyFlagBits::eDeviceLocal,                                                // memoryPropertyFlags
             &allocateFlags);
 
-    vk::BufferDeviceAddressInfo bufferInfo(scratchBuffer.get());
+    vk::BufferDeviceAddressInfo bufferInfo(build.scratchBuffer->get());
     vk::DeviceAddress scratchAddress = vkCore::global::device.getBufferAddress(&bufferInfo);
 
-    // Query size of compact BLAS.
-    vk::UniqueQueryPool queryPool = vkCore::initQueryPoolUnique(blasCount,
-                                                                vk::QueryType::eAccelerationStructureCompactedSizeKHR);
+    // Query size of compact BLAS, they are read back once the builds finished, see collectBlasBuilds().
+    if (doCompaction)
+        build.queryPool = vkCore::initQueryPoolUnique(blasCount, vk::QueryType::eAccelerationStructureCompactedSizeKHR);
 
-    // Create a command buffer containing all the BLAS builds.
-    vk::UniqueCommandPool commandPool = vkCore::initCommandPoolUnique({vkCore::global::graphicsFamilyIndex});
-    int ctr = 0;
+    // Create a command buffer containing all the BLAS builds, they run on the compute queue instead of next to the traces.
+    build.commandPool = vkCore::initCommandPoolUnique({vkCore::global::computeFamilyIndex});
 
-    vkCore::CommandBuffer cmdBuf(commandPool.get(), blasCount);
+    vkCore::CommandBuffer cmdBuf(build.commandPool.get(), blasCount);
 
-    index = 0;
-    for (Blas &blas : mBlas) {
+    for (uint32_t index = 0; index < blasCount; ++index) {
+        Blas &blas = mBlas.at(geometries[index]);
         buildInfos[index].scratchData.deviceAddress = scratchAddress;
 
         std::vector<const vk::AccelerationStructureBuildRangeInfoKHR *> pBuildRangeInfos(
@@ -291,149 +372,458 @@ void RayTracer::buildBlas(vk::BuildAccelerationStructureFlagsKHR flags) {
         if (doCompaction) {
             // After query pool creation, each query must be reset before it is used. Queries must also be reset between uses.
             // https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/vkCmdResetQueryPool.html
-            cmdBuf.get(index).resetQueryPool(queryPool.get(), index, 1);
+            cmdBuf.get(index).resetQueryPool(build.queryPool.get(), index, 1);
 
             cmdBuf.get(index).writeAccelerationStructuresPropertiesKHR(
                     1,                                                     // accelerationStructureCount
                     &blas.as.as,                                           // pAccelerationStructures
                     vk::QueryType::eAccelerationStructureCompactedSizeKHR, // queryType
-                    queryPool.get(),                                      // queryPool
-                    ctr++);                                               // firstQuery
+                    build.queryPool.get(),                                // queryPool
+                    index);                                               // firstQuery
         }
 
         cmdBuf.end(index);
+    }
+
+    // The geometry data might still be in flight on the transfer queue. The frames wait for the builds on the device,
+    // the command buffers and scratch memory are kept until then.
+    build.value = submitToComputeQueue(cmdBuf.get(), uploads.getSemaphore(), uploads.getValue());
+    mBlasBuilds.push_back(std::move(build));
+}
+
+bool RayTracer::collectBlasBuilds() {
+    if (mBlasBuilds.empty())
+        return false;
+
+    uint64_t finished = vkCore::global::device.getSemaphoreCounterValue(mBlasSemaphore.get());
+
+    BlasBuild compaction;
+    std::vector<vk::CopyAccelerationStructureInfoKHR> copies;
+    std::vector<AccelerationStructure> originals;
+    vk::DeviceSize totalOriginalSize = 0;
+    vk::DeviceSize totalCompactSize = 0;
+
+    while (!mBlasBuilds.empty() && mBlasBuilds.front().value <= finished) {
+        auto &build = mBlasBuilds.front();
+
+        if (build.queryPool) {
+            std::vector<vk::DeviceSize> compactSizes(build.structures.size());
+
+            // The builds finished, so the sizes are available without waiting.
+            auto result = vkCore::global::device.getQueryPoolResults(
+                    build.queryPool.get(),                          // queryPool
+                    0,                                               // firstQuery
+                    static_cast<uint32_t>(compactSizes.size()),   // queryCount
+                    compactSizes.size() * sizeof(vk::DeviceSize), // dataSize
+                    compactSizes.data(),                            // pData
+                    sizeof(vk::DeviceSize),                        // stride
+                    vk::QueryResultFlagBits::e64);                  // flags
+
+            KF_ASSERT(result == vk::Result::eSuccess, "Failed to get query pool results.");
+
+            for (size_t i = 0; i < build.structures.size(); ++i) {
+                const auto &structure = build.structures[i];
+
+                // Structures that were replaced or removed in the meantime are not compacted.
+                auto blas = mBlas.find(structure.geometry);
+                if (blas == mBlas.end() || blas->second.as.as != structure.as)
+                    continue;
+
+                totalOriginalSize += structure.size;
+                totalCompactSize += compactSizes[i];
+
+                // Creating a compact version of the AS.
+                vk::AccelerationStructureCreateInfoKHR asCreateInfo(
+                        {},                                            // createFlags
+                        {},                                            // buffer
+                        {},                                            // offset
+                        compactSizes[i],                                // size
+                        vk::AccelerationStructureTypeKHR::eBottomLevel, // type
+                        {});                                          // deviceAddress
+
+                auto as = initAccelerationStructure(asCreateInfo);
+
+                // Copy the original BLAS to a compact version
+                copies.emplace_back(blas->second.as.as,                               // src
+                                    as.as,                                            // dst
+                                    vk::CopyAccelerationStructureModeKHR::eCompact); // mode
+
+                originals.push_back(blas->second.as);
+                blas->second.as = as;
+            }
+        }
 
-        ++index;
+        mBlasBuilds.pop_front();
     }
 
-    cmdBuf.submitToQueue(vkCore::global::graphicsQueue);
+    if (copies.empty())
+        return false;
 
-    if (doCompaction) {
-        vkCore::CommandBuffer compactionCmdBuf(vkCore::global::graphicsCmdPool);
+    compaction.commandPool = vkCore::initCommandPoolUnique({vkCore::global::computeFamilyIndex});
 
-        std::vector<vk::DeviceSize> compactSizes(mBlas.size());
+    vkCore::CommandBuffer compactionCmdBuf(compaction.commandPool.get());
+    compactionCmdBuf.begin(0);
 
-        auto result = vkCore::global::device.getQueryPoolResults(
-                queryPool.get(),                                // queryPool
-                0,                                               // firstQuery
-                static_cast<uint32_t>(compactSizes.size()),   // queryCount
-                compactSizes.size() * sizeof(vk::DeviceSize), // dataSize
-                compactSizes.data(),                            // pData
-                sizeof(vk::DeviceSize),                        // stride
-                vk::QueryResultFlagBits::eWait);                // flags
+    for (const auto &copyInfo : copies)
+        compactionCmdBuf.get(0).copyAccelerationStructureKHR(&copyInfo);
+
+    compactionCmdBuf.end(0);
+
+    compaction.value = submitToComputeQueue(compactionCmdBuf.get());
+    mBlasBuilds.push_back(std::move(compaction));
+
+    // The copies and the frames in flight still read the originals.
+    for (const auto &as : originals)
+        retire(as);
+
+    KF_DEBUG("BLAS: Compaction Results: {} -> {} | Total: {}",
+             totalOriginalSize, totalCompactSize, totalOriginalSize - totalCompactSize);
+
+    return true;
+}
 
-        KF_ASSERT(result == vk::Result::eSuccess, "Failed to get query pool results.");
+auto RayTracer::submitToComputeQueue(const std::vector<vk::CommandBuffer> &cmdBufs, vk::Semaphore waitSemaphore,
+                                     uint64_t waitValue) -> uint64_t {
+    auto signalSemaphore = mBlasSemaphore.get();
+    uint64_t signalValue = ++mBlasValue;
 
-        std::vector<AccelerationStructure> cleanupAS(mBlas.size());
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR;
+    uint32_t waitCount = waitSemaphore && waitValue > 0 ? 1 : 0;
 
-        uint32_t totalOriginalSize = 0;
-        uint32_t totalCompactSize = 0;
+    vk::TimelineSemaphoreSubmitInfo timelineInfo(waitCount, &waitValue, 1, &signalValue);
 
-        compactionCmdBuf.begin(0);
+    vk::SubmitInfo submitInfo(waitCount,                                   // waitSemaphoreCount
+                              &waitSemaphore,                              // pWaitSemaphores
+                              &waitStage,                                  // pWaitDstStageMask
+                              static_cast<uint32_t>(cmdBufs.size()),       // commandBufferCount
+                              cmdBufs.data(),                              // pCommandBuffers
+                              1,                                           // signalSemaphoreCount
+                              &signalSemaphore);                           // pSignalSemaphores
+    submitInfo.pNext = &timelineInfo;
+
+    auto result = vkCore::global::computeQueue.submit(1, &submitInfo, nullptr);
+    KF_ASSERT(result == vk::Result::eSuccess, "Failed to submit acceleration structure builds.");
+
+    return signalValue;
+}
+
+void RayTracer::beginFrame(size_t frameIndex, size_t framesInFlight) {
+    if (mFrameReleases.size() < std::max(framesInFlight, frameIndex + 1))
+        mFrameReleases.resize(std::max(framesInFlight, frameIndex + 1));
+
+    // The frame that retired these is done, and so are all frames and builds submitted before it.
+    auto &release = mFrameReleases[frameIndex];
+
+    // Builds submitted after the frame, e.g. if it was never rendered, are waited for.
+    if (release.blasValue > vkCore::global::device.getSemaphoreCounterValue(mBlasSemaphore.get())) {
+        auto semaphore = mBlasSemaphore.get();
+        vk::SemaphoreWaitInfo waitInfo({}, 1, &semaphore, &release.blasValue);
+        auto result = vkCore::global::device.waitSemaphores(waitInfo, UINT64_MAX);
+        KF_ASSERT(result == vk::Result::eSuccess, "Failed to wait for acceleration structure builds.");
+    }
+
+    for (auto &as : release.structures)
+        as.destroy();
+
+    release.structures.clear();
+    release.resources.clear();
+    release.blasValue = 0;
+
+    mFrameIndex = frameIndex;
+}
+
+void RayTracer::retire(const AccelerationStructure &as) {
+    if (mFrameReleases.size() <= mFrameIndex)
+        mFrameReleases.resize(mFrameIndex + 1);
+
+    mFrameReleases[mFrameIndex].structures.push_back(as);
+    mFrameReleases[mFrameIndex].blasValue = mBlasValue;
+}
 
-        for (size_t i = 0; i < mBlas.size(); ++i) {
-            totalOriginalSize += static_cast<uint32_t>(originalSizes[i]);
-            totalCompactSize += static_cast<uint32_t>(compactSizes[i]);
+void RayTracer::retire(std::shared_ptr<void> resource) {
+    if (mFrameReleases.size() <= mFrameIndex)
+        mFrameReleases.resize(mFrameIndex + 1);
 
-            // Creating a compact version of the AS.
-            vk::AccelerationStructureCreateInfoKHR asCreateInfo(
+    mFrameReleases[mFrameIndex].resources.push_back(std::move(resource));
+    mFrameReleases[mFrameIndex].blasValue = mBlasValue;
+}
+
+bool RayTracer::updateGeometryVertices(const GeometryBuffer &geometryBuffer,
+                                       const std::unordered_map<const Geometry *, GeometryAllocation> &allocations,
+                                       const std::unordered_map<const Geometry *, VertexUpdate> &updates,
+                                       size_t frameIndex, uint32_t rebuildInterval) {
+    // Geometries that left the scene or are hidden have nothing to refit.
+    std::vector<std::tuple<Blas *, const GeometryAllocation *, const VertexUpdate *>> valid;
+    for (const auto &[geometry, update] : updates) {
+        auto blas = mBlas.find(geometry);
+        auto allocation = allocations.find(geometry);
+        if (blas == mBlas.end() || blas->second.hidden || allocation == allocations.end())
+            continue;
+
+        KF_ASSERT((allocation->second.layout.flags & GeometryLayout::eProcedural) == 0,
+                  "The vertices of procedural geometries can not be updated.");
+
+        valid.emplace_back(&blas->second, &allocation->second, &update);
+    }
+
+    if (valid.empty())
+        return false;
+
+    if (mVertexStaging.size() <= frameIndex)
+        mVertexStaging.resize(frameIndex + 1);
+
+    if (!mVertexStaging[frameIndex])
+        mVertexStaging[frameIndex] = std::make_unique<VertexStaging>();
+
+    auto &staging = *mVertexStaging[frameIndex];
+
+    vk::DeviceSize stagingSize = 0;
+    for (auto [blas, allocation, update] : valid)
+        stagingSize += update->positions.size() * sizeof(glm::vec3) + update->attributes.size() * sizeof(uint32_t);
+
+    // Grow the staging buffer geometrically. The device is done with the last frame that used it.
+    if (staging.capacity < stagingSize) {
+        staging.capacity = std::max(stagingSize, staging.capacity * 2);
+        staging.buffer.init(staging.capacity,
+                            vk::BufferUsageFlagBits::eTransferSrc,
+                            {vkCore::global::graphicsFamilyIndex},
+                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        staging.pData = reinterpret_cast<uint8_t *>(staging.buffer.map());
+    }
+
+    mBlasUpdateDstBuffer = geometryBuffer.get();
+    mBlasUpdates.clear();
+
+    bool replaced = false;
+    vk::DeviceSize stagingOffset = 0;
+    for (auto [pBlas, allocation, update] : valid) {
+        auto &blas = *pBlas;
+        const auto &layout = allocation->layout;
+
+        BlasUpdate blasUpdate;
+
+        if (!update->positions.empty()) {
+            KF_ASSERT(update->positions.size() == layout.vertexCount, "Expected {} vertices, got {}.",
+                      layout.vertexCount, update->positions.size());
+
+            // Attributes packed differently would overrun into the data of neighbouring geometries.
+            constexpr uint32_t attributeFlags = GeometryLayout::eCompact | GeometryLayout::eColor;
+            KF_ASSERT((update->layout.flags & attributeFlags) == (layout.flags & attributeFlags),
+                      "The attributes were packed with a different layout than uploaded.");
+            KF_ASSERT(update->attributes.size() == size_t{layout.vertexCount} * layout.getAttributeStride(),
+                      "Expected {} attribute words, got {}.",
+                      size_t{layout.vertexCount} * layout.getAttributeStride(), update->attributes.size());
+
+            for (auto [data, size, offset] : {
+                    std::tuple(static_cast<const void *>(update->positions.data()),
+                               update->positions.size() * sizeof(glm::vec3), allocation->positionOffset),
+                    std::tuple(static_cast<const void *>(update->attributes.data()),
+                               update->attributes.size() * sizeof(uint32_t), allocation->attributeOffset)}) {
+                if (size == 0)
+                    continue;
+
+                memcpy(staging.pData + stagingOffset, data, size);
+                blasUpdate.copies.emplace_back(stagingOffset, offset, size);
+                stagingOffset += size;
+            }
+
+            blasUpdate.srcBuffer = staging.buffer.get();
+        } else {
+            blasUpdate.srcBuffer = update->buffer;
+            blasUpdate.copies.emplace_back(update->offset, allocation->positionOffset,
+                                           layout.vertexCount * sizeof(glm::vec3));
+        }
+
+        // The geometry buffer might have moved since the BLAS was built.
+        auto fresh = modelToBlas(geometryBuffer.getAddress(allocation->positionOffset),
+                                 geometryBuffer.getAddress(allocation->indexOffset), layout, blas.opaque);
+
+        // A BLAS built for static use, e.g. of a geometry flagged dynamic after its upload, is compacted and can not be
+        // refit. It is replaced by one that is built after the copies, the frames in flight keep tracing the old one.
+        bool replace = !blas.updatable;
+        if (replace) {
+            vk::AccelerationStructureBuildGeometryInfoKHR buildInfo(
+                    vk::AccelerationStructureTypeKHR::eBottomLevel, // type
+                    dynamicBlasFlags,                               // flags
+                    vk::BuildAccelerationStructureModeKHR::eBuild,  // mode
+                    nullptr,                                        // srcAccelerationStructure
+                    {},                                            // dstAccelerationStructure
+                    1,                                              // geometryCount
+                    &fresh.asGeometry.front(),                      // pGeometries
+                    {},                                            // ppGeometries
+                    {});                                          // scratchData
+
+            vk::AccelerationStructureBuildSizesInfoKHR sizeInfo;
+            vkCore::global::device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
+                                                                         &buildInfo,
+                                                                         &fresh.asBuildRangeInfo.front().primitiveCount,
+                                                                         &sizeInfo);
+
+            vk::AccelerationStructureCreateInfoKHR createInfo(
                     {},                                            // createFlags
                     {},                                            // buffer
                     {},                                            // offset
-                    compactSizes[i],                                // size
+                    sizeInfo.accelerationStructureSize,             // size
                     vk::AccelerationStructureTypeKHR::eBottomLevel, // type
                     {});                                          // deviceAddress
 
-            auto as = initAccelerationStructure(asCreateInfo);
-
-            // Copy the original BLAS to a compact version
-            vk::CopyAccelerationStructureInfoKHR copyInfo(mBlas[i].as.as,                                  // src
-                                                          as.as,                                            // dst
-                                                          vk::CopyAccelerationStructureModeKHR::eCompact); // mode
-
-            compactionCmdBuf.get(0).copyAccelerationStructureKHR(&copyInfo);
-
-            cleanupAS[i] = mBlas[i].as;
-            mBlas[i].as = as;
+            retire(blas.as);
+            blas.as = initAccelerationStructure(createInfo);
+            blas.updatable = true;
+            blas.refitCount = 0;
+            blas.scratchSize = std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize);
+            replaced = true;
         }
 
-        compactionCmdBuf.end(0);
-        compactionCmdBuf.submitToQueue(vkCore::global::graphicsQueue);
+        blasUpdate.as = blas.as.as;
+        blasUpdate.asGeometry = fresh.asGeometry.front();
+        blasUpdate.asBuildRangeInfo = fresh.asBuildRangeInfo.front();
+        blasUpdate.scratchSize = blas.scratchSize;
 
-        for (auto &as : cleanupAS) {
-            as.destroy();
-        }
+        // Refits only move the bounding boxes of the existing hierarchy, which gets worse the further the vertices move.
+        blasUpdate.rebuild = replace || blas.refitCount >= rebuildInterval;
+        blas.refitCount = blasUpdate.rebuild ? 0 : blas.refitCount + 1;
 
-        KF_DEBUG("BLAS: Compaction Results: {} -> {} | Total: {}",
-                 totalOriginalSize, totalCompactSize, totalOriginalSize - totalCompactSize);
+        mBlasUpdates.push_back(std::move(blasUpdate));
     }
+
+    mBlasRefitted = true;
+    return replaced;
 }
 
 void RayTracer::updateTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances,
+                           std::span<const uint32_t> changedInstances, size_t frameIndex,
                            vk::BuildAccelerationStructureFlagsKHR flags) {
-    buildTlas(geometryInstances, flags, true);
+    buildTlas(geometryInstances, frameIndex, flags, true, changedInstances);
 }
 
-void RayTracer::buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances,
-                          vk::BuildAccelerationStructureFlagsKHR flags, bool reuse) {
-    //mTlas.flags = flags;
+void RayTracer::buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances, size_t frameIndex,
+                          vk::BuildAccelerationStructureFlagsKHR flags, bool reuse,
+                          std::span<const uint32_t> changedInstances) {
+    auto instancesCount = static_cast<uint32_t>(geometryInstances.size());
+
+    if (instancesCount > mInstanceCapacity)
+        mInstanceCapacity = std::max({instancesCount, mInstanceCapacity * 2, 16U});
+
+    auto &instanceBuffer = getInstanceBuffer(frameIndex);
+
+    // Grow the instance buffer geometrically. It stays mapped for its whole lifetime.
+    if (instanceBuffer.capacity < mInstanceCapacity) {
+        instanceBuffer.capacity = mInstanceCapacity;
+
+        vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+
+        instanceBuffer.buffer.init(sizeof(vk::AccelerationStructureInstanceKHR) * instanceBuffer.capacity,
+                                   vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                   vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+                                   {vkCore::global::graphicsFamilyIndex},
+                                   vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                   &allocateFlags);
 
-    std::vector<vk::AccelerationStructureInstanceKHR> tlasInstances;
-    tlasInstances.reserve(geometryInstances.size());
+        instanceBuffer.pData = reinterpret_cast<vk::AccelerationStructureInstanceKHR *>(instanceBuffer.buffer.map());
+        instanceBuffer.writeAll = true;  // the new buffer has to be written completely
+    }
+
+    size_t previousCount = mTlasInstances.size();
+    bool dirty = previousCount != instancesCount || mPosesChanged || mBlasRefitted || !changedInstances.empty();
+    bool posesChanged = mPosesChanged;
+    mPosesChanged = false;
+    mBlasRefitted = false;
+
+    mTlasInstances.resize(instancesCount);
+    mInstanceOrigins.resize(instancesCount);
+
+    // Track how far the instances moved from where they were at the last full build. The distance of an instance
+    // that moved back is still counted, which only makes the rebuild come earlier.
+    auto createInstance = [&](uint32_t i) {
+        mTlasInstances[i] = geometryInstanceToAccelerationStructureInstance(geometryInstances[i]);
 
-    for (auto instance : geometryInstances) {
-        tlasInstances.push_back(geometryInstanceToAccelerationStructureInstance(instance));
+        // The transforms and origins of posed instances come from the poses, see recordInstancePoses().
+        if (i < mPoseCount)
+            return;
+
+        const auto &matrix = mTlasInstances[i].transform.matrix;
+        mInstanceOrigins[i] = glm::vec3(matrix[0][3], matrix[1][3], matrix[2][3]);
+
+        if (i < mTlasOrigins.size()) {
+            glm::vec3 offset = mInstanceOrigins[i] - mTlasOrigins[i];
+            mMovedDistance2 = std::max(mMovedDistance2, glm::dot(offset, offset));
+        }
+    };
+
+    // The TLAS instances are only created again if their geometry instances changed. A full build, e.g. because a
+    // BLAS was replaced, creates all of them.
+    bool createAll = !reuse || previousCount != instancesCount;
+    if (createAll) {
+        for (uint32_t i = 0; i < instancesCount; ++i)
+            createInstance(i);
+    } else {
+        for (auto i : changedInstances)
+            createInstance(i);
     }
 
-    if (reuse) {
-        // destroy geometry instances buffer (probably not necessary in this case because I am using a unique handle)
+    for (auto &buffer : mInstanceBuffers) {
+        if (!buffer || buffer->writeAll)
+            continue;
+
+        if (createAll || buffer->pending.size() + changedInstances.size() > instancesCount) {
+            buffer->writeAll = true;
+            buffer->pending.clear();
+        } else
+            buffer->pending.insert(buffer->pending.end(), changedInstances.begin(), changedInstances.end());
     }
 
-    vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+    if (createAll || posesChanged) {
+        mPoseDistance2 = 0.0F;
+        size_t trackedCount = std::min<size_t>(mPoseCount, mTlasOrigins.size());
 
-    _instanceBuffer.init(sizeof(vk::AccelerationStructureInstanceKHR) * geometryInstances.size(),
-                         vk::BufferUsageFlagBits::eShaderDeviceAddress |
-                         vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
-                         {vkCore::global::graphicsFamilyIndex},
-                         vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostCoherent,
-                         &allocateFlags);
+        for (uint32_t i = 0; i < mPoseCount; ++i) {
+            mInstanceOrigins[i] = mPosePositions[i];
 
-    _instanceBuffer.fill<vk::AccelerationStructureInstanceKHR>(tlasInstances);
+            if (i < trackedCount) {
+                glm::vec3 offset = mInstanceOrigins[i] - mTlasOrigins[i];
+                mPoseDistance2 = std::max(mPoseDistance2, glm::dot(offset, offset));
+            }
+        }
+    }
 
-    vk::BufferDeviceAddressInfo bufferInfo(_instanceBuffer.get());
-    vk::DeviceAddress instanceAddress = vkCore::global::device.getBufferAddress(&bufferInfo);
+    // The instance buffer of this frame is as recent as the last frame that used it.
+    if (instanceBuffer.writeAll)
+        memcpy(instanceBuffer.pData, mTlasInstances.data(), sizeof(vk::AccelerationStructureInstanceKHR) * instancesCount);
+    else
+        for (auto i : instanceBuffer.pending)
+            instanceBuffer.pData[i] = mTlasInstances[i];
 
-    vk::UniqueCommandPool commandPool = vkCore::initCommandPoolUnique(vkCore::global::graphicsFamilyIndex);
-    vkCore::CommandBuffer cmdBuf(commandPool.get());
+    instanceBuffer.pending.clear();
+    instanceBuffer.writeAll = false;
 
-    cmdBuf.begin(0);
+    // Also a build that is still pending reads the instances of this frame from now on.
+    mInstanceBufferIndex = frameIndex;
 
-    vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,                   // srcAccessMask
-                              vk::AccessFlagBits::eAccelerationStructureWriteKHR); // dstAccessMask
+    // An update requires the same instance count as the last build and a build that has not been recorded yet must stay a build.
+    bool pendingBuild = mTlasBuildPending && mTlasMode == vk::BuildAccelerationStructureModeKHR::eBuild;
+    bool update = reuse && !pendingBuild && mTlas.as.as && previousCount == instancesCount;
 
-    cmdBuf.get(0).pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,                      // srcStageMask
-                                  vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, // dstStageMask
-                                  {},                                                       // dependencyFlags
-                                  1,                                                         // memoryBarrierCount
-                                  &barrier,                                                  // pMemoryBarriers
-                                  0,                                                         // bufferMemoryBarrierCount
-                                  nullptr,                                                   // pBufferMemoryBarriers
-                                  0,                                                         // imageMemoryBarrierCount
-                                  nullptr);                                                 // pImageMemoryBarriers
+    if (update && !dirty)
+        return;                            // nothing changed since the last call
 
-    vk::AccelerationStructureGeometryInstancesDataKHR instancesData(VK_FALSE,          // arrayOfPointers
-                                                                    instanceAddress); // data
+    // Refits keep the tree of the last full build, whose bounds overlap more and more the further the instances move.
+    // Without an extent, e.g. for a single instance or instances sharing their origin, the displacement can not be
+    // measured and only the refit count limits the refits.
+    mTlasDisplacement = mTlasExtent > 0.0F ? std::sqrt(std::max(mMovedDistance2, mPoseDistance2)) / mTlasExtent : 0.0F;
 
-    vk::AccelerationStructureGeometryKHR tlasGeometry(vk::GeometryTypeKHR::eInstances, // geometryType
-                                                      instancesData,                   // geoemtry
-                                                      {});                           // flags
+    if (update && (mTlasRefitCount >= mTlasRebuildInterval ||
+                   (mTlasRebuildDisplacement > 0.0F && mTlasDisplacement > mTlasRebuildDisplacement)))
+        update = false;
 
-    vk::BuildAccelerationStructureModeKHR mode = reuse ? vk::BuildAccelerationStructureModeKHR::eUpdate
-                                                       : vk::BuildAccelerationStructureModeKHR::eBuild;
+    // Size the acceleration structure and scratch memory for the full instance capacity, so they can be reused.
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData(VK_FALSE, {});
+    vk::AccelerationStructureGeometryKHR tlasGeometry(vk::GeometryTypeKHR::eInstances, instancesData, {});
 
     vk::AccelerationStructureBuildGeometryInfoKHR buildInfo(vk::AccelerationStructureTypeKHR::eTopLevel, // type
                                                             flags,                                       // flags
-                                                            mode,                                        // mode
+                                                            vk::BuildAccelerationStructureModeKHR::eBuild, // mode
                                                             nullptr,                                     // srcAccelerationStructure
                                                             {},                                         // dstAccelerationStructure
                                                             1,                                           // geometryCount
@@ -441,16 +831,17 @@ void RayTracer::buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &
                                                             {},                                         // ppGeometries
                                                             {});                                       // scratchData
 
-    auto instancesCount = static_cast<uint32_t>(geometryInstances.size());
-
     vk::AccelerationStructureBuildSizesInfoKHR buildSizesInfo({},   // accelerationStructureSize
                                                               {},   // updateScratchSize
                                                               {}); // buildScratchSize
 
     vkCore::global::device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
-                                                                 &buildInfo, &instancesCount, &buildSizesInfo);
+                                                                 &buildInfo, &mInstanceCapacity, &buildSizesInfo);
+
+    if (!mTlas.as.as || mTlasCapacity < instancesCount) {
+        // The caller guarantees the device is done with the old acceleration structure.
+        mTlas.as.destroy();
 
-    if (!reuse) {
         vk::AccelerationStructureCreateInfoKHR asCreateInfo(
                 {},                                         // createFlags
                 {},                                         // buffer
@@ -460,44 +851,378 @@ void RayTracer::buildTlas(const std::vector<std::shared_ptr<GeometryInstance>> &
                 {});                                       // deviceAddress
 
         mTlas.as = initAccelerationStructure(asCreateInfo);
+        mTlasCapacity = mInstanceCapacity;
+        update = false;
+    }
+
+    vk::DeviceSize alignment = mCapabilities.accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+    vk::DeviceSize scratchSize = std::max(buildSizesInfo.buildScratchSize, buildSizesInfo.updateScratchSize) + alignment;
+
+    if (scratchSize > mTlasScratchCapacity) {
+        mTlasScratchCapacity = std::max(scratchSize, mTlasScratchCapacity * 2);
+
+        vk::MemoryAllocateFlagsInfo allocateInfo(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+
+        mTlasScratchBuffer.init(mTlasScratchCapacity,                                                        // size
+                                vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                vk::BufferUsageFlagBits::eStorageBuffer,                                     // usage
+                                {vkCore::global::graphicsFamilyIndex},                                       // queueFamilyIndices
+                                vk::MemoryPropertyFlagBits::eDeviceLocal,                                    // memoryPropertyFlags
+                                &allocateInfo);
+    }
+
+    if (update) {
+        ++mTlasRefitCount;
+    } else {
+        mTlasRefitCount = 0;
+        mTlasDisplacement = 0.0F;
+        mMovedDistance2 = 0.0F;
+        mPoseDistance2 = 0.0F;
+        mTlasOrigins = mInstanceOrigins;
+
+        glm::vec3 lower(std::numeric_limits<float>::max());
+        glm::vec3 upper(std::numeric_limits<float>::lowest());
+        for (const auto &origin : mTlasOrigins) {
+            lower = glm::min(lower, origin);
+            upper = glm::max(upper, origin);
+        }
+
+        // Extents that vanish next to the coordinates themselves count as degenerate.
+        mTlasExtent = mTlasOrigins.empty() ? 0.0F : glm::length(upper - lower);
+        float magnitude = mTlasOrigins.empty() ? 0.0F : std::max(glm::length(lower), glm::length(upper));
+        if (mTlasExtent <= std::max(magnitude, 1.0F) * 1e-4F)
+            mTlasExtent = 0.0F;
     }
 
-    vk::MemoryAllocateFlagsInfo allocateInfo(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+    mTlasFlags = flags;
+    mTlasMode = update ? vk::BuildAccelerationStructureModeKHR::eUpdate
+                       : vk::BuildAccelerationStructureModeKHR::eBuild;
+    mTlasBuildPending = true;
+}
+
+auto RayTracer::getInstanceBuffer(size_t frameIndex) -> InstanceBuffer & {
+    if (mInstanceBuffers.size() <= frameIndex)
+        mInstanceBuffers.resize(frameIndex + 1);
+
+    if (!mInstanceBuffers[frameIndex])
+        mInstanceBuffers[frameIndex] = std::make_unique<InstanceBuffer>();
+
+    return *mInstanceBuffers[frameIndex];
+}
+
+void RayTracer::setInstancePoses(std::span<const float> poses, const PoseLayout &layout, bool changed,
+                                 vk::Buffer geometryInstances, size_t frameIndex) {
+    auto poseCount = static_cast<uint32_t>(poses.size() / layout.stride);
+
+    if (changed || poseCount != mPoseCount) {
+        ++mPoseVersion;
+        mPosesChanged = true;
+        mInstancePoseLayout = layout;
+
+        mPosePositions.resize(poseCount);
+        for (uint32_t i = 0; i < poseCount; ++i) {
+            const float *position = &poses[i * layout.stride + layout.positionOffset];
+            mPosePositions[i] = glm::vec3(position[0], position[1], position[2]);
+        }
+    }
+
+    mPoseCount = poseCount;
+    if (poseCount == 0)
+        return;
+
+    mGeometryInstancesAddress = vkCore::global::device.getBufferAddress(geometryInstances);
+
+    auto &instanceBuffer = getInstanceBuffer(frameIndex);
+
+    if (instanceBuffer.poseCapacity < poses.size()) {
+        instanceBuffer.poseCapacity = std::max({poses.size(), instanceBuffer.poseCapacity * 2, size_t{256}});
 
-    vkCore::Buffer scratchBuffer(
-            buildSizesInfo.buildScratchSize,                                                                           // size
-            vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
-            vk::BufferUsageFlagBits::eShaderDeviceAddress |
-            vk::BufferUsageFlagBits::eStorageBuffer, // usage
-            {vkCore::global::graphicsFamilyIndex},                                                                   // queueFamilyIndices
-            vk::MemoryPropertyFlagBits::eDeviceLocal |
-            vk::MemoryPropertyFlagBits::eHostCoherent,                      // memoryPropertyFlags
-            &allocateInfo);
+        vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
 
-    vk::BufferDeviceAddressInfo scratchBufferInfo(scratchBuffer.get());
+        instanceBuffer.poseBuffer.init(sizeof(float) * instanceBuffer.poseCapacity,
+                                       vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                       {vkCore::global::graphicsFamilyIndex},
+                                       vk::MemoryPropertyFlagBits::eHostVisible |
+                                       vk::MemoryPropertyFlagBits::eHostCoherent,
+                                       &allocateFlags);
+
+        instanceBuffer.pPoses = reinterpret_cast<float *>(instanceBuffer.poseBuffer.map());
+        instanceBuffer.poseVersion = 0;
+    }
+
+    // Like the instances, every frame in flight has its own copy of the poses, which may be behind.
+    if (instanceBuffer.poseVersion != mPoseVersion) {
+        memcpy(instanceBuffer.pPoses, poses.data(), poses.size_bytes());
+        instanceBuffer.poseVersion = mPoseVersion;
+    }
+}
+
+void RayTracer::recordBlasUpdates(vk::CommandBuffer cmdBuf) {
+    if (mBlasUpdates.empty())
+        return;
+
+    vk::DeviceSize alignment = mCapabilities.accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+    alignment = std::max<vk::DeviceSize>(alignment, 1);
+
+    // All builds are recorded at once, each one gets its own range of the scratch memory.
+    std::vector<vk::DeviceSize> scratchOffsets;
+    vk::DeviceSize scratchSize = alignment;
+    for (const auto &update : mBlasUpdates) {
+        scratchOffsets.push_back(scratchSize);
+        scratchSize += (update.scratchSize + alignment - 1) / alignment * alignment;
+    }
+
+    if (scratchSize > mBlasUpdateScratchCapacity) {
+        // Previous frames might still refit with the old scratch buffer, it is released once this frame finished.
+        if (mBlasUpdateScratchBuffer)
+            retire(std::move(mBlasUpdateScratchBuffer));
+
+        mBlasUpdateScratchCapacity = std::max(scratchSize, mBlasUpdateScratchCapacity * 2);
+
+        vk::MemoryAllocateFlagsInfo allocateInfo(vk::MemoryAllocateFlagBitsKHR::eDeviceAddress);
+
+        mBlasUpdateScratchBuffer = std::make_shared<vkCore::Buffer>(
+                mBlasUpdateScratchCapacity,                                                              // size
+                vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer, // usage
+                std::vector<uint32_t>{vkCore::global::graphicsFamilyIndex},                             // queueFamilyIndices
+                vk::MemoryPropertyFlagBits::eDeviceLocal,                                                // memoryPropertyFlags
+                &allocateInfo);
+    }
+
+    vk::BufferDeviceAddressInfo scratchBufferInfo(mBlasUpdateScratchBuffer->get());
+    vk::DeviceAddress scratchAddress = vkCore::global::device.getBufferAddress(&scratchBufferInfo);
+    scratchAddress = scratchAddress / alignment * alignment;    // the first range starts one alignment in
+
+    // Previous builds read the positions and traces the attributes that are overwritten here.
+    vk::MemoryBarrier barrier({},                                   // srcAccessMask
+                              vk::AccessFlagBits::eTransferWrite); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR, // srcStageMask
+                           vk::PipelineStageFlagBits::eTransfer,            // dstStageMask
+                           {},                                              // dependencyFlags
+                           1,                                               // memoryBarrierCount
+                           &barrier,                                        // pMemoryBarriers
+                           0,                                               // bufferMemoryBarrierCount
+                           nullptr,                                         // pBufferMemoryBarriers
+                           0,                                               // imageMemoryBarrierCount
+                           nullptr);                                       // pImageMemoryBarriers
+
+    for (const auto &update : mBlasUpdates)
+        cmdBuf.copyBuffer(update.srcBuffer, mBlasUpdateDstBuffer, update.copies);
+
+    // The refits write the structures previous traces read and the scratch memory of previous refits.
+    barrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite |
+                                vk::AccessFlagBits::eAccelerationStructureWriteKHR,  // srcAccessMask
+                                vk::AccessFlagBits::eShaderRead |
+                                vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                                vk::AccessFlagBits::eAccelerationStructureWriteKHR); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer |
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,          // srcStageMask
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,          // dstStageMask
+                           {},                                                       // dependencyFlags
+                           1,                                                        // memoryBarrierCount
+                           &barrier,                                                 // pMemoryBarriers
+                           0,                                                        // bufferMemoryBarrierCount
+                           nullptr,                                                  // pBufferMemoryBarriers
+                           0,                                                        // imageMemoryBarrierCount
+                           nullptr);                                                // pImageMemoryBarriers
+
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR *> pBuildRangeInfos;
+    buildInfos.reserve(mBlasUpdates.size());
+    pBuildRangeInfos.reserve(mBlasUpdates.size());
+
+    for (size_t i = 0; i < mBlasUpdates.size(); ++i) {
+        const auto &update = mBlasUpdates[i];
+
+        vk::AccelerationStructureBuildGeometryInfoKHR buildInfo(
+                vk::AccelerationStructureTypeKHR::eBottomLevel,                  // type
+                dynamicBlasFlags,                                                // flags
+                update.rebuild ? vk::BuildAccelerationStructureModeKHR::eBuild
+                               : vk::BuildAccelerationStructureModeKHR::eUpdate, // mode
+                update.rebuild ? nullptr : update.as,                            // srcAccelerationStructure
+                update.as,                                                       // dstAccelerationStructure
+                1,                                                               // geometryCount
+                &update.asGeometry,                                              // pGeometries
+                {},                                                             // ppGeometries
+                {});                                                           // scratchData
+
+        buildInfo.scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+
+        buildInfos.push_back(buildInfo);
+        pBuildRangeInfos.push_back(&update.asBuildRangeInfo);
+    }
+
+    cmdBuf.buildAccelerationStructuresKHR(static_cast<uint32_t>(buildInfos.size()), buildInfos.data(),
+                                          pBuildRangeInfos.data());
+
+    mBlasUpdates.clear();
+}
+
+void RayTracer::recordInstancePoses(vk::CommandBuffer cmdBuf) {
+    if (mPoseCount == 0)
+        return;
+
+    auto &instanceBuffer = *mInstanceBuffers[mInstanceBufferIndex];
+
+    PosePushConstants pushConstants{
+            vkCore::global::device.getBufferAddress(instanceBuffer.poseBuffer.get()),
+            vkCore::global::device.getBufferAddress(instanceBuffer.buffer.get()),
+            mGeometryInstancesAddress,
+            mPoseCount,
+            mInstancePoseLayout.stride,
+            mInstancePoseLayout.positionOffset,
+            mInstancePoseLayout.rotationOffset,
+            mInstancePoseLayout.scaleOffset};
+
+    // Previous traces read the geometry instance buffer that is written here.
+    vk::MemoryBarrier barrier({},                                  // srcAccessMask
+                              vk::AccessFlagBits::eShaderWrite); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR, // srcStageMask
+                           vk::PipelineStageFlagBits::eComputeShader,       // dstStageMask
+                           {},                                              // dependencyFlags
+                           1,                                               // memoryBarrierCount
+                           &barrier,                                        // pMemoryBarriers
+                           0,                                               // bufferMemoryBarrierCount
+                           nullptr,                                         // pBufferMemoryBarriers
+                           0,                                               // imageMemoryBarrierCount
+                           nullptr);                                       // pImageMemoryBarriers
+
+    cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, mPosePipeline.get());
+    cmdBuf.pushConstants(mPoseLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PosePushConstants),
+                         &pushConstants);
+    cmdBuf.dispatch((mPoseCount + poseGroupSize - 1) / poseGroupSize, 1, 1);
+
+    // The build reads the TLAS instances, the trace the geometry instances.
+    barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite,  // srcAccessMask
+                                vk::AccessFlagBits::eShaderRead); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,                // srcStageMask
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,          // dstStageMask
+                           {},                                                       // dependencyFlags
+                           1,                                                        // memoryBarrierCount
+                           &barrier,                                                 // pMemoryBarriers
+                           0,                                                        // bufferMemoryBarrierCount
+                           nullptr,                                                  // pBufferMemoryBarriers
+                           0,                                                        // imageMemoryBarrierCount
+                           nullptr);                                                // pImageMemoryBarriers
+}
+
+void RayTracer::recordTlasBuild(vk::CommandBuffer cmdBuf) {
+    auto queryIndex = static_cast<uint32_t>(mTimestampIndex) * timestampsPerFrame;
+
+    if (mTimestampIndex < mTimestamps.size()) {
+        auto &telemetry = mTimestamps[mTimestampIndex].telemetry;
+        telemetry = {};
+        telemetry.tlasRebuilt = mTlasBuildPending && mTlasMode == vk::BuildAccelerationStructureModeKHR::eBuild;
+        telemetry.tlasRefitCount = mTlasRefitCount;
+        telemetry.tlasDisplacement = mTlasDisplacement;
+    }
+
+    if (mTimestampPool) {
+        cmdBuf.resetQueryPool(mTimestampPool.get(), queryIndex, timestampsPerFrame);
+        cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mTimestampPool.get(), queryIndex);
+    }
+
+    if (!mTlasBuildPending) {
+        if (mTimestampPool)
+            cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mTimestampPool.get(), queryIndex + 1);
+        return;
+    }
+
+    mTlasBuildPending = false;
+
+    recordBlasUpdates(cmdBuf);
+    recordInstancePoses(cmdBuf);
+
+    vk::BufferDeviceAddressInfo bufferInfo(mInstanceBuffers[mInstanceBufferIndex]->buffer.get());
+    vk::DeviceAddress instanceAddress = vkCore::global::device.getBufferAddress(&bufferInfo);
+
+    vk::BufferDeviceAddressInfo scratchBufferInfo(mTlasScratchBuffer.get());
     vk::DeviceAddress scratchAddress = vkCore::global::device.getBufferAddress(&scratchBufferInfo);
 
-    buildInfo.srcAccelerationStructure = reuse ? mTlas.as.as : nullptr;
-    buildInfo.dstAccelerationStructure = mTlas.as.as;
+    vk::DeviceSize alignment = mCapabilities.accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment;
+    if (alignment > 0)
+        scratchAddress = (scratchAddress + alignment - 1) / alignment * alignment;
+
+    // Previous traces and builds (which shared the scratch memory) have to be finished.
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR,                   // srcAccessMask
+                              vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                              vk::AccessFlagBits::eAccelerationStructureWriteKHR);                 // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,                        // srcStageMask
+                           vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,              // dstStageMask
+                           {},                                                                     // dependencyFlags
+                           1,                                                                      // memoryBarrierCount
+                           &barrier,                                                               // pMemoryBarriers
+                           0,                                                                      // bufferMemoryBarrierCount
+                           nullptr,                                                                // pBufferMemoryBarriers
+                           0,                                                                      // imageMemoryBarrierCount
+                           nullptr);                                                              // pImageMemoryBarriers
+
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData(VK_FALSE,          // arrayOfPointers
+                                                                    instanceAddress); // data
+
+    vk::AccelerationStructureGeometryKHR tlasGeometry(vk::GeometryTypeKHR::eInstances, // geometryType
+                                                      instancesData,                   // geoemtry
+                                                      {});                           // flags
+
+    bool update = mTlasMode == vk::BuildAccelerationStructureModeKHR::eUpdate;
+
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo(vk::AccelerationStructureTypeKHR::eTopLevel, // type
+                                                            mTlasFlags,                                  // flags
+                                                            mTlasMode,                                   // mode
+                                                            update ? mTlas.as.as : nullptr,              // srcAccelerationStructure
+                                                            mTlas.as.as,                                 // dstAccelerationStructure
+                                                            1,                                           // geometryCount
+                                                            &tlasGeometry,                               // pGeometries
+                                                            {},                                         // ppGeometries
+                                                            {});                                       // scratchData
+
     buildInfo.scratchData.deviceAddress = scratchAddress;
 
-    vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo(instancesCount, // primitiveCount
+    vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo(static_cast<uint32_t>(mTlasInstances.size()), // primitiveCount
                                                               0,              // primitiveOffset
                                                               0,              // firstVertex
                                                               0);            // transformOffset
 
     const vk::AccelerationStructureBuildRangeInfoKHR *pBuildRangeInfo = &buildRangeInfo;
 
-    cmdBuf.get(0).buildAccelerationStructuresKHR(1, &buildInfo, &pBuildRangeInfo);
-
-    cmdBuf.end(0);
-    cmdBuf.submitToQueue(vkCore::global::graphicsQueue);
+    cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo, &pBuildRangeInfo);
+
+    if (mTimestampPool)
+        cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, mTimestampPool.get(),
+                              queryIndex + 1);
+
+    // Make the new TLAS visible to the trace that follows.
+    barrier = vk::MemoryBarrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR,  // srcAccessMask
+                                vk::AccessFlagBits::eAccelerationStructureReadKHR); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, // srcStageMask
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,           // dstStageMask
+                           {},                                                        // dependencyFlags
+                           1,                                                         // memoryBarrierCount
+                           &barrier,                                                  // pMemoryBarriers
+                           0,                                                         // bufferMemoryBarrierCount
+                           nullptr,                                                   // pBufferMemoryBarriers
+                           0,                                                         // imageMemoryBarrierCount
+                           nullptr);                                                 // pImageMemoryBarriers
 }
 
 void RayTracer::createStorageImage(vk::Extent2D extent) {
-    mRenderTargets->clear();
-    if (mRenderTargets->contains("rgba"))
-         return;
+    createStorageImage(*mRenderTargets.front(), extent);
+}
+
+void RayTracer::createStorageImage(RenderTargets &renderTargets, vk::Extent2D extent) {
+    renderTargets.clear();
 
     auto storageImageInfo = vkCore::getImageCreateInfo(
             vk::Extent3D(extent.width, extent.height, 1));
@@ -506,9 +1231,15 @@ void RayTracer::createStorageImage(vk::Extent2D extent) {
                              vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
     storageImageInfo.format = vk::Format::eR32G32B32A32Sfloat;
 
-    createRenderTarget("rgba", storageImageInfo);
-    createRenderTarget("albedo", storageImageInfo);
-    createRenderTarget("normal", storageImageInfo);
+    createRenderTarget(renderTargets, "rgba", storageImageInfo);
+    createRenderTarget(renderTargets, "albedo", storageImageInfo);
+    createRenderTarget(renderTargets, "normal", storageImageInfo);
+
+    storageImageInfo.format = vk::Format::eR32Sfloat;
+    createRenderTarget(renderTargets, "depth", storageImageInfo);
+
+    storageImageInfo.format = vk::Format::eR32G32Uint;
+    createRenderTarget(renderTargets, "segmentation", storageImageInfo);
 }
 
 void RayTracer::createShaderBindingTable() {
@@ -535,18 +1266,12 @@ void RayTracer::createShaderBindingTable() {
 
     KF_ASSERT(result == vk::Result::eSuccess, "Failed to get ray tracing shader group handles.");
 
-    void *mapped = NULL;
-    result = vkCore::global::device.mapMemory(_sbtBuffer.getMemory(), 0, _sbtBuffer.getSize(), {}, &mapped);
-
-//        KF_ASSERT(result == vk::Result::eSuccess, "Failed to map memory for shader binding table.");
-
-    auto *pData = reinterpret_cast<uint8_t *>(mapped);
+    // The buffer is suballocated, only its own range of the memory is mapped.
+    auto *pData = reinterpret_cast<uint8_t *>(_sbtBuffer.map());
     for (uint32_t i = 0; i < _shaderGroups; ++i) {
         memcpy(pData, shaderHandleStorage.data() + i * groupHandleSize, groupHandleSize); // raygen
         pData += baseAlignment;
     }
-
-    vkCore::global::device.unmapMemory(_sbtBuffer.getMemory());
 }
 
 void RayTracer::createPipeline(const std::vector<vk::DescriptorSetLayout> &descriptorSetLayouts) {
@@ -561,6 +1286,9 @@ void RayTracer::createPipeline(const std::vector<vk::DescriptorSetLayout> &descr
     //auto ahit1 = vk::Initializer::initShaderModuleUnique("shaders/PathTrace1.rahit");
     auto missShadow = vkCore::initShaderModuleUnique(global::assetsPath + "shaders/PathTraceShadow.rmiss",
                                                      KF_GLSLC_PATH);
+    auto chitProcedural = vkCore::initShaderModuleUnique(global::assetsPath + "shaders/PathTraceProcedural.rchit",
+                                                         KF_GLSLC_PATH);
+    auto rint = vkCore::initShaderModuleUnique(global::assetsPath + "shaders/PathTrace.rint", KF_GLSLC_PATH);
 
     vk::PushConstantRange ptPushConstant(vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR |
                                          vk::ShaderStageFlagBits::eClosestHitKHR, // stageFlags
@@ -578,16 +1306,19 @@ void RayTracer::createPipeline(const std::vector<vk::DescriptorSetLayout> &descr
     _layout = vkCore::global::device.createPipelineLayoutUnique(layoutInfo);
     KF_ASSERT(_layout.get(), "Failed to create pipeline layout for path tracing pipeline.");
 
-    std::array<vk::PipelineShaderStageCreateInfo, 5> shaderStages;
+    std::array<vk::PipelineShaderStageCreateInfo, 7> shaderStages;
     shaderStages[0] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eRaygenKHR, rgen.get());
     shaderStages[1] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eMissKHR, miss.get());
     shaderStages[2] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eMissKHR, missShadow.get());
     shaderStages[3] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eClosestHitKHR, chit.get());
     shaderStages[4] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eAnyHitKHR, ahit.get());
     //shaderStages[4] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eAnyHitKHR, ahit1.get());
+    shaderStages[5] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eClosestHitKHR,
+                                                               chitProcedural.get());
+    shaderStages[6] = vkCore::getPipelineShaderStageCreateInfo(vk::ShaderStageFlagBits::eIntersectionKHR, rint.get());
 
     // Set up path tracing shader groups.
-    std::array<vk::RayTracingShaderGroupCreateInfoKHR, 4> groups;
+    std::array<vk::RayTracingShaderGroupCreateInfoKHR, 5> groups;
 
     for (auto &group : groups) {
         group.generalShader = VK_SHADER_UNUSED_KHR;
@@ -609,6 +1340,12 @@ void RayTracer::createPipeline(const std::vector<vk::DescriptorSetLayout> &descr
     groups[3].anyHitShader = 4;
     groups[3].type = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup;
 
+    // Analytic primitives, selected by the instances' shader binding table record offset.
+    groups[4].closestHitShader = 5;
+    groups[4].anyHitShader = 4;
+    groups[4].intersectionShader = 6;
+    groups[4].type = vk::RayTracingShaderGroupTypeKHR::eProceduralHitGroup;
+
     //groups[3].closestHitShader = 4;
     //groups[3].anyHitShader = 3;
     //groups[3].type         = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup;
@@ -632,9 +1369,37 @@ void RayTracer::createPipeline(const std::vector<vk::DescriptorSetLayout> &descr
     _pipeline = static_cast<vk::UniquePipeline>(
             vkCore::global::device.createRayTracingPipelineKHRUnique({}, nullptr, createInfo).value);
 //        KF_ASSERT(mPipeline.get(), "Failed to create path tracing pipeline.");
+
+    createPosePipeline();
+}
+
+void RayTracer::createPosePipeline() {
+    auto comp = vkCore::initShaderModuleUnique(global::assetsPath + "shaders/InstancePoses.comp", KF_GLSLC_PATH);
+
+    vk::PushConstantRange pushConstant(vk::ShaderStageFlagBits::eCompute, // stageFlags
+                                       0,                                 // offset
+                                       sizeof(PosePushConstants));       // size
+
+    vk::PipelineLayoutCreateInfo layoutInfo({},            // flags
+                                            0,             // setLayoutCount
+                                            nullptr,       // pSetLayouts
+                                            1,             // pushConstantRangeCount
+                                            &pushConstant); // pPushConstantRanges
+
+    mPoseLayout = vkCore::global::device.createPipelineLayoutUnique(layoutInfo);
+    KF_ASSERT(mPoseLayout.get(), "Failed to create pipeline layout for instance pose pipeline.");
+
+    vk::ComputePipelineCreateInfo createInfo({},                                                    // flags
+                                             vkCore::getPipelineShaderStageCreateInfo(
+                                                     vk::ShaderStageFlagBits::eCompute, comp.get()), // stage
+                                             mPoseLayout.get());                                   // layout
+
+    mPosePipeline = static_cast<vk::UniquePipeline>(
+            vkCore::global::device.createComputePipelineUnique({}, createInfo).value);
 }
 
-void RayTracer::trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapchainImage, vk::Extent2D extent) {
+void RayTracer::trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapchainImage, vk::Extent2D extent,
+                      uint32_t cameraCount) {
     vk::DeviceSize progSize = mCapabilities.pipelineProperties.shaderGroupBaseAlignment;
 //        vk::DeviceSize sbtSize = progSize * static_cast<vk::DeviceSize>(_shaderGroups);
 
@@ -650,7 +1415,7 @@ void RayTracer::trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapch
 
     vk::StridedDeviceAddressRegionKHR bufferRegionChit(sbtAddress + (3U * progSize), // deviceAddress
                                                        progSize,                       // stride
-                                                       progSize * 1);                 // size
+                                                       progSize * 2);                 // size
 
     vk::StridedDeviceAddressRegionKHR callableShaderBindingTable(0,   // deviceAddress
                                                                  0,   // stride
@@ -662,7 +1427,66 @@ void RayTracer::trace(vk::CommandBuffer swapchainCommandBuffer, vk::Image swapch
                                         &callableShaderBindingTable, // pCallableShaderBindingTable
                                         extent.width,                // width
                                         extent.height,               // height
-                                        1);                         // depth
+                                        cameraCount);               // depth
+
+    if (mTimestampIndex < mTimestamps.size()) {
+        if (mTimestampPool)
+            swapchainCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eRayTracingShaderKHR, mTimestampPool.get(),
+                                                  static_cast<uint32_t>(mTimestampIndex) * timestampsPerFrame + 2);
+
+        auto &timestamps = mTimestamps[mTimestampIndex];
+        timestamps.telemetry.frame = mTelemetryFrame++;
+        timestamps.written = true;
+    }
+}
+
+void RayTracer::collectTelemetry(size_t frameIndex, size_t framesInFlight) {
+    framesInFlight = std::max(framesInFlight, frameIndex + 1);
+
+    if (mTimestamps.size() < framesInFlight) {
+        // Only happens before the first frame, unless the number of frames in flight changed.
+        if (mTimestampPool)
+            vkCore::global::device.waitIdle();
+
+        mTimestamps.assign(framesInFlight, {});
+
+        if (mTimestampPeriod > 0.0F)
+            mTimestampPool = vkCore::initQueryPoolUnique(static_cast<uint32_t>(framesInFlight) * timestampsPerFrame,
+                                                         vk::QueryType::eTimestamp);
+    }
+
+    mTimestampIndex = frameIndex;
+
+    auto &timestamps = mTimestamps[frameIndex];
+    if (!timestamps.written)
+        return;
+
+    timestamps.written = false;
+    auto telemetry = timestamps.telemetry;
+
+    if (mTimestampPool) {
+        std::array<uint64_t, timestampsPerFrame> ticks{};
+
+        auto result = vkCore::global::device.getQueryPoolResults(
+                mTimestampPool.get(),                                              // queryPool
+                static_cast<uint32_t>(frameIndex) * timestampsPerFrame,            // firstQuery
+                timestampsPerFrame,                                                // queryCount
+                sizeof(ticks),                                                     // dataSize
+                ticks.data(),                                                      // pData
+                sizeof(uint64_t),                                                  // stride
+                vk::QueryResultFlagBits::e64);                                    // flags
+
+        // The caller waited for the frame, so the timestamps are only missing if it was never submitted.
+        if (result == vk::Result::eSuccess) {
+            float milliseconds = mTimestampPeriod * 1e-6F;
+            telemetry.tlasBuildTime = static_cast<float>(ticks[1] - ticks[0]) * milliseconds;
+            telemetry.traceTime = static_cast<float>(ticks[2] - ticks[1]) * milliseconds;
+        }
+    }
+
+    mTelemetry.push_back(telemetry);
+    if (mTelemetry.size() > telemetryHistory)
+        mTelemetry.pop_front();
 }
 
 void RayTracer::initDescriptorSet() {
@@ -670,20 +1494,35 @@ void RayTracer::initDescriptorSet() {
     mDescriptors.bindings.add(0,
                               vk::DescriptorType::eAccelerationStructureKHR,
                               vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR);
-    // Output image
+    // Output image, one per camera traced at once
     mDescriptors.bindings.add(1,
                               vk::DescriptorType::eStorageImage,
-                              vk::ShaderStageFlagBits::eRaygenKHR);
+                              vk::ShaderStageFlagBits::eRaygenKHR,
+                              global::maxCameras);
 
     // Albedo
     mDescriptors.bindings.add(2,
                               vk::DescriptorType::eStorageImage,
-                              vk::ShaderStageFlagBits::eRaygenKHR);
+                              vk::ShaderStageFlagBits::eRaygenKHR,
+                              global::maxCameras);
 
     // Normal
     mDescriptors.bindings.add(3,
                               vk::DescriptorType::eStorageImage,
-                              vk::ShaderStageFlagBits::eRaygenKHR);
+                              vk::ShaderStageFlagBits::eRaygenKHR,
+                              global::maxCameras);
+
+    // Depth
+    mDescriptors.bindings.add(4,
+                              vk::DescriptorType::eStorageImage,
+                              vk::ShaderStageFlagBits::eRaygenKHR,
+                              global::maxCameras);
+
+    // Segmentation
+    mDescriptors.bindings.add(5,
+                              vk::DescriptorType::eStorageImage,
+                              vk::ShaderStageFlagBits::eRaygenKHR,
+                              global::maxCameras);
 
     mDescriptors.layout = mDescriptors.bindings.initLayoutUnique();
     mDescriptors.pool = mDescriptors.bindings.initPoolUnique(vkCore::global::swapchainImageCount);
@@ -694,14 +1533,26 @@ void RayTracer::updateDescriptors() {
     vk::WriteDescriptorSetAccelerationStructureKHR tlasInfo(1, &mTlas.as.as);
     mDescriptors.bindings.write(mDescriptorSets, 0, &tlasInfo);
 
-    auto rgbaStorageImageInfo = getStorageImageInfo("rgba");
-    mDescriptors.bindings.write(mDescriptorSets, 1, &rgbaStorageImageInfo);
-
-    auto albedoStorageImageInfo = getStorageImageInfo("albedo");
-    mDescriptors.bindings.write(mDescriptorSets, 2, &albedoStorageImageInfo);
+    // Slots without a camera repeat the first one, they are never accessed.
+    std::array<vk::DescriptorImageInfo, global::maxCameras> rgbaStorageImageInfos;
+    std::array<vk::DescriptorImageInfo, global::maxCameras> albedoStorageImageInfos;
+    std::array<vk::DescriptorImageInfo, global::maxCameras> normalStorageImageInfos;
+    std::array<vk::DescriptorImageInfo, global::maxCameras> depthStorageImageInfos;
+    std::array<vk::DescriptorImageInfo, global::maxCameras> segmentationStorageImageInfos;
+    for (size_t i = 0; i < global::maxCameras; ++i) {
+        const auto &renderTargets = i < mRenderTargets.size() ? mRenderTargets[i] : mRenderTargets.front();
+        rgbaStorageImageInfos[i] = renderTargets->at("rgba").getInfo();
+        albedoStorageImageInfos[i] = renderTargets->at("albedo").getInfo();
+        normalStorageImageInfos[i] = renderTargets->at("normal").getInfo();
+        depthStorageImageInfos[i] = renderTargets->at("depth").getInfo();
+        segmentationStorageImageInfos[i] = renderTargets->at("segmentation").getInfo();
+    }
 
-    auto normalStorageImageInfo = getStorageImageInfo("normal");
-    mDescriptors.bindings.write(mDescriptorSets, 3, &normalStorageImageInfo);
+    mDescriptors.bindings.writeArray(mDescriptorSets, 1, rgbaStorageImageInfos.data());
+    mDescriptors.bindings.writeArray(mDescriptorSets, 2, albedoStorageImageInfos.data());
+    mDescriptors.bindings.writeArray(mDescriptorSets, 3, normalStorageImageInfos.data());
+    mDescriptors.bindings.writeArray(mDescriptorSets, 4, depthStorageImageInfos.data());
+    mDescriptors.bindings.writeArray(mDescriptorSets, 5, segmentationStorageImageInfos.data());
 
     mDescriptors.bindings.update();
 }
@@ -24,11 +24,13 @@
 #include "core/context/global.hpp"
 #include "kuafu_utils.hpp"
 
+#include <cstddef>
+
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 namespace kuafu {
-CameraUBO cameraUBO;
+CamerasUBO camerasUBO;
 DirectionalLightUBO directionalLightUBO;
 PointLightsUBO pointLightsUBO;
 ActiveLightsUBO activeLightsUBO;
@@ -36,47 +38,91 @@ ActiveLightsUBO activeLightsUBO;
 std::shared_ptr<Geometry> triangle = nullptr; ///< A dummy triangle that will be placed in the scene if it empty. This assures the AS creation.
 std::shared_ptr<GeometryInstance> triangleInstance = nullptr;
 
-std::vector<GeometryInstanceSSBO> memAlignedGeometryInstances;
+uint64_t geometryVersion = 0; ///< Monotonic counter handed out as Geometry::version, so versions are never reused.
+
+constexpr vk::DeviceSize initialGeometryBufferSize = 16 * 1024 * 1024;
+constexpr size_t initialGeometryRecordCount = 128;
+
 std::vector<NiceMaterialSSBO> memAlignedMaterials;
 
+Scene::~Scene() {
+    // Instances may outlive the scene.
+    for (const auto &geometryInstance : mGeometryInstances.values())
+        geometryInstance->pScene = nullptr;
+}
+
 auto Scene::getGeometries() const -> const std::vector<std::shared_ptr<Geometry>> & {
-    return mGeometries;
+    return mGeometries.values();
 }
 
 auto Scene::getGeometryInstances() const -> const std::vector<std::shared_ptr<GeometryInstance>> & {
-    return mGeometryInstances;
+    return mGeometryInstances.values();
 }
 
 auto Scene::getGeometryInstance(size_t index) const -> std::shared_ptr<GeometryInstance> {
     if (index < mGeometryInstances.size())
-        return mGeometryInstances[index];
+        return mGeometryInstances.values()[index];
     else
         throw std::runtime_error("Geometry Instances out of bound.");
     return nullptr;
 }
 
-void Scene::submitGeometryInstance(std::shared_ptr<GeometryInstance> geometryInstance) {
+auto Scene::getGeometryInstance(GeometryInstanceHandle handle) const -> std::shared_ptr<GeometryInstance> {
+    auto geometryInstance = mGeometryInstances.get(handle);
+    return geometryInstance ? *geometryInstance : nullptr;
+}
+
+void Scene::attachGeometryInstance(GeometryInstance &geometryInstance) {
+    auto it = mGeometryEntries.find(geometryInstance.geometry.get());
+    KF_ASSERT(it != mGeometryEntries.end(), "Geometry not submitted!");
+
+    geometryInstance.geometryIndex = static_cast<int>(it->second.handle.index);
+    ++it->second.instanceCount;
+}
+
+GeometryInstanceHandle Scene::submitGeometryInstance(std::shared_ptr<GeometryInstance> geometryInstance) {
     if (!mDummy) {
         if (mGeometryInstances.size() > pConfig->mMaxGeometryInstances) {
             throw std::runtime_error(
                     "Failed to submit geometry instance because instance buffer size has been exceeded.");
-            return;
         }
     }
 
-    // mark local geometry index                                    // FIXME: make_instance as scene function
-    for (size_t i = 0; i < mGeometries.size(); i++)
-        if (mGeometries[i] == geometryInstance->geometry)
-            geometryInstance->geometryIndex = i;
+    if (auto it = mGeometryInstanceHandles.find(geometryInstance.get()); it != mGeometryInstanceHandles.end())
+        return it->second;
 
-    KF_ASSERT(geometryInstance->geometryIndex >= 0, "Geometry not submitted!");
+    // The instance notifies a single scene of its changes.
+    KF_ASSERT(geometryInstance->pScene == nullptr || geometryInstance->pScene == this,
+              "Geometry instance was already submitted to another scene!");
 
-    mGeometryInstances.push_back(geometryInstance);
+    attachGeometryInstance(*geometryInstance);
+
+    auto handle = mGeometryInstances.insert(geometryInstance);
+    mGeometryInstanceHandles.emplace(geometryInstance.get(), handle);
+    geometryInstance->pScene = this;
+
+    markGeometryInstanceSlotDirty(handle.index);
     markGeometryInstancesChanged();
+    return handle;
+}
+
+GeometryInstanceHandle Scene::submitGeometryInstance(const GeometryInstance& geometryInstance) {
+    // The copy is a new instance, even if the original was submitted to a scene.
+    auto copy = std::make_shared<GeometryInstance>(geometryInstance);
+    copy->pScene = nullptr;
+
+    return submitGeometryInstance(copy);
 }
 
 void Scene::setGeometryInstances(const std::vector<std::shared_ptr<GeometryInstance>> &geometryInstances) {
+    for (const auto &geometryInstance : mGeometryInstances.values())
+        geometryInstance->pScene = nullptr;
+
     mGeometryInstances.clear();
+    mGeometryInstanceHandles.clear();
+    for (auto &[geometry, entry] : mGeometryEntries)
+        entry.instanceCount = 0;
+
     mGeometryInstances.reserve(geometryInstances.size());
 
     for (auto geometryInstance : geometryInstances) {
@@ -89,79 +135,221 @@ void Scene::setGeometryInstances(const std::vector<std::shared_ptr<GeometryInsta
 void Scene::removeGeometryInstance(const std::shared_ptr<GeometryInstance>& geometryInstance) {
     KF_ASSERT(geometryInstance, "Deleting an invalid geometry instance!");
 
-    mGeometryInstances.erase(
-            std::remove_if(mGeometryInstances.begin(), mGeometryInstances.end(),
-                           [geometryInstance](auto &g) { return geometryInstance == g; }),
-                           mGeometryInstances.end());
+    auto it = mGeometryInstanceHandles.find(geometryInstance.get());
+    if (it != mGeometryInstanceHandles.end())
+        removeGeometryInstance(it->second);
+}
+
+void Scene::removeGeometryInstance(GeometryInstanceHandle handle) {
+    auto geometryInstance = mGeometryInstances.get(handle);
+    if (geometryInstance == nullptr)
+        return;
+
+    if (auto it = mGeometryEntries.find((*geometryInstance)->geometry.get()); it != mGeometryEntries.end())
+        --it->second.instanceCount;
+
+    // The last instance takes the place of the removed one in the instance buffer.
+    uint32_t dense = mGeometryInstances.getDenseIndex(handle);
+
+    (*geometryInstance)->pScene = nullptr;
+    mGeometryInstanceHandles.erase(geometryInstance->get());
+    mGeometryInstances.erase(handle);
+
+    if (dense < mGeometryInstances.size())
+        markGeometryInstanceSlotDirty(mGeometryInstances.getHandle(dense).index);
 
     markGeometryInstancesChanged();
 }
 
+void Scene::markGeometryInstanceDirty(const GeometryInstance *geometryInstance) {
+    auto it = mGeometryInstanceHandles.find(geometryInstance);
+    if (it != mGeometryInstanceHandles.end())
+        markGeometryInstanceSlotDirty(it->second.index);
+}
+
+void Scene::markGeometryInstanceSlotDirty(uint32_t slot) {
+    if (mGeometryInstanceDirty.size() <= slot)
+        mGeometryInstanceDirty.resize(mGeometryInstances.getSlotCount());
+
+    if (!mGeometryInstanceDirty[slot]) {
+        mGeometryInstanceDirty[slot] = true;
+        mDirtyGeometryInstances.push_back(slot);
+    }
+}
+
+void Scene::markAllGeometryInstancesDirty() {
+    for (size_t i = 0; i < mGeometryInstances.size(); ++i)
+        markGeometryInstanceSlotDirty(mGeometryInstances.getHandle(i).index);
+}
+
 void Scene::removeGeometryInstances(const std::vector<std::shared_ptr<GeometryInstance>>& geometryInstances) {
     for (auto& ins: geometryInstances)
         removeGeometryInstance(ins);
 }
 
+void Scene::updateGeometryVertices(const std::shared_ptr<Geometry> &geometry, std::span<const Vertex> vertices) {
+    KF_ASSERT(geometry && geometry->dynamic, "Only dynamic geometries can be updated in place.");
+    KF_ASSERT(geometry->primitives.empty(), "The vertices of procedural geometries can not be updated.");
+    KF_ASSERT(vertices.size() == geometry->vertices.size(), "Expected {} vertices, got {}.",
+              geometry->vertices.size(), vertices.size());
+
+    std::copy(vertices.begin(), vertices.end(), geometry->vertices.begin());
+
+    // A geometry that was not uploaded yet gets the new vertices with its upload.
+    if (!geometry->initialized || !mGeometryAllocations.contains(geometry.get()))
+        return;
+
+    // The attributes are written over the uploaded ones, they have to be packed the same way.
+    auto packed = packVertices(*geometry);
+    constexpr uint32_t attributeFlags = GeometryLayout::eCompact | GeometryLayout::eColor;
+    KF_ASSERT((packed.layout.flags & attributeFlags) ==
+              (mGeometryAllocations.at(geometry.get()).layout.flags & attributeFlags),
+              "The vertex layout or vertex colors of a geometry can not change after its upload.");
+
+    mVertexUpdates[geometry.get()] = {
+            .positions = std::move(packed.positions),
+            .attributes = std::move(packed.attributes),
+            .layout = packed.layout
+    };
+}
+
+void Scene::updateGeometryVertices(const std::shared_ptr<Geometry> &geometry, vk::Buffer positions,
+                                   vk::DeviceSize offset) {
+    KF_ASSERT(geometry && geometry->dynamic, "Only dynamic geometries can be updated in place.");
+    KF_ASSERT(geometry->primitives.empty(), "The vertices of procedural geometries can not be updated.");
+    KF_ASSERT(geometry->initialized && mGeometryAllocations.contains(geometry.get()),
+              "A geometry has to be uploaded before its positions can be updated from a device buffer.");
+
+    mVertexUpdates[geometry.get()] = {.buffer = positions, .offset = offset};
+}
+
+void Scene::setInstancePoses(std::span<const Pose> poses) {
+    static_assert(sizeof(Pose) == sizeof(float) * PoseLayout{}.stride, "Pose does not match the default PoseLayout.");
+
+    setInstancePoses({reinterpret_cast<const float *>(poses.data()), poses.size() * PoseLayout{}.stride}, {});
+}
+
+void Scene::setInstancePoses(std::span<const float> poses, const PoseLayout &layout) {
+    KF_ASSERT(layout.stride > 0 && poses.size() % layout.stride == 0, "{} floats are no multiple of the pose stride {}.",
+              poses.size(), layout.stride);
+    KF_ASSERT(std::max({layout.positionOffset + 3, layout.rotationOffset + 4, layout.scaleOffset + 3}) <= layout.stride,
+              "A pose does not fit into the stride {}.", layout.stride);
+
+    size_t poseCount = poses.size() / layout.stride;
+    KF_ASSERT(poseCount <= mGeometryInstances.size(), "{} poses for {} geometry instances.",
+              poseCount, mGeometryInstances.size());
+
+    // Instances that are no longer posed get their own transforms uploaded again.
+    for (size_t i = poseCount; i < getInstancePoseCount(); ++i)
+        markGeometryInstanceSlotDirty(mGeometryInstances.getHandle(i).index);
+
+    mInstancePoses.assign(poses.begin(), poses.end());
+    mInstancePoseLayout = layout;
+    mUploadInstancePoses = true;
+}
+
+auto Scene::getInstancePoseCount() const -> size_t {
+    // Instances may have been removed since, the dummy is never posed.
+    if (mDummy)
+        return 0;
+
+    return std::min(mInstancePoses.size() / mInstancePoseLayout.stride, mGeometryInstances.size());
+}
+
+auto Scene::getInstancePoses() const -> std::span<const float> {
+    return std::span<const float>(mInstancePoses).first(getInstancePoseCount() * mInstancePoseLayout.stride);
+}
+
 void Scene::clearGeometryInstances() {
     // Only allow clearing the scene if there is no dummy element.
     if (!mDummy) {
+        for (const auto &geometryInstance : mGeometryInstances.values())
+            geometryInstance->pScene = nullptr;
+
         mGeometryInstances.clear();
+        mGeometryInstanceHandles.clear();
+        for (auto &[geometry, entry] : mGeometryEntries)
+            entry.instanceCount = 0;
+
         markGeometryInstancesChanged();
     }
 }
 
-void Scene::submitGeometry(std::shared_ptr<Geometry> geometry) {
-    if (!mDummy) {
-        if (mGeometries.size() >= pConfig->mMaxGeometry) {
-            throw std::runtime_error(
-                    "Failed to submit geometry because geometries buffer size has been exceeded.");
-            return;
-        }
-    }
+GeometryHandle Scene::submitGeometry(std::shared_ptr<Geometry> geometry) {
+    // Shared geometries, e.g. the primitives from getSharedSphere(), only occupy a single slot.
+    if (auto it = mGeometryEntries.find(geometry.get()); it != mGeometryEntries.end())
+        return it->second.handle;
+
+    auto handle = mGeometries.insert(geometry);
+    mGeometryEntries.emplace(geometry.get(), GeometryEntry{handle});
 
-    mGeometries.push_back(geometry);
     markGeometriesChanged();
+    return handle;
 }
 
-void Scene::submitGeometry(const Geometry& geometry) {
-    if (!mDummy) {
-        if (mGeometries.size() >= pConfig->mMaxGeometry) {
-            throw std::runtime_error(
-                    "Failed to submit geometry because geometries buffer size has been exceeded.");
-            return;
-        }
-    }
-
+GeometryHandle Scene::submitGeometry(const Geometry& geometry) {
     auto g = std::make_shared<Geometry>();
     *g = geometry;
-    mGeometries.push_back(g);
-    markGeometriesChanged();
+    g->initialized = false;
+    return submitGeometry(g);
 }
 
 void Scene::setGeometries(const std::vector<std::shared_ptr<Geometry>> &geometries) {
     mGeometries.clear();
+    mGeometryEntries.clear();
     mGeometries.reserve(geometries.size());
 
     for (auto geometry : geometries) {
         submitGeometry(geometry);
     }
 
+    // The instances refer to the geometries by index, which changed.
+    for (const auto &geometryInstance : mGeometryInstances.values())
+        attachGeometryInstance(*geometryInstance);
+
+    markAllGeometryInstancesDirty();
     markGeometriesChanged();
+    markGeometryInstancesChanged();
 }
 
 void Scene::removeGeometry(std::shared_ptr<Geometry> geometry) {
-    throw std::runtime_error("Not implemented!");
+    auto it = mGeometryEntries.find(geometry.get());
+    if (it != mGeometryEntries.end())
+        removeGeometry(it->second.handle);
 }
 
 void Scene::removeGeometry(uint32_t geometryIndex) {
-    throw std::runtime_error("Not implemented!");
+    removeGeometry(mGeometries.find(geometryIndex));
+}
+
+void Scene::removeGeometry(GeometryHandle handle) {
+    auto geometry = mGeometries.get(handle);
+    if (geometry == nullptr)
+        return;
+
+    auto it = mGeometryEntries.find(geometry->get());
+    KF_ASSERT(it->second.instanceCount == 0, "Removing geometry {} which is still referenced by {} instances.",
+              handle.index, it->second.instanceCount);
+
+    mVertexUpdates.erase(geometry->get());
+    mGeometryEntries.erase(it);
+    mGeometries.erase(handle);
+
+    markGeometriesChanged();
 }
 
 void Scene::clearGeometries() {
     KF_INFO( "Clearing geometry." );
 
     mGeometries.clear();
+    mGeometryEntries.clear();
+    mVertexUpdates.clear();
+
+    for (const auto &geometryInstance : mGeometryInstances.values())
+        geometryInstance->pScene = nullptr;
+
     mGeometryInstances.clear();
+    mGeometryInstanceHandles.clear();
 
     // Reset texture counter.
     global::textureIndex = 0;
@@ -171,7 +359,7 @@ void Scene::clearGeometries() {
 }
 
 auto Scene::findGeometry(std::string_view path) const -> std::shared_ptr<Geometry> {
-    for (std::shared_ptr<Geometry> geometry : mGeometries) {
+    for (const auto &geometry : mGeometries.values()) {
         if (geometry->path == path) {
             return geometry;
         }
@@ -209,16 +397,23 @@ void Scene::prepareBuffers() {
     // Resize and initialize buffers with "dummy data".
     // The advantage of doing this is that the buffers are all initialized right away (even though it is invalid data) and
     // this makes it possible to call fill instead of initialize again, when changing any of the data below.
-    std::vector<GeometryInstanceSSBO> geometryInstances(pConfig->mMaxGeometryInstances);
-    mGeometryInstancesBuffer.init(geometryInstances, global::maxResources);
+    // Instances are only written by the frames' command buffers, from the frames' own staging buffers, see
+    // recordGeometryInstanceUploads(). All frames in flight read the same buffer.
+    mGeometryInstancesBuffer.initDeviceLocal(pConfig->mMaxGeometryInstances, vkCore::global::graphicsFamilyIndex, true);
+    markAllGeometryInstancesDirty();
 
-    // @todo is this even necessary?
+    // Materials and geometry records only change between frames, after all frames in flight finished. A single copy
+    // without a persistent staging buffer is enough.
     std::vector<NiceMaterialSSBO> materials(pConfig->mMaxMaterials);
-    mMaterialBuffers.init(materials, global::maxResources);
+    mMaterialBuffers.initImmutable(materials);
+
+    // Both grow on demand, the sizes are only a starting point.
+    mGeometryBuffer.init(initialGeometryBufferSize);
+    mGeometryAllocations.clear();
+
+    std::vector<GeometryRecordSSBO> geometryRecords(initialGeometryRecordCount);
+    mGeometryRecordsBuffer.initImmutable(geometryRecords);
 
-    mVertexBuffers.resize(pConfig->mMaxGeometry);
-    mIndexBuffers.resize(pConfig->mMaxGeometry);
-    mMaterialIndexBuffers.resize(pConfig->mMaxGeometry);
     mTextures.resize(pConfig->mMaxTextures);
 
     mCameraUniformBuffer.init();
@@ -228,25 +423,32 @@ void Scene::prepareBuffers() {
 }
 
 
-void Scene::uploadUniformBuffers(uint32_t imageIndex) {
-    uploadCameraBuffer(imageIndex);
+void Scene::uploadUniformBuffers(uint32_t imageIndex, const std::vector<Camera *> &cameras) {
+    uploadCameraBuffer(imageIndex, cameras);
     uploadLightBuffers(imageIndex);
 }
 
-void Scene::uploadCameraBuffer(uint32_t imageIndex) {
-    // Upload camera.
-    KF_ASSERT(mCurrentCamera, "Trying to render with an invalid camera!");
+void Scene::uploadCameraBuffer(uint32_t imageIndex, const std::vector<Camera *> &cameras) {
+    // Upload cameras, one slot per launch depth.
+    KF_ASSERT(cameras.size() <= global::maxCameras, "Trying to render more than {} cameras at once!", global::maxCameras);
+
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        auto camera = cameras[i];
+        KF_ASSERT(camera, "Trying to render with an invalid camera!");
 
-    cameraUBO.view = mCurrentCamera->getViewMatrix();
-    cameraUBO.viewInverse = mCurrentCamera->getViewInverseMatrix();
+        auto &cameraUBO = camerasUBO.cameras[i];
+        cameraUBO.view = camera->getViewMatrix();
+        cameraUBO.viewInverse = camera->getViewInverseMatrix();
 
-    cameraUBO.projection = mCurrentCamera->getProjectionMatrix();
-    cameraUBO.projectionInverse = mCurrentCamera->getProjectionInverseMatrix();
+        cameraUBO.projection = camera->getProjectionMatrix();
+        cameraUBO.projectionInverse = camera->getProjectionInverseMatrix();
 
-    cameraUBO.position = glm::vec4(mCurrentCamera->getPosition(), mCurrentCamera->getAperture());
-    cameraUBO.front = glm::vec4(mCurrentCamera->getFront(), mCurrentCamera->getFocalLength());
+        cameraUBO.position = glm::vec4(camera->getPosition(), camera->getAperture());
+        cameraUBO.front = glm::vec4(camera->getFront(), camera->getFocalLength());
+        cameraUBO.info = glm::ivec4(camera->getWidth(), camera->getHeight(), camera->mFrameCount, 0);
+    }
 
-    mCameraUniformBuffer.upload(imageIndex, cameraUBO);
+    mCameraUniformBuffer.upload(imageIndex, camerasUBO);
 }
 
 void Scene::uploadLightBuffers(uint32_t imageIndex) {
@@ -308,88 +510,101 @@ void Scene::uploadEnvironmentMap() {
             "cubemap format not supported: " + mEnvironmentMapTexturePath);
 }
 
-void Scene::uploadGeometries() {
-  mUploadGeometries = false;
+void Scene::uploadMaterials(vkCore::UploadBatch &batch) {
+    mUploadedMaterialVersion = global::materials().getVersion();
 
     memAlignedMaterials.clear();
-    memAlignedMaterials.reserve(global::materials.size());
+    memAlignedMaterials.reserve(global::materials().size());
 
+    // Textures are shared by all materials and lights using them, only textures that are not resident get loaded.
+    std::vector<std::shared_ptr<vkCore::Texture>> textures(pConfig->mMaxTextures);
+    std::unordered_map<const vkCore::Texture *, int> textureIndices;
     global::textureIndex = 0;
 
+    // Load all missing textures at once, the lookups below only hit the cache.
+    std::vector<std::string> texturePaths;
+    for (const auto &material : global::materials())
+        for (const auto *path : {&material.diffuseTexPath, &material.metallicTexPath,
+                                 &material.roughnessTexPath, &material.transmissionTexPath})
+            if (!path->empty())
+                texturePaths.push_back(*path);
+
+    for (const auto &light : pActiveLights)
+        if (!light->texPath.empty())
+            texturePaths.push_back(light->texPath);
+
+    mTextureCache.load(texturePaths, batch);
+
+    // Only a texture that can not be loaded falls back to the constant value, a full texture table is an error.
+    auto loadTexture = [&](const std::string &path) -> std::shared_ptr<vkCore::Texture> {
+        try {
+            return mTextureCache.acquire(path);
+        } catch (const std::runtime_error &) {
+            return nullptr;
+        }
+    };
+
+    auto getTextureIndex = [&](const std::shared_ptr<vkCore::Texture> &texture) -> int {
+        auto [it, inserted] = textureIndices.try_emplace(texture.get(), static_cast<int>(global::textureIndex));
+        if (inserted) {
+            KF_ASSERT(global::textureIndex < textures.size(), "Can not bind more than {} textures.", textures.size());
+            textures[global::textureIndex++] = texture;
+        }
+
+        return it->second;
+    };
+
     // Create all textures of a material
-    for (size_t i = 0; i < global::materials.size(); ++i) {
+    const auto &materials = global::materials();
+    for (size_t i = 0; i < materials.size(); ++i) {
         // Convert to memory aligned struct
         NiceMaterialSSBO mat2 {
-                .diffuse = {global::materials[i].diffuseColor, 0},
-                .emission = {global::materials[i].emission, global::materials[i].emissionStrength},
-                .alpha = global::materials[i].alpha,
-                .metallic = global::materials[i].metallic,
-                .specular = global::materials[i].specular,
-                .roughness = global::materials[i].roughness,
-                .ior = global::materials[i].ior,
-                .transmission = global::materials[i].transmission
+                .diffuse = {materials[i].diffuseColor, 0},
+                .emission = {materials[i].emission, materials[i].emissionStrength},
+                .alpha = materials[i].alpha,
+                .metallic = materials[i].metallic,
+                .specular = materials[i].specular,
+                .roughness = materials[i].roughness,
+                .ior = materials[i].ior,
+                .transmission = materials[i].transmission
         };
 
         // Set up texture
         // TODO: make these array
-        if (!global::materials[i].diffuseTexPath.empty()) {
-            try {
-                auto texture = std::make_shared<vkCore::Texture>();
-                texture->init(global::materials[i].diffuseTexPath);
-                mat2.diffuseTexIdx = static_cast<int>(global::textureIndex);
-                mTextures[global::textureIndex++] = texture;
-            } catch (...) {
+        mat2.diffuseTexIdx = -1;
+        if (!materials[i].diffuseTexPath.empty()) {
+            if (auto texture = loadTexture(materials[i].diffuseTexPath))
+                mat2.diffuseTexIdx = getTextureIndex(texture);
+            else
                 KF_WARN("Failed to load diffuse texture: {}, base color will be used!",
-                        global::materials[i].diffuseTexPath);
-                mat2.diffuseTexIdx = -1;
-            }
-        } else {
-            mat2.diffuseTexIdx = -1;
+                        materials[i].diffuseTexPath);
         }
 
-        if (!global::materials[i].metallicTexPath.empty()) {
-            try {
-                auto texture = std::make_shared<vkCore::Texture>();
-                texture->init(global::materials[i].metallicTexPath);
-                mat2.metallicTexIdx = static_cast<int>(global::textureIndex);
-                mTextures[global::textureIndex++] = texture;
-            } catch (...) {
+        mat2.metallicTexIdx = -1;
+        if (!materials[i].metallicTexPath.empty()) {
+            if (auto texture = loadTexture(materials[i].metallicTexPath))
+                mat2.metallicTexIdx = getTextureIndex(texture);
+            else
                 KF_WARN("Failed to load metallic texture: {}, metallic value will be used!",
-                        global::materials[i].metallicTexPath);
-                mat2.metallicTexIdx = -1;
-            }
-        } else {
-            mat2.metallicTexIdx = -1;
+                        materials[i].metallicTexPath);
         }
 
-        if (!global::materials[i].roughnessTexPath.empty()) {
-            try {
-                auto texture = std::make_shared<vkCore::Texture>();
-                texture->init(global::materials[i].roughnessTexPath);
-                mat2.roughnessTexIdx = static_cast<int>(global::textureIndex);
-                mTextures[global::textureIndex++] = texture;
-            } catch (...) {
+        mat2.roughnessTexIdx = -1;
+        if (!materials[i].roughnessTexPath.empty()) {
+            if (auto texture = loadTexture(materials[i].roughnessTexPath))
+                mat2.roughnessTexIdx = getTextureIndex(texture);
+            else
                 KF_WARN("Failed to load roughness texture: {}, roughness value will be used!",
-                        global::materials[i].roughnessTexPath);
-                mat2.roughnessTexIdx = -1;
-            }
-        } else {
-            mat2.roughnessTexIdx = -1;
+                        materials[i].roughnessTexPath);
         }
 
-        if (!global::materials[i].transmissionTexPath.empty()) {
-            try {
-                auto texture = std::make_shared<vkCore::Texture>();
-                texture->init(global::materials[i].transmissionTexPath);
-                mat2.transmissionTexIdx = static_cast<int>(global::textureIndex);
-                mTextures[global::textureIndex++] = texture;
-            } catch (...) {
-                KF_WARN("Failed to load roughness texture: {}, roughness value will be used!",
-                        global::materials[i].transmissionTexPath);
-                mat2.transmissionTexIdx = -1;
-            }
-        } else {
-            mat2.transmissionTexIdx = -1;
+        mat2.transmissionTexIdx = -1;
+        if (!materials[i].transmissionTexPath.empty()) {
+            if (auto texture = loadTexture(materials[i].transmissionTexPath))
+                mat2.transmissionTexIdx = getTextureIndex(texture);
+            else
+                KF_WARN("Failed to load transmission texture: {}, transmission value will be used!",
+                        materials[i].transmissionTexPath);
         }
 
         memAlignedMaterials.push_back(mat2);
@@ -397,77 +612,228 @@ void Scene::uploadGeometries() {
 
     // upload active light textures
     for (auto& light: pActiveLights) {
+        light->texID = -1;
         if (!light->texPath.empty()) {
-            try {
-                auto texture = std::make_shared<vkCore::Texture>();
-                texture->init(light->texPath);
-                light->texID = global::textureIndex;
-                mTextures[global::textureIndex++] = texture;
-            } catch (...) {
+            if (auto texture = loadTexture(light->texPath))
+                light->texID = getTextureIndex(texture);
+            else
                 KF_WARN("Failed to load active light texture {}, degrade to spot light!", light->texPath);
-                light->texID = -1;
-            }
-        } else {
-            light->texID = -1;
         }
     }
 
+    // Textures no material or light refers to anymore are released.
+    mTextures = std::move(textures);
+    mTextureCache.evictUnused();
+
     // upload materials
-    mMaterialBuffers.upload(memAlignedMaterials);
+    mMaterialBuffers.upload(memAlignedMaterials, batch);
+}
+
+void Scene::uploadGeometries(vkCore::UploadBatch &batch) {
+  mUploadGeometries = false;
+
+    uploadMaterials(batch);
 
+    // Geometries that left the scene give their data back.
+    auto freeGeometry = [this](const GeometryAllocation &allocation) {
+        mGeometryBuffer.free(allocation.positionOffset);
+        mGeometryBuffer.free(allocation.attributeOffset);
+        mGeometryBuffer.free(allocation.indexOffset);
+        mGeometryBuffer.free(allocation.matIndexOffset);
+    };
+
+    for (auto it = mGeometryAllocations.begin(); it != mGeometryAllocations.end();) {
+        if (!mGeometryEntries.contains(it->first)) {
+            freeGeometry(it->second);
+            it = mGeometryAllocations.erase(it);
+        } else
+            ++it;
+    }
+
+    // New or modified geometries are copied into free ranges of the geometry buffer.
+    for (const auto &geometry : mGeometries.values()) {
+
+        auto it = mGeometryAllocations.find(geometry.get());
+        if (geometry->initialized && it != mGeometryAllocations.end())
+            continue;
+
+        if (it != mGeometryAllocations.end())
+            freeGeometry(it->second);
+
+        auto packed = packGeometry(*geometry);
+        mGeometryAllocations[geometry.get()] = {
+                .layout = packed.layout,
+                .positionOffset = mGeometryBuffer.add(packed.positions),
+                .attributeOffset = mGeometryBuffer.add(packed.attributes),
+                .indexOffset = mGeometryBuffer.add(packed.indices),
+                .matIndexOffset = mGeometryBuffer.add(geometry->matIndex)
+        };
+
+        geometry->initialized = true;
+        geometry->version = ++geometryVersion;
+    }
+
+    mGeometryBuffer.flush(batch);
+
+    // The records are rewritten as a whole, growing the geometry buffer moves all data.
+    // Records are indexed by geometry index, the slots of removed geometries are left empty.
+    std::vector<GeometryRecordSSBO> geometryRecords(mGeometries.getSlotCount());
     for (size_t i = 0; i < mGeometries.size(); ++i) {
-        if (i < mGeometries.size()) {
-            if (mGeometries[i] != nullptr) {
-                if (!mGeometries[i]->initialized) {
-                    // Only keep one copy of both index and vertex buffers each.
-                    mVertexBuffers[i].init(
-                            mGeometries[i]->vertices, 2, true,
-                            {vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR}
-                    );
-                    mIndexBuffers[i].init(
-                            mGeometries[i]->indices, 2, true,
-                            {vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR}
-
-                    );
-                    mMaterialIndexBuffers[i].init(mGeometries[i]->matIndex, 2, true);
-
-                    mGeometries[i]->initialized = true;
-//                        KF_SUCCESS( "Initialized Geometries." );
-                }
-            }
-        }
+        const auto &geometry = mGeometries.values()[i];
+
+        const auto &allocation = mGeometryAllocations.at(geometry.get());
+        geometryRecords[mGeometries.getHandle(i).index] = {
+                .attributes = mGeometryBuffer.getAddress(allocation.attributeOffset),
+                .indices = mGeometryBuffer.getAddress(allocation.indexOffset),
+                .matIndices = mGeometryBuffer.getAddress(allocation.matIndexOffset),
+                .flags = allocation.layout.flags
+        };
+    }
+
+    if (geometryRecords.size() > mGeometryRecordsBuffer.getCount()) {
+        geometryRecords.resize(std::max<size_t>(geometryRecords.size(), mGeometryRecordsBuffer.getCount() * 2));
+        mGeometryRecordsBuffer.initImmutable(geometryRecords, batch);
+    } else if (!geometryRecords.empty())
+        mGeometryRecordsBuffer.upload(geometryRecords, batch);
+
+    if (vkCore::global::allocator) {
+        auto stats = vkCore::global::allocator->getStats(vkCore::MemoryUsage::eDeviceLocal);
+        KF_DEBUG("Device local memory: {} blocks ({} bytes), {} allocations ({} bytes, {} dedicated)",
+                 stats.blockCount, stats.blockBytes, stats.allocationCount, stats.allocationBytes,
+                 stats.dedicatedCount);
     }
 
 //        KF_SUCCESS( "Uploaded Geometries." );
 }
 
-void Scene::uploadGeometryInstances() {
+auto Scene::uploadGeometryInstances(size_t frameIndex) -> std::vector<uint32_t> {
     if (pConfig->mMaxGeometryInstancesChanged) {
         pConfig->mMaxGeometryInstancesChanged = false;
 
-        std::vector<GeometryInstanceSSBO> geometryInstances(pConfig->mMaxGeometryInstances);
-        mGeometryInstancesBuffer.init(geometryInstances, global::maxResources);
+        mGeometryInstancesBuffer.initDeviceLocal(pConfig->mMaxGeometryInstances, vkCore::global::graphicsFamilyIndex, true);
+        markAllGeometryInstancesDirty();
 
         updateSceneDescriptors();
     }
 
     mUploadGeometryInstancesToBuffer = false;
 
-    memAlignedGeometryInstances.resize(mGeometryInstances.size());
-    std::transform(mGeometryInstances.begin(), mGeometryInstances.end(), memAlignedGeometryInstances.begin(),
-                   [](std::shared_ptr<GeometryInstance> instance) {
-                       auto idx = static_cast<uint32_t>(instance->geometryIndex);
-                       return GeometryInstanceSSBO{instance->transform,
-                                                   idx};
-                   });
+    // The copies of a frame that was never recorded, e.g. because the window is minimized, are lost.
+    if (!mInstanceCopies.empty())
+        markAllGeometryInstancesDirty();
+
+    mInstanceCopies.clear();
+
+    // Only dirty instances are uploaded, in the order of the instance buffer.
+    std::vector<uint32_t> dirty;
+    dirty.reserve(mDirtyGeometryInstances.size());
+
+    for (auto slot : mDirtyGeometryInstances) {
+        mGeometryInstanceDirty[slot] = false;
+        if (auto handle = mGeometryInstances.find(slot); handle.valid())
+            dirty.push_back(mGeometryInstances.getDenseIndex(handle));
+    }
 
-    mGeometryInstancesBuffer.upload(memAlignedGeometryInstances);
+    mDirtyGeometryInstances.clear();
+    std::sort(dirty.begin(), dirty.end());
+
+    if (dirty.empty())
+        return dirty;
+
+    if (mInstanceStaging.size() <= frameIndex)
+        mInstanceStaging.resize(frameIndex + 1);
+
+    if (!mInstanceStaging[frameIndex])
+        mInstanceStaging[frameIndex] = std::make_unique<InstanceStaging>();
+
+    // The frame that used the staging buffer last is done, it can be rewritten or replaced.
+    auto &staging = *mInstanceStaging[frameIndex];
+    if (staging.capacity < dirty.size()) {
+        staging.capacity = std::max({dirty.size(), staging.capacity * 2, size_t{16}});
+
+        staging.buffer.init(sizeof(GeometryInstanceSSBO) * staging.capacity,
+                            vk::BufferUsageFlagBits::eTransferSrc,
+                            {vkCore::global::graphicsFamilyIndex},
+                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        staging.pData = reinterpret_cast<GeometryInstanceSSBO *>(staging.buffer.map());
+    }
+
+    const auto &instances = mGeometryInstances.values();
+    size_t poseCount = getInstancePoseCount();
+
+    constexpr vk::DeviceSize recordSize = sizeof(GeometryInstanceSSBO);
+    constexpr vk::DeviceSize transformSize = offsetof(GeometryInstanceSSBO, geometryIndex);
+
+    for (size_t i = 0; i < dirty.size(); ++i) {
+        const auto &instance = instances[dirty[i]];
+        glm::mat4 transpose = glm::transpose(instance->transform);
+
+        staging.pData[i] = {
+                .transform = {transpose[0], transpose[1], transpose[2]},
+                .geometryIndex = static_cast<uint32_t>(instance->geometryIndex),
+                .materialIndex = instance->material.getIndex()
+        };
+
+        // The transforms of posed instances are written on the device, see RayTracer::recordInstancePoses().
+        vk::DeviceSize skip = dirty[i] < poseCount ? transformSize : 0;
+        vk::BufferCopy copy(i * recordSize + skip, dirty[i] * recordSize + skip, recordSize - skip);
+
+        // Consecutive instances are copied at once.
+        if (!mInstanceCopies.empty() && skip == 0 && dirty[i] == dirty[i - 1] + 1 &&
+            mInstanceCopies.back().srcOffset + mInstanceCopies.back().size == copy.srcOffset)
+            mInstanceCopies.back().size += copy.size;
+        else
+            mInstanceCopies.push_back(copy);
+    }
+
+    mInstanceCopySource = staging.buffer.get();
 
 //        KF_SUCCESS( "Uploaded geometry instances." );
+    return dirty;
+}
+
+void Scene::recordGeometryInstanceUploads(vk::CommandBuffer cmdBuf) {
+    if (mInstanceCopies.empty())
+        return;
+
+    // Previous frames still pose and trace with the instances that are overwritten here.
+    vk::MemoryBarrier barrier({},                                   // srcAccessMask
+                              vk::AccessFlagBits::eTransferWrite); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR, // srcStageMask
+                           vk::PipelineStageFlagBits::eTransfer,            // dstStageMask
+                           {},                                              // dependencyFlags
+                           1,                                               // memoryBarrierCount
+                           &barrier,                                        // pMemoryBarriers
+                           0,                                               // bufferMemoryBarrierCount
+                           nullptr,                                         // pBufferMemoryBarriers
+                           0,                                               // imageMemoryBarrierCount
+                           nullptr);                                       // pImageMemoryBarriers
+
+    cmdBuf.copyBuffer(mInstanceCopySource, mGeometryInstancesBuffer.get(0), mInstanceCopies);
+
+    // The poses are applied to the instances next, then the trace reads them.
+    barrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite,                                   // srcAccessMask
+                                vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite); // dstAccessMask
+
+    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,                    // srcStageMask
+                           vk::PipelineStageFlagBits::eComputeShader |
+                           vk::PipelineStageFlagBits::eRayTracingShaderKHR,         // dstStageMask
+                           {},                                                      // dependencyFlags
+                           1,                                                       // memoryBarrierCount
+                           &barrier,                                                // pMemoryBarriers
+                           0,                                                       // bufferMemoryBarrierCount
+                           nullptr,                                                 // pBufferMemoryBarriers
+                           0,                                                       // imageMemoryBarrierCount
+                           nullptr);                                               // pImageMemoryBarriers
+
+    mInstanceCopies.clear();
 }
 
 void Scene::translateDummy() {
-    auto dummyInstance = getGeometryInstance(0);
+    auto dummyInstance = triangleInstance;
     auto camPos = mCurrentCamera->getPosition();
     dummyInstance->setTransform(glm::translate(glm::mat4(1.0F), glm::vec3(camPos.x, camPos.y, camPos.z + 2.0F)));
 }
@@ -512,8 +878,10 @@ void Scene::removeDummy() {
         mDummy = false;
 
 //            KF_VERBOSE( "Removing dummy element." );
+        removeGeometryInstance(triangleInstance);
         removeGeometry(triangle);
         triangle = nullptr;
+        triangleInstance = nullptr;
     }
 }
 
@@ -539,32 +907,19 @@ void Scene::initSceneDescriptorSets() {
     mSceneDescriptors.bindings.add(5, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eClosestHitKHR);
 
     mSceneDescriptors.layout = mSceneDescriptors.bindings.initLayoutUnique();
-  mSceneDescriptors.pool = mSceneDescriptors.bindings.initPoolUnique(global::maxResources);
+  mSceneDescriptors.pool = mSceneDescriptors.bindings.initPoolUnique(vkCore::global::dataCopies);
   mSceneDescriptorSets = vkCore::allocateDescriptorSets(mSceneDescriptors.pool.get(), mSceneDescriptors.layout.get());
 }
 
 void Scene::initGeometryDescriptorSets() {
   mGeometryDescriptors.bindings.reset();
 
-    // Vertex buffers
+    // Geometry records, the geometry data itself is read through their device addresses
   mGeometryDescriptors.bindings.add(0,
                                       vk::DescriptorType::eStorageBuffer,
-                                      vk::ShaderStageFlagBits::eClosestHitKHR,
-                                      pConfig->mMaxGeometry,
-                                      vk::DescriptorBindingFlagBits::eUpdateAfterBind);
-
-    // Index buffers
-  mGeometryDescriptors.bindings.add(1,
-                                      vk::DescriptorType::eStorageBuffer,
-                                      vk::ShaderStageFlagBits::eClosestHitKHR,
-                                      pConfig->mMaxGeometry,
-                                      vk::DescriptorBindingFlagBits::eUpdateAfterBind);
-
-    // MatIndex buffers
-  mGeometryDescriptors.bindings.add(2,
-                                      vk::DescriptorType::eStorageBuffer,
-                                      vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eAnyHitKHR,
-                                      pConfig->mMaxGeometry,
+                                      vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eAnyHitKHR |
+                                      vk::ShaderStageFlagBits::eIntersectionKHR,
+                                      1,
                                       vk::DescriptorBindingFlagBits::eUpdateAfterBind);
 
     // Textures
@@ -609,60 +964,20 @@ void Scene::updateSceneDescriptors() {
         throw std::runtime_error("No default environment map provided.");
     }
 
-    mSceneDescriptors.bindings.writeArray(mSceneDescriptorSets, 0,
-                                          mCameraUniformBuffer._bufferInfos.data());
+    // Every frame in flight reads its own copy of the uniform buffers.
+    mSceneDescriptors.bindings.write(mSceneDescriptorSets, 0, mCameraUniformBuffer._bufferInfos);
     mSceneDescriptors.bindings.writeArray(mSceneDescriptorSets, 1,
                                           mGeometryInstancesBuffer.getDescriptorInfos().data());
     mSceneDescriptors.bindings.write(mSceneDescriptorSets, 2, &environmentMapTextureInfo);
-    mSceneDescriptors.bindings.writeArray(mSceneDescriptorSets, 3,
-                                          mDirectionalLightUniformBuffer._bufferInfos.data());
-    mSceneDescriptors.bindings.writeArray(mSceneDescriptorSets, 4,
-                                          mPointLightsUniformBuffer._bufferInfos.data());
-    mSceneDescriptors.bindings.writeArray(mSceneDescriptorSets, 5,
-                                          mActiveLightsUniformBuffer._bufferInfos.data());
+    mSceneDescriptors.bindings.write(mSceneDescriptorSets, 3, mDirectionalLightUniformBuffer._bufferInfos);
+    mSceneDescriptors.bindings.write(mSceneDescriptorSets, 4, mPointLightsUniformBuffer._bufferInfos);
+    mSceneDescriptors.bindings.write(mSceneDescriptorSets, 5, mActiveLightsUniformBuffer._bufferInfos);
     mSceneDescriptors.bindings.update();
 }
 
 void Scene::updateGeometryDescriptors() {
-    KF_ASSERT( mGeometries.size( ) <= pConfig->mMaxGeometry, "Can not bind more than ", pConfig->mMaxGeometry, " geometries." );
-    KF_ASSERT( mVertexBuffers.size( ) == pConfig->mMaxGeometry, "Vertex buffers container size and geometry limit must be identical." );
-    KF_ASSERT( mIndexBuffers.size( ) == pConfig->mMaxGeometry, "Index buffers container size and geometry limit must be identical." );
     KF_ASSERT( mTextures.size( ) == pConfig->mMaxTextures, "Texture container size and texture limit must be identical." );
 
-    // Vertex buffers infos
-    std::vector<vk::DescriptorBufferInfo> vertexBufferInfos;
-    vertexBufferInfos.reserve(mVertexBuffers.size());
-    for (const auto &vertexBuffer : mVertexBuffers) {
-        vk::DescriptorBufferInfo vertexDataBufferInfo(vertexBuffer.get().empty() ? nullptr : vertexBuffer.get(0),
-                                                      0,
-                                                      VK_WHOLE_SIZE);
-
-        vertexBufferInfos.push_back(vertexDataBufferInfo);
-    }
-
-    // Index buffers infos
-    std::vector<vk::DescriptorBufferInfo> indexBufferInfos;
-    indexBufferInfos.reserve(mIndexBuffers.size());
-    for (const auto &indexBuffer : mIndexBuffers) {
-        vk::DescriptorBufferInfo indexDataBufferInfo(indexBuffer.get().empty() ? nullptr : indexBuffer.get(0),
-                                                     0,
-                                                     VK_WHOLE_SIZE);
-
-        indexBufferInfos.push_back(indexDataBufferInfo);
-    }
-
-    // MatIndices infos
-    std::vector<vk::DescriptorBufferInfo> matIndexBufferInfos;
-    matIndexBufferInfos.reserve(mMaterialIndexBuffers.size());
-    for (const auto &materialIndexBuffer : mMaterialIndexBuffers) {
-        vk::DescriptorBufferInfo materialIndexDataBufferInfo(
-                materialIndexBuffer.get().empty() ? nullptr : materialIndexBuffer.get(0),
-                0,
-                VK_WHOLE_SIZE);
-
-        matIndexBufferInfos.push_back(materialIndexDataBufferInfo);
-    }
-
     // Texture samplers
     std::vector<vk::DescriptorImageInfo> textureInfos;
     textureInfos.reserve(mTextures.size());
@@ -682,9 +997,8 @@ void Scene::updateGeometryDescriptors() {
     }
 
     // Write to and update descriptor bindings
-    mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 0, vertexBufferInfos.data());
-    mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 1, indexBufferInfos.data());
-    mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 2, matIndexBufferInfos.data()); // matIndices
+    mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 0,
+        mGeometryRecordsBuffer.getDescriptorInfos().data()); // geometry records
     mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 3, textureInfos.data());
     mGeometryDescriptors.bindings.writeArray(mGeometryDescriptorSets, 4,
         mMaterialBuffers.getDescriptorInfos().data()); // materials
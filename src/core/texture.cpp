@@ -0,0 +1,158 @@
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+#include "core/texture.hpp"
+#include "core/context/global.hpp"
+
+namespace kuafu {
+constexpr vk::DeviceSize stagingChunkSize = 64 * 1024 * 1024; ///< The staging memory of a chunk of textures, unless a single texture is larger.
+constexpr size_t stagingChunkCount = 2; ///< The number of chunks whose uploads may be in flight at once.
+
+std::string TextureCache::getKey(const std::string &path) {
+    // Different relative paths or links to the same file share the texture.
+    std::error_code error;
+    auto canonicalPath = std::filesystem::weakly_canonical(path, error);
+    return error ? path : canonicalPath.string();
+}
+
+std::shared_ptr<vkCore::Texture> TextureCache::acquire(const std::string &path) {
+    auto key = getKey(path);
+
+    auto it = mTextures.find(key);
+    if (it != mTextures.end())
+        return it->second;
+
+    auto texture = std::make_shared<vkCore::Texture>();
+    texture->init(key);
+
+    mTextures.emplace(key, texture);
+    KF_DEBUG("Texture loaded: {} ({} resident)", key, mTextures.size());
+
+    return texture;
+}
+
+void TextureCache::load(const std::vector<std::string> &paths, vkCore::UploadBatch &batch) {
+    struct Image {
+        std::string key;
+        stbi_uc *pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        vk::DeviceSize offset = 0;
+    };
+
+    std::vector<Image> images;
+    std::unordered_set<std::string> keys;
+    for (const auto &path : paths) {
+        auto key = getKey(path);
+        if (mTextures.find(key) == mTextures.end() && keys.insert(key).second) {
+            // Only the header is read up front, files that can not be read are skipped.
+            Image image{key};
+            int channels;
+            if (stbi_info(image.key.c_str(), &image.width, &image.height, &channels) != 0)
+                images.push_back(std::move(image));
+        }
+    }
+
+    if (images.empty())
+        return;
+
+    // Images are decoded, staged and recorded in chunks, so neither the decoded pixels nor the staging memory grow
+    // with the number of textures. A chunk holds at least one image.
+    auto getSize = [](const Image &image) {
+        return (static_cast<vk::DeviceSize>(image.width) * image.height * 4 + 15) / 16 * 16;
+    };
+
+    std::deque<uint64_t> chunkValues;  // the batch values of the chunks whose staging memory is still in use
+    size_t loaded = 0;
+
+    for (size_t first = 0; first < images.size();) {
+        size_t last = first;
+        vk::DeviceSize stagingSize = 0;
+        while (last < images.size() && (last == first || stagingSize + getSize(images[last]) <= stagingChunkSize)) {
+            images[last].offset = stagingSize;
+            stagingSize += getSize(images[last++]);
+        }
+
+        std::span<Image> chunk(images.begin() + first, images.begin() + last);
+        first = last;
+
+        // Decode on all cores, the files are independent of each other.
+        std::atomic<size_t> next = 0;
+        auto decode = [&chunk, &next]() {
+            for (size_t i = next++; i < chunk.size(); i = next++) {
+                int channels;
+                chunk[i].pixels = stbi_load(chunk[i].key.c_str(), &chunk[i].width, &chunk[i].height, &channels,
+                                            STBI_rgb_alpha);
+            }
+        };
+
+        auto threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U), chunk.size());
+        std::vector<std::thread> workers;
+        workers.reserve(threadCount - 1);
+        for (size_t i = 1; i < threadCount; ++i)
+            workers.emplace_back(decode);
+
+        decode();
+        for (auto &worker : workers)
+            worker.join();
+
+        // At most stagingChunkCount chunks are in flight, wait for the oldest one before staging another.
+        if (chunkValues.size() >= stagingChunkCount) {
+            auto semaphore = batch.getSemaphore();
+            vk::SemaphoreWaitInfo waitInfo({}, 1, &semaphore, &chunkValues.front());
+            auto result = vkCore::global::device.waitSemaphores(waitInfo, UINT64_MAX);
+            KF_ASSERT(result == vk::Result::eSuccess, "Failed to wait for texture uploads.");
+            chunkValues.pop_front();
+        }
+
+        auto pStagingBuffer = std::make_shared<vkCore::Buffer>(stagingSize,
+                                                               vk::BufferUsageFlagBits::eTransferSrc,
+                                                               std::vector<uint32_t>{batch.getQueueFamilyIndex()},
+                                                               vkCore::MemoryUsage::eStaging);
+
+        auto pStaging = static_cast<uint8_t *>(pStagingBuffer->map());
+
+        for (auto &image : chunk) {
+            if (!image.pixels)
+                continue;
+
+            memcpy(pStaging + image.offset, image.pixels, static_cast<size_t>(image.width) * image.height * 4);
+            stbi_image_free(image.pixels);
+            image.pixels = nullptr;
+
+            auto texture = std::make_shared<vkCore::Texture>();
+            texture->init(image.key,
+                          vk::Extent3D{static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), 1},
+                          pStagingBuffer->get(), image.offset, batch);
+
+            mTextures.emplace(image.key, texture);
+            ++loaded;
+        }
+
+        // Submitting each chunk releases its staging memory as soon as its copies finished.
+        batch.keepAlive(std::move(pStagingBuffer));
+        chunkValues.push_back(batch.submit());
+    }
+
+    KF_DEBUG("Textures loaded: {} ({} resident)", loaded, mTextures.size());
+}
+
+size_t TextureCache::evictUnused() {
+    size_t evicted = 0;
+
+    for (auto it = mTextures.begin(); it != mTextures.end();) {
+        if (it->second.use_count() == 1) {
+            it = mTextures.erase(it);
+            ++evicted;
+        } else {
+            ++it;
+        }
+    }
+
+    if (evicted > 0)
+        KF_DEBUG("Textures evicted: {} ({} resident)", evicted, mTextures.size());
+
+    return evicted;
+}
+}
@@ -20,10 +20,15 @@
 //    misrepresented as being the original software.
 // 3. This notice may not be removed or altered from any source distribution.
 //
+#include <chrono>
+
 #include "core/time.hpp"
 #include "stdafx.hpp"
 
 namespace kuafu {
+// Not using SDL's ticks, SDL is not initialized in offscreen mode.
+const auto startTime = std::chrono::steady_clock::now();
+
 float deltaTime;
 float prevTime;
 std::vector<uint32_t> allFrames;
@@ -88,7 +93,7 @@ void Time::startBenchmark(float length) {
 }
 
 auto Time::getTime() -> float {
-    return static_cast<float>( SDL_GetTicks()) / 1000.0F;
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
 }
 
 auto Time::getDeltaTime() -> float {
@@ -100,7 +105,7 @@ auto Time::getFramesPerSecond() -> uint32_t {
 }
 
 void Time::update() {
-    float current_time = static_cast<float>( SDL_GetTicks()) / 1000.0F;
+    float current_time = getTime();
 
     frames++;
 
@@ -52,12 +52,9 @@ Kuafu::Kuafu(std::shared_ptr<Config> config) {
     if (mContext.pConfig->getAssetsPath().empty())
         mContext.pConfig->setAssetsPath(mContext.pConfig->sDefaultAssetsPath);
 
+    // Offscreen mode does not touch SDL at all, the Vulkan loader is loaded directly by the context.
     if (pWindow)
         pWindow->init();
-    else {
-        assert(SDL_Init(SDL_INIT_VIDEO) == 0);
-        assert(SDL_Vulkan_LoadLibrary(nullptr) == 0);
-    }
 
     mContext.init();
 }
@@ -84,6 +81,17 @@ void Kuafu::run() {
     mContext.render();
 }
 
+void Kuafu::run(const std::vector<Camera*> &cameras) {
+    if (!mRunning)
+        return;
+
+    Time::update();
+
+    for (auto camera : cameras)
+        camera->update();
+    mContext.render(cameras);
+}
+
 std::vector<uint8_t> Kuafu::downloadLatestFrame(Camera* cam) {
     if (mContext.pConfig->mPresent) {
         global::logger->warn("Downloading images when using viewer is not recommended. "
@@ -94,6 +102,19 @@ std::vector<uint8_t> Kuafu::downloadLatestFrame(Camera* cam) {
         return cam->downloadLatestFrame();
 }
 
+std::shared_ptr<Readback> Kuafu::downloadNextFrameAsync(Camera* cam, Readback::Callback callback) {
+    return downloadNextFrameAsync(cam, Readback::eColor, std::move(callback));
+}
+
+std::shared_ptr<Readback> Kuafu::downloadNextFrameAsync(Camera* cam, Readback::Channels channels,
+                                                        Readback::Callback callback) {
+    if (mContext.pConfig->mPresent)
+        global::logger->warn("Downloading images when using viewer is not recommended. "
+                             "Hint for SAPIEN users: set use_viewer=False in production.");
+
+    return mContext.requestReadback(cam, channels, std::move(callback));
+}
+
 void Kuafu::setWindow(std::shared_ptr<Window> window) {
     pWindow = window;
     mContext.pWindow = pWindow;
@@ -119,8 +140,8 @@ void Kuafu::reset() {
 //    mContext.mCurrentScene->getCamera()->resetView();
 
 //    // Delete all textures
-//    global::materials.clear();
-//    global::materials.reserve(mContext.pConfig->mMaxMaterials);
+//    global::materials().clear();
+//    global::materials().reserve(mContext.pConfig->mMaxMaterials);
 
 //    mContext.mCurrentScene->mTextures.clear();
 //    mContext.mCurrentScene->mTextures.resize(static_cast<size_t>(mContext.pConfig->mMaxTextures));